@@ -7,6 +7,17 @@
 Image::Image(int width, int height):
     width(width),
     height(height),
+    frameHeight(height),
+    frameTop(0),
+    pixels(new uint32_t[width * height])
+{
+}
+
+Image::Image(int width, int height, int frameHeight, int frameTop):
+    width(width),
+    height(height),
+    frameHeight(frameHeight),
+    frameTop(frameTop),
     pixels(new uint32_t[width * height])
 {
 }
@@ -11,12 +11,18 @@ class Image
 public:
     Image(int width, int height);
 
+    // Creates an image holding rows [frameTop, frameTop + height) of a
+    // taller frame.
+    Image(int width, int height, int frameHeight, int frameTop);
+
     static glm::vec4 linearToSRGB(const glm::vec4& color);
     static uint32_t colorToRGBA8(const glm::vec4& color);
     bool save(const std::string& fileName) const;
 
     int width;
     int height;
+    int frameHeight;
+    int frameTop;
     std::unique_ptr<uint32_t[]> pixels;
 };
 
@@ -0,0 +1,71 @@
+// Copyright (C) 2013 Sami Kyöstilä
+
+#include "ImageStream.h"
+#include "Image.h"
+
+#include <cassert>
+#include <iostream>
+
+ImageStream::ImageStream():
+    m_file(0),
+    m_width(0),
+    m_height(0),
+    m_rowsWritten(0)
+{
+}
+
+ImageStream::~ImageStream()
+{
+    close();
+}
+
+bool ImageStream::open(const std::string& fileName, int width, int height)
+{
+    close();
+    m_file = fopen(fileName.c_str(), "wb");
+    if (!m_file) {
+        std::cerr << "Unable to open " << fileName << " for writing" << std::endl;
+        return false;
+    }
+    m_width = width;
+    m_height = height;
+    m_rowsWritten = 0;
+    m_row.reset(new uint8_t[width * 3]);
+    return fprintf(m_file, "P6\n%d %d\n255\n", width, height) > 0;
+}
+
+bool ImageStream::write(const Image& band)
+{
+    assert(m_file);
+    assert(band.width == m_width);
+    assert(band.frameTop == m_rowsWritten);
+
+    for (int y = 0; y < band.height; y++) {
+        const uint32_t* src = &band.pixels[y * band.width];
+        for (int x = 0; x < band.width; x++) {
+            m_row[x * 3 + 0] = (src[x] >> 16) & 0xff;
+            m_row[x * 3 + 1] = (src[x] >> 8) & 0xff;
+            m_row[x * 3 + 2] = src[x] & 0xff;
+        }
+        if (fwrite(&m_row[0], 3, m_width, m_file) != static_cast<size_t>(m_width))
+            return false;
+    }
+    m_rowsWritten += band.height;
+    return fflush(m_file) == 0;
+}
+
+bool ImageStream::close()
+{
+    if (!m_file)
+        return true;
+    bool complete = m_rowsWritten == m_height;
+    bool ok = fclose(m_file) == 0;
+    m_file = 0;
+    m_row.reset();
+    return ok && complete;
+}
+
+int ImageStream::rowsWritten() const
+{
+    return m_rowsWritten;
+}
@@ -0,0 +1,38 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef IMAGESTREAM_H
+#define IMAGESTREAM_H
+
+#include "Util.h"
+
+#include <cstdio>
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+class Image;
+
+/**
+ *  Writes an image to a binary PPM file a band of rows at a time so that the
+ *  whole image never needs to be resident in memory.
+ */
+class ImageStream: public NonCopyable
+{
+public:
+    ImageStream();
+    ~ImageStream();
+
+    bool open(const std::string& fileName, int width, int height);
+    bool write(const Image& band);
+    bool close();
+
+    int rowsWritten() const;
+
+private:
+    FILE* m_file;
+    int m_width;
+    int m_height;
+    int m_rowsWritten;
+    std::unique_ptr<uint8_t[]> m_row;
+};
+
+#endif
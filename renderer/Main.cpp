@@ -1,5 +1,6 @@
 // Copyright (C) 2012 Sami Kyöstilä
 #include "Scheduler.h"
+#include "cpu/BandScheduler.h"
 #include "cpu/Scheduler.h"
 #include "gl/Scheduler.h"
 #include "scene/Parser.h"
@@ -101,6 +102,11 @@ int main(int argc, char** argv)
 
     int width = 640;
     int height = 480;
+    int bandHeight = 0;
+    int passes = 4;
+    size_t memoryLimit = 0;
+    bool bvhStatistics = false;
+    cpu::Options cpuOptions;
     for (size_t i = 1; i < args.size(); i++) {
         bool hasMoreArgs = i < args.size() - 1;
         if (args[i] == "--help") {
@@ -108,7 +114,43 @@ int main(int argc, char** argv)
                    "Options:\n"
                    "    -w SIZE    Image width (640)\n"
                    "    -h SIZE    Image height (480)\n"
-                   "    -r NAME    Renderer (cpu, gl)\n", args[0].c_str());
+                   "    -r NAME    Renderer (cpu, gl)\n"
+                   "    -b ROWS    Render in bands of ROWS rows to out.ppm\n"
+                   "    -m MB      Render in bands that fit in MB megabytes\n"
+                   "    -p COUNT   Passes per band (4)\n"
+                   "    -a FORMAT  Accumulator format (float, half, rgb9e5)\n"
+                   "    -i NAME    Integrator of the cpu renderer (path, bdpt, ppm, mlt,\n"
+                   "               vpl, ao, direct, normal, albedo), also chosen with the\n"
+                   "               number keys of the preview\n"
+                   "    -d DEPTH   Maximum path depth of the cpu renderer (8)\n"
+                   "    --roulette-depth DEPTH\n"
+                   "               Path depth from which the cpu renderer terminates\n"
+                   "               paths with Russian roulette (3)\n"
+                   "    --light-split COUNT\n"
+                   "               Light samples at the first hit of the cpu renderer (1)\n"
+                   "    --indirect-split COUNT\n"
+                   "               Indirect rays at the first hit of the cpu renderer (1)\n"
+                   "    --photons COUNT\n"
+                   "               Photons stored per pass of the photon mapper (200000)\n"
+                   "    --photon-radius RADIUS\n"
+                   "               Initial gather radius of the photon mapper, estimated\n"
+                   "               from the scene by default\n"
+                   "    --guide    Guide the paths of the path tracer by the light found\n"
+                   "               in earlier passes\n"
+                   "    --cache    End the paths of the path tracer early with the light\n"
+                   "               cached from earlier paths, for fast previews\n"
+                   "    --light-candidates COUNT\n"
+                   "               Choose the direct light at the first hit of the path\n"
+                   "               tracer from COUNT candidates per sample and the choices\n"
+                   "               of nearby pixels, for scenes with many lights (0)\n"
+                   "    --ao-distance DIST\n"
+                   "               Distance within which surfaces occlude each other\n"
+                   "               in ambient occlusion (1)\n"
+                   "    --isa NAME Instruction set of the cpu kernels (sse2, avx2, avx512),\n"
+                   "               detected by default\n"
+                   "    --bvh-stats\n"
+                   "               Print the size, quality and build time of the bounding\n"
+                   "               volume hierarchies of the scene\n", args[0].c_str());
             return 1;
         } else if (args[i] == "-w" && hasMoreArgs) {
             width = atoi(args[++i].c_str());
@@ -116,6 +158,53 @@ int main(int argc, char** argv)
             height = atoi(args[++i].c_str());
         } else if (args[i] == "-r" && hasMoreArgs) {
             rendererName = args[++i];
+        } else if (args[i] == "-b" && hasMoreArgs) {
+            bandHeight = atoi(args[++i].c_str());
+        } else if (args[i] == "-m" && hasMoreArgs) {
+            memoryLimit = atoi(args[++i].c_str()) * 1024 * 1024ull;
+        } else if (args[i] == "-p" && hasMoreArgs) {
+            passes = atoi(args[++i].c_str());
+        } else if (args[i] == "-a" && hasMoreArgs) {
+            if (!cpu::parseAccumulatorFormat(args[++i], cpuOptions.accumulatorFormat)) {
+                std::cerr << "Unknown accumulator format: " << args[i] << std::endl;
+                return 1;
+            }
+        } else if (args[i] == "-i" && hasMoreArgs) {
+            if (!cpu::parseIntegratorType(args[++i], cpuOptions.integrator)) {
+                std::cerr << "Unknown integrator: " << args[i] << std::endl;
+                return 1;
+            }
+        } else if (args[i] == "-d" && hasMoreArgs) {
+            cpuOptions.maxDepth = atoi(args[++i].c_str());
+        } else if (args[i] == "--roulette-depth" && hasMoreArgs) {
+            cpuOptions.rouletteDepth = atoi(args[++i].c_str());
+        } else if (args[i] == "--light-split" && hasMoreArgs) {
+            cpuOptions.lightSplit = atoi(args[++i].c_str());
+        } else if (args[i] == "--indirect-split" && hasMoreArgs) {
+            cpuOptions.indirectSplit = atoi(args[++i].c_str());
+        } else if (args[i] == "--photons" && hasMoreArgs) {
+            cpuOptions.photonCount = atoi(args[++i].c_str());
+        } else if (args[i] == "--photon-radius" && hasMoreArgs) {
+            cpuOptions.photonRadius = atof(args[++i].c_str());
+        } else if (args[i] == "--guide") {
+            cpuOptions.pathGuiding = true;
+        } else if (args[i] == "--cache") {
+            cpuOptions.radianceCache = true;
+        } else if (args[i] == "--light-candidates" && hasMoreArgs) {
+            cpuOptions.lightCandidates = atoi(args[++i].c_str());
+        } else if (args[i] == "--ao-distance" && hasMoreArgs) {
+            cpuOptions.occlusionDistance = atof(args[++i].c_str());
+        } else if (args[i] == "--isa" && hasMoreArgs) {
+            if (!cpu::parseIsa(args[++i], cpuOptions.isa)) {
+                std::cerr << "Unknown instruction set: " << args[i] << std::endl;
+                return 1;
+            }
+            if (!cpu::isaSupported(cpuOptions.isa)) {
+                std::cerr << "Instruction set not supported by this processor: " << args[i] << std::endl;
+                return 1;
+            }
+        } else if (args[i] == "--bvh-stats") {
+            bvhStatistics = true;
         }
     }
 
@@ -128,14 +217,31 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    if (bvhStatistics)
+        std::cout << "BVH: " << scene.bvhStatistics() << std::endl;
+
+    if (memoryLimit)
+        bandHeight = cpu::BandScheduler::bandHeightForMemoryLimit(cpuOptions, width, height, memoryLimit);
+
+    if (bandHeight) {
+        if (rendererName != "cpu") {
+            std::cerr << "Band rendering is only supported by the cpu renderer" << std::endl;
+            return 1;
+        }
+        cpu::BandScheduler scheduler(scene, cpuOptions, width, height, bandHeight, passes, "out.ppm");
+        scheduler.run();
+        return 0;
+    }
+
     std::unique_ptr<Image> image(new Image(width, height));
     std::unique_ptr<Preview> preview(Preview::create(image.get(), true));
     std::unique_ptr<Scheduler> scheduler;
 
     if (rendererName == "cpu") {
-        scheduler.reset(new cpu::Scheduler(scene, image.get(), preview.get()));
+        scheduler.reset(new cpu::Scheduler(scene, cpuOptions, image.get(), preview.get()));
     } else if (rendererName == "gl") {
-        scheduler.reset(new gl::Scheduler(scene, image.get(), preview.get()));
+        bool compactBuffers = cpuOptions.accumulatorFormat != cpu::AccumulatorFormat::Float;
+        scheduler.reset(new gl::Scheduler(scene, image.get(), preview.get(), compactBuffers));
     } else {
         std::cerr << "Unknown renderer: " << rendererName << std::endl;
         return 1;
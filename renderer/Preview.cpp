@@ -97,6 +97,22 @@ void Preview::update(std::thread::id threadId, int pass, int samples, int xOffse
     }
 }
 
+void Preview::setDescription(const std::string& description)
+{
+    m_description = description;
+}
+
+void Preview::setNumberKeyHandler(std::function<void(int number)> handler)
+{
+    m_numberKeyHandler = handler;
+}
+
+void Preview::restart()
+{
+    m_threadStatistics.clear();
+    m_startTime = std::chrono::steady_clock::now();
+}
+
 void Preview::updateScreen(int xOffset, int yOffset, int width, int height)
 {
     auto* src = &m_image->pixels[0];
@@ -164,6 +180,8 @@ void Preview::drawStatusLine()
     status << std::chrono::duration_cast<std::chrono::seconds>(elapsed).count() % 60 << " s, ";
     formatSI(status, totalSamples / float(m_image->width * m_image->height), "samples/pixel, ");
     formatSI(status, totalPerSecond, "samples/s");
+    if (!m_description.empty())
+        status << ", " << m_description;
 
     SDL_Color textColor = {0x0, 0x0, 0x0, 0x0};
     uint32_t backgroundColor = SDL_MapRGB(surface->format, 0xaa, 0xaa, 0xaa);
@@ -226,6 +244,9 @@ bool Preview::processEvents()
                 else if (event.key.keysym.sym == SDLK_s && (event.key.keysym.mod & KMOD_LCTRL)) {
                     std::cout << "Saving preview to preview.png" << std::endl;
                     m_image->save("preview.png");
+                } else if (event.key.keysym.sym >= SDLK_0 && event.key.keysym.sym <= SDLK_9 &&
+                           m_numberKeyHandler) {
+                    m_numberKeyHandler(event.key.keysym.sym - SDLK_0);
                 }
                 break;
         }
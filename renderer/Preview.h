@@ -5,8 +5,10 @@
 #include "GLHelpers.h"
 
 #include <chrono>
+#include <functional>
 #include <map>
 #include <memory>
+#include <string>
 #include <thread>
 #include <SDL/SDL_ttf.h>
 
@@ -22,6 +24,22 @@ public:
     bool processEvents();
     void update(std::thread::id threadId, int pass, int samples, int xOffset, int yOffset, int width, int height);
 
+    /**
+     *  Sets renderer specific statistics shown at the end of the status line.
+     */
+    void setDescription(const std::string& description);
+
+    /**
+     *  Sets |handler| to be called with the number of each number key
+     *  pressed in the preview window.
+     */
+    void setNumberKeyHandler(std::function<void(int number)> handler);
+
+    /**
+     *  Forgets the samples counted so far, e.g. when rendering starts over.
+     */
+    void restart();
+
 private:
     Preview(Image* image);
     void updateScreen(int xOffset, int yOffset, int width, int height);
@@ -34,6 +52,8 @@ private:
     Texture m_texture;
     Framebuffer m_fbo;
     SDL_Surface* m_statusSurface;
+    std::string m_description;
+    std::function<void(int number)> m_numberKeyHandler;
 
     class ThreadStatistics
     {
@@ -0,0 +1,261 @@
+// Copyright (C) 2013 Sami Kyöstilä
+
+#include "Accumulator.h"
+#include "Random.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace cpu;
+
+bool cpu::parseAccumulatorFormat(const std::string& name, AccumulatorFormat& format)
+{
+    if (name == "float")
+        format = AccumulatorFormat::Float;
+    else if (name == "half")
+        format = AccumulatorFormat::Half;
+    else if (name == "rgb9e5")
+        format = AccumulatorFormat::RGB9E5;
+    else
+        return false;
+    return true;
+}
+
+Accumulator::Accumulator(AccumulatorFormat format, size_t size):
+    m_format(format)
+{
+    switch (format)
+    {
+    case AccumulatorFormat::Float:
+        m_float.reset(new glm::vec3[size]);
+        break;
+    case AccumulatorFormat::Half:
+        m_half.reset(new uint16_t[size * 3]());
+        m_deviation.reset(new uint32_t[size]());
+        break;
+    case AccumulatorFormat::RGB9E5:
+        m_rgb9e5.reset(new uint32_t[size]());
+        m_deviation.reset(new uint32_t[size]());
+        break;
+    }
+}
+
+size_t Accumulator::bytesPerPixel() const
+{
+    switch (m_format)
+    {
+    case AccumulatorFormat::Float:
+        return sizeof(glm::vec3);
+    case AccumulatorFormat::Half:
+        return 3 * sizeof(uint16_t) + sizeof(uint32_t);
+    case AccumulatorFormat::RGB9E5:
+        return 2 * sizeof(uint32_t);
+    }
+    return 0;
+}
+
+glm::vec3 Accumulator::storedMean(size_t index) const
+{
+    switch (m_format)
+    {
+    case AccumulatorFormat::Float:
+        return m_float[index];
+    case AccumulatorFormat::Half:
+        return glm::vec3(halfToFloat(m_half[index * 3 + 0]),
+                         halfToFloat(m_half[index * 3 + 1]),
+                         halfToFloat(m_half[index * 3 + 2]));
+    case AccumulatorFormat::RGB9E5:
+        return decodeRGB9E5(m_rgb9e5[index]);
+    }
+    return glm::vec3();
+}
+
+glm::vec3 Accumulator::add(size_t index, const glm::vec3& batchMean, int batches, Random& random)
+{
+    glm::vec3 mean = storedMean(index);
+    if (m_format == AccumulatorFormat::Float) {
+        mean += (batchMean - mean) / static_cast<float>(batches);
+        m_float[index] = mean;
+        return mean;
+    }
+
+    // The stored mean covers the first |folded| batches, which is the
+    // largest power of two below |batches|.
+    int folded = 1;
+    while (folded * 2 < batches)
+        folded *= 2;
+    if (batches == 1)
+        folded = 0;
+    int pending = batches - folded;
+
+    glm::vec3 deviation = pending > 1 ? decodeSignedRGB8E5(m_deviation[index]) : glm::vec3();
+    deviation += (batchMean - mean - deviation) / static_cast<float>(pending);
+    glm::vec3 result = mean + deviation * (static_cast<float>(pending) / batches);
+
+    if (pending == folded || batches == 1) {
+        storeMean(index, result, random);
+        return storedMean(index);
+    }
+    glm::vec3 rounding;
+    for (int i = 0; i < 3; i++)
+        rounding[i] = random.generateUniform();
+    m_deviation[index] = encodeSignedRGB8E5(deviation, rounding);
+    return mean + decodeSignedRGB8E5(m_deviation[index]) * (static_cast<float>(pending) / batches);
+}
+
+void Accumulator::storeMean(size_t index, const glm::vec3& result, Random& random)
+{
+    switch (m_format)
+    {
+    case AccumulatorFormat::Float:
+        m_float[index] = result;
+        break;
+    case AccumulatorFormat::Half:
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                uint32_t roundingBits = static_cast<uint32_t>(random.generateUniform() * 0x2000) & 0x1fff;
+                m_half[index * 3 + i] = floatToHalf(result[i], roundingBits);
+            }
+        }
+        break;
+    case AccumulatorFormat::RGB9E5:
+        {
+            glm::vec3 rounding;
+            for (int i = 0; i < 3; i++)
+                rounding[i] = random.generateUniform();
+            m_rgb9e5[index] = encodeRGB9E5(result, rounding);
+        }
+        break;
+    }
+}
+
+uint16_t Accumulator::floatToHalf(float value, uint32_t roundingBits)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    bits &= 0x7fffffff;
+
+    // Infinity, NaN and values too large for a half
+    if (bits >= 0x477ff000)
+        return sign | (bits > 0x7f800000 ? 0x7e00 : 0x7bff);
+
+    // Denormals
+    if (bits < 0x38800000)
+    {
+        float scaled = std::abs(value) * 16777216.f;
+        return sign | static_cast<uint16_t>(scaled + roundingBits / 8192.f);
+    }
+
+    // Adding the rounding bits below the kept mantissa bits rounds up with
+    // the probability given by the discarded fraction when roundingBits is
+    // uniformly distributed, or to the nearest value when it is one half.
+    bits += roundingBits;
+    bits -= (127 - 15) << 23;
+    return sign | std::min<uint32_t>(bits >> 13, 0x7bff);
+}
+
+float Accumulator::halfToFloat(uint16_t value)
+{
+    uint32_t sign = (value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+    uint32_t bits;
+
+    if (!exponent)
+    {
+        float result = mantissa / 16777216.f;
+        return sign ? -result : result;
+    }
+    else if (exponent == 31)
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    else
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+// Shared exponent encoding as described in the EXT_texture_shared_exponent
+// specification.
+uint32_t Accumulator::encodeRGB9E5(const glm::vec3& color, const glm::vec3& rounding)
+{
+    const int mantissaBits = 9;
+    const int exponentBias = 15;
+    const float maxValue = 65408.f;
+
+    glm::vec3 c = glm::clamp(color, glm::vec3(0), glm::vec3(maxValue));
+    float maxComponent = std::max(c.r, std::max(c.g, c.b));
+    if (maxComponent <= 0)
+        return 0;
+
+    int exponent;
+    frexpf(maxComponent, &exponent);
+    exponent = std::max(-exponentBias, exponent) + exponentBias;
+
+    // Leave room for rounding up without overflowing the mantissa.
+    float scale = ldexpf(1.f, mantissaBits - (exponent - exponentBias));
+    if (maxComponent * scale >= (1 << mantissaBits) - 1 && exponent < 31)
+    {
+        exponent++;
+        scale *= .5f;
+    }
+
+    uint32_t r = std::min(511u, static_cast<uint32_t>(c.r * scale + rounding.r));
+    uint32_t g = std::min(511u, static_cast<uint32_t>(c.g * scale + rounding.g));
+    uint32_t b = std::min(511u, static_cast<uint32_t>(c.b * scale + rounding.b));
+    return (exponent << 27) | (b << 18) | (g << 9) | r;
+}
+
+glm::vec3 Accumulator::decodeRGB9E5(uint32_t value)
+{
+    float scale = ldexpf(1.f, static_cast<int>(value >> 27) - 15 - 9);
+    return glm::vec3(value & 0x1ff, (value >> 9) & 0x1ff, (value >> 18) & 0x1ff) * scale;
+}
+
+uint32_t Accumulator::encodeSignedRGB8E5(const glm::vec3& color, const glm::vec3& rounding)
+{
+    const int mantissaBits = 8;
+    const int exponentBias = 15;
+    const float maxValue = 65280.f;
+
+    glm::vec3 c = glm::min(glm::abs(color), glm::vec3(maxValue));
+    float maxComponent = std::max(c.r, std::max(c.g, c.b));
+    if (!(maxComponent > 0))
+        return 0;
+
+    int exponent;
+    frexpf(maxComponent, &exponent);
+    exponent = std::max(-exponentBias, exponent) + exponentBias;
+
+    float scale = ldexpf(1.f, mantissaBits - (exponent - exponentBias));
+    if (maxComponent * scale >= (1 << mantissaBits) - 1 && exponent < 31)
+    {
+        exponent++;
+        scale *= .5f;
+    }
+
+    uint32_t result = exponent << 27;
+    for (int i = 0; i < 3; i++)
+    {
+        uint32_t magnitude = std::min(255u, static_cast<uint32_t>(c[i] * scale + rounding[i]));
+        uint32_t sign = color[i] < 0 ? 0x100 : 0;
+        result |= (sign | magnitude) << (9 * i);
+    }
+    return result;
+}
+
+glm::vec3 Accumulator::decodeSignedRGB8E5(uint32_t value)
+{
+    float scale = ldexpf(1.f, static_cast<int>(value >> 27) - 15 - 8);
+    glm::vec3 result;
+    for (int i = 0; i < 3; i++)
+    {
+        uint32_t component = (value >> (9 * i)) & 0x1ff;
+        result[i] = (component & 0xff) * ((component & 0x100) ? -scale : scale);
+    }
+    return result;
+}
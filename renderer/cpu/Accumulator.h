@@ -0,0 +1,82 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_ACCUMULATOR_H
+#define CPU_ACCUMULATOR_H
+
+#include "renderer/Util.h"
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+namespace cpu
+{
+
+class Random;
+
+enum class AccumulatorFormat
+{
+    Float,  // 12 bytes per pixel
+    Half,   // 10 bytes per pixel: 6 for the mean, 4 for the deviation
+    RGB9E5, // 8 bytes per pixel: 4 for the mean, 4 for the deviation
+};
+
+bool parseAccumulatorFormat(const std::string& name, AccumulatorFormat& format);
+
+/**
+ *  Running per-pixel mean of the rendered radiance. The sample count is shared
+ *  by all pixels, so only the mean is stored per pixel.
+ *
+ *  Rounding the mean of a compact format after every batch would add up the
+ *  rounding errors like a random walk, so the compact formats only fold new
+ *  batches into the stored mean after 1, 2, 4, 8, ... batches, which bounds
+ *  the total rounding error by a few units in the last place. In between,
+ *  the mean deviation of the new batches from the stored mean is kept in a
+ *  signed shared exponent format. The deviations are of the order of the
+ *  noise rather than of the mean, so rounding them matters even less. All
+ *  rounding is stochastic to keep the result unbiased.
+ *
+ *  The deviation needs three signed channels with about eight significant
+ *  bits each, or its rounding error stops shrinking below the noise of the
+ *  image, so it takes four bytes of every pixel in both compact formats.
+ *  This keeps the half format above eight bytes per pixel; RGB9E5 is the
+ *  format to use when memory matters most.
+ */
+class Accumulator: public NonCopyable
+{
+public:
+    Accumulator(AccumulatorFormat format, size_t size);
+
+    /**
+     *  Folds the mean of a new batch of samples into the given pixel. |batches|
+     *  is the number of batches accumulated so far including this one.
+     *  Returns the updated mean.
+     */
+    glm::vec3 add(size_t index, const glm::vec3& batchMean, int batches, Random& random);
+
+    size_t bytesPerPixel() const;
+
+    static uint16_t floatToHalf(float value, uint32_t roundingBits = 1 << 12);
+    static float halfToFloat(uint16_t value);
+    static uint32_t encodeRGB9E5(const glm::vec3& color, const glm::vec3& rounding = glm::vec3(.5f));
+    static glm::vec3 decodeRGB9E5(uint32_t value);
+
+    // Sign and magnitude variant of RGB9E5 with 8 bit magnitudes.
+    static uint32_t encodeSignedRGB8E5(const glm::vec3& color, const glm::vec3& rounding = glm::vec3(.5f));
+    static glm::vec3 decodeSignedRGB8E5(uint32_t value);
+
+private:
+    glm::vec3 storedMean(size_t index) const;
+    void storeMean(size_t index, const glm::vec3& mean, Random& random);
+
+    AccumulatorFormat m_format;
+    std::unique_ptr<glm::vec3[]> m_float;
+    std::unique_ptr<uint16_t[]> m_half;
+    std::unique_ptr<uint32_t[]> m_rgb9e5;
+    // Mean deviation of the batches since the last fold from the stored mean.
+    std::unique_ptr<uint32_t[]> m_deviation;
+};
+
+}
+
+#endif
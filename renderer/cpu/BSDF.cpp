@@ -1,7 +1,9 @@
 // Copyright (C) 2012 Sami Kyöstilä
 
 #include "BSDF.h"
+#include "FastMath.h"
 #include "Random.h"
+#include "SDTree.h"
 #include "SurfacePoint.h"
 
 using namespace cpu;
@@ -63,14 +65,14 @@ glm::vec4 PhongBSDF::evaluateSample(const glm::vec3& direction) const
 {
     glm::vec3 reflection = glm::reflect(m_surfacePoint->view, m_surfacePoint->normal);
     float cos_a = std::max(0.f, glm::dot(reflection, direction));
-    return (m_exponent + 1) / (2 * M_PI) * m_color * powf(cos_a, m_exponent);
+    return (m_exponent + 1) / (2 * M_PI) * m_color * fastPow(cos_a, m_exponent);
 }
 
 float PhongBSDF::sampleProbability(const glm::vec3& direction) const
 {
     glm::vec3 reflection = glm::reflect(m_surfacePoint->view, m_surfacePoint->normal);
     float cos_a = std::max(0.f, glm::dot(reflection, direction));
-    return (m_exponent + 1) / (2 * M_PI) * powf(cos_a, m_exponent);
+    return (m_exponent + 1) / (2 * M_PI) * fastPow(cos_a, m_exponent);
 }
 
 IdealReflectorBSDF::IdealReflectorBSDF(const SurfacePoint* surfacePoint, const glm::vec4& color):
@@ -134,3 +136,33 @@ float IdealTransmissionBSDF::sampleProbability(const glm::vec3& direction) const
 {
     return 0.f;
 }
+
+GuidedBSDF::GuidedBSDF(const SurfacePoint* surfacePoint, const BSDF& bsdf, const DirectionTree& guide,
+                       float guideProbability):
+    BSDF(surfacePoint),
+    m_bsdf(bsdf),
+    m_guide(guide),
+    m_guideProbability(guideProbability)
+{
+}
+
+RandomValue<glm::vec3> GuidedBSDF::generateSample(Random& random) const
+{
+    glm::vec3 direction;
+    if (random.generateUniform() < m_guideProbability)
+        direction = m_guide.generateSample(random).value;
+    else
+        direction = m_bsdf.generateSample(random).value;
+    return RandomValue<glm::vec3>(direction, sampleProbability(direction));
+}
+
+glm::vec4 GuidedBSDF::evaluateSample(const glm::vec3& direction) const
+{
+    return m_bsdf.evaluateSample(direction);
+}
+
+float GuidedBSDF::sampleProbability(const glm::vec3& direction) const
+{
+    return m_guideProbability * m_guide.sampleProbability(direction) +
+           (1 - m_guideProbability) * std::max(0.f, m_bsdf.sampleProbability(direction));
+}
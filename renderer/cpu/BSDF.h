@@ -7,6 +7,7 @@
 namespace cpu
 {
 
+class DirectionTree;
 class SurfacePoint;
 class Random;
 
@@ -78,6 +79,25 @@ private:
     float m_refractiveIndex;
 };
 
+/**
+ *  Samples the directions of |bsdf| or of a learned distribution of the
+ *  incident light, choosing the latter with |guideProbability|. The density
+ *  is that of the mixture, which makes the combination a one-sample
+ *  multiple importance sampling estimate with the balance heuristic.
+ */
+class GuidedBSDF: public BSDF
+{
+public:
+    GuidedBSDF(const SurfacePoint*, const BSDF& bsdf, const DirectionTree& guide, float guideProbability);
+
+    RandomValue<glm::vec3> generateSample(Random& random) const override;
+    glm::vec4 evaluateSample(const glm::vec3& direction) const override;
+    float sampleProbability(const glm::vec3& direction) const override;
+private:
+    const BSDF& m_bsdf;
+    const DirectionTree& m_guide;
+    float m_guideProbability;
+};
 
 }
 
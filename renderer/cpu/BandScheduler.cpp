@@ -0,0 +1,106 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#include "Accumulator.h"
+#include "BandScheduler.h"
+#include "LightReservoirs.h"
+#include "PhotonMap.h"
+#include "Renderer.h"
+#include "Scheduler.h"
+#include "SplatBuffer.h"
+#include "renderer/Image.h"
+#include "renderer/ImageStream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <vector>
+
+namespace cpu
+{
+
+BandScheduler::BandScheduler(const scene::Scene& scene, const Options& options, int width, int height,
+                             int bandHeight, int passes, const std::string& fileName):
+    m_renderer(new Renderer(scene, options)),
+    m_options(options),
+    m_width(width),
+    m_height(height),
+    m_bandHeight(std::max(1, std::min(bandHeight, height))),
+    m_fileName(fileName)
+{
+    m_renderer->setPassLimit(std::max(1, passes));
+}
+
+BandScheduler::~BandScheduler()
+{
+}
+
+int BandScheduler::bandHeightForMemoryLimit(const Options& options, int width, int height, size_t bytes)
+{
+    // Each row needs an RGBA8 output row and the per-task radiance
+    // accumulator row, a splat buffer row for bidirectional path tracing and
+    // a row of light reservoirs for resampled direct light.
+    Accumulator accumulator(options.accumulatorFormat, 0);
+    size_t bytesPerPixel = sizeof(uint32_t) + accumulator.bytesPerPixel();
+    if (options.integrator == IntegratorType::Bidirectional)
+        bytesPerPixel += SplatBuffer::bytesPerPixel;
+    if (options.integrator == IntegratorType::PathTracing && options.lightCandidates)
+        bytesPerPixel += LightReservoirs::bytesPerPixel;
+    size_t bytesPerRow = width * bytesPerPixel;
+
+    // Photon mapping keeps a photon map for each thread at most.
+    if (options.integrator == IntegratorType::PhotonMapping) {
+        size_t photonBytes = cpuCount() * options.photonCount * PhotonMap::bytesPerPhoton;
+        bytes -= std::min(bytes, photonBytes);
+    }
+    size_t rows = bytes / bytesPerRow;
+    return static_cast<int>(std::max<size_t>(1, std::min<size_t>(rows, height)));
+}
+
+void BandScheduler::run()
+{
+    ImageStream stream;
+    if (!stream.open(m_fileName, m_width, m_height))
+        return;
+
+    if (m_options.lightSplit > 1 || m_options.indirectSplit > 1)
+        std::cout << "Splitting paths into " << splitDescription(m_options) << std::endl;
+
+    auto startTime = std::chrono::steady_clock::now();
+    int bandCount = (m_height + m_bandHeight - 1) / m_bandHeight;
+    for (int top = 0, band = 1; top < m_height; top += m_bandHeight, band++)
+    {
+        int rows = std::min(m_bandHeight, m_height - top);
+        Image image(m_width, rows, m_height, top);
+
+        int threads = std::min(cpuCount(), rows);
+        int slice = (rows + threads - 1) / threads;
+        std::vector<std::future<void>> tasks;
+        for (int y = top; y < top + rows; y += slice)
+        {
+            int height = std::min(slice, top + rows - y);
+            tasks.push_back(std::async(std::launch::async, [=, &image] {
+                m_renderer->render(image, 0, y, m_width, height);
+            }));
+        }
+        for (auto& task: tasks)
+            task.wait();
+
+        if (!stream.write(image)) {
+            std::cerr << "Failed to write band " << band << " to " << m_fileName << std::endl;
+            return;
+        }
+
+        auto elapsed = std::chrono::steady_clock::now() - startTime;
+        std::cout << "Band " << band << "/" << bandCount << " done, "
+                  << std::chrono::duration_cast<std::chrono::seconds>(elapsed).count() << " s" << std::endl;
+    }
+
+    if (!stream.close())
+        std::cerr << "Failed to finish writing " << m_fileName << std::endl;
+
+    std::string statistics = m_renderer->statistics();
+    if (!statistics.empty())
+        std::cout << "Integrator " << statistics << std::endl;
+}
+
+}
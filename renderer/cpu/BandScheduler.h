@@ -0,0 +1,49 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_BANDSCHEDULER_H
+#define CPU_BANDSCHEDULER_H
+
+#include "Options.h"
+#include "renderer/Scheduler.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace scene
+{
+class Scene;
+}
+
+namespace cpu
+{
+
+class Renderer;
+
+/**
+ *  Renders the image as a sequence of horizontal bands, each of which is
+ *  streamed to disk and released once finished. Peak memory use depends on
+ *  the band height instead of the image size.
+ */
+class BandScheduler: public ::Scheduler
+{
+public:
+    BandScheduler(const scene::Scene&, const Options&, int width, int height,
+                  int bandHeight, int passes, const std::string& fileName);
+    ~BandScheduler();
+
+    virtual void run() override;
+
+    // Returns the tallest band whose buffers fit in the given number of bytes.
+    static int bandHeightForMemoryLimit(const Options&, int width, int height, size_t bytes);
+
+private:
+    std::unique_ptr<Renderer> m_renderer;
+    Options m_options;
+    int m_width;
+    int m_height;
+    int m_bandHeight;
+    std::string m_fileName;
+};
+
+}
+
+#endif
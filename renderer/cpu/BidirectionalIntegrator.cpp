@@ -0,0 +1,454 @@
+// Copyright (C) 2013 Sami Kyöstilä
+
+#include "BidirectionalIntegrator.h"
+#include "BSDF.h"
+#include "Lobes.h"
+#include "PinholeCamera.h"
+#include "Random.h"
+#include "Ray.h"
+#include "Raytracer.h"
+#include "Scene.h"
+#include "SplatBuffer.h"
+#include "SurfacePoint.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace cpu;
+
+namespace
+{
+const float g_surfaceEpsilon = 0.001f;
+
+// Maps the zero density of a delta lobe to one, so that it cancels out in
+// the ratios of the MIS weight.
+inline float remap(float probability)
+{
+    return probability ? probability : 1;
+}
+
+}
+
+class BidirectionalIntegrator::Vertex
+{
+public:
+    enum Type
+    {
+        CameraVertex,
+        LightVertex,
+        SurfaceVertex,
+    };
+
+    /**
+     *  Converts the solid angle density |directionProbability| of the
+     *  direction from this vertex towards |next| to an area density at |next|.
+     */
+    float convertToArea(float directionProbability, const Vertex& next) const
+    {
+        glm::vec3 offset = next.point.position - point.position;
+        float distanceSquared = glm::dot(offset, offset);
+        if (next.type == CameraVertex)
+            return directionProbability / distanceSquared;
+        return directionProbability * std::abs(glm::dot(next.point.normal, offset)) /
+               (distanceSquared * sqrtf(distanceSquared));
+    }
+
+    /**
+     *  Returns true if the vertex can be connected to a vertex of the other
+     *  subpath, i.e. it scatters light to more than a single direction.
+     */
+    bool connectible() const
+    {
+        return type != SurfaceVertex || Lobes(*point.material).scattersDiffusely();
+    }
+
+    Type type;
+    SurfacePoint point;
+    const Sphere* light;
+
+    // Weight of the subpath up to and including this vertex.
+    glm::vec4 throughput;
+
+    // Area densities of generating this vertex from the previous vertex of
+    // its own subpath and from the next one.
+    float forwardProbability;
+    float reverseProbability;
+
+    // True if the path was scattered from this vertex by a delta lobe.
+    bool delta;
+};
+
+/**
+ *  Subpaths of a render thread, which are long enough for the deepest
+ *  paths and reused by every sample of the thread.
+ */
+class BidirectionalIntegrator::Paths: public Integrator::ThreadState
+{
+public:
+    explicit Paths(int maxDepth):
+        cameraPath(maxDepth + 2),
+        lightPath(maxDepth + 1)
+    {
+    }
+
+    std::vector<Vertex> cameraPath;
+    std::vector<Vertex> lightPath;
+};
+
+BidirectionalIntegrator::BidirectionalIntegrator(Scene* scene, Raytracer* raytracer, const PinholeCamera* camera,
+                                                 SplatBuffer* splats, const Options& options):
+    m_scene(scene),
+    m_raytracer(raytracer),
+    m_camera(camera),
+    m_splats(splats),
+    m_options(options),
+    m_lights(*scene)
+{
+}
+
+std::unique_ptr<Integrator::ThreadState> BidirectionalIntegrator::createThreadState(Random&, int, int) const
+{
+    return std::unique_ptr<ThreadState>(new Paths(m_options.maxDepth));
+}
+
+glm::vec4 BidirectionalIntegrator::radiance(const SurfacePoint& surfacePoint, Random& random,
+                                            const PassState*, ThreadState* threadState) const
+{
+    // Every camera sample traces one light subpath, which the splat buffer
+    // needs to know to normalize the light tracing contributions.
+    m_splats->addSample();
+
+    Paths& paths = *static_cast<Paths*>(threadState);
+    Vertex* cameraPath = &paths.cameraPath[0];
+    Vertex* lightPath = &paths.lightPath[0];
+    glm::vec4 radiance;
+    int cameraCount = traceCameraPath(surfacePoint, random, cameraPath, radiance);
+    int lightCount = traceLightPath(random, lightPath);
+
+    // Connect the first t camera subpath vertices to the first s light
+    // subpath vertices. Paths of length one would need a camera that can be
+    // hit by rays.
+    for (int t = 1; t <= cameraCount; t++) {
+        for (int s = 0; s <= lightCount; s++) {
+            if (s + t < 2 || s + t - 2 > m_options.maxDepth)
+                continue;
+            if (t == 1)
+                connectToCamera(lightPath, s);
+            else
+                radiance += connect(cameraPath, t, lightPath, s);
+        }
+    }
+    return radiance;
+}
+
+int BidirectionalIntegrator::traceCameraPath(const SurfacePoint& surfacePoint, Random& random, Vertex* path,
+                                              glm::vec4& escapedRadiance) const
+{
+    Vertex& camera = path[0];
+    camera.type = Vertex::CameraVertex;
+    camera.point = SurfacePoint();
+    camera.point.position = m_camera->origin;
+    camera.light = 0;
+    camera.throughput = glm::vec4(1);
+    camera.forwardProbability = 1;
+    camera.reverseProbability = 0;
+    camera.delta = false;
+
+    float filmX, filmY, density;
+    if (!m_camera->project(surfacePoint.view, filmX, filmY, density))
+        return 1;
+
+    Ray ray;
+    ray.origin = m_camera->origin;
+    ray.direction = surfacePoint.view;
+    return extendPath(path, 1, m_options.maxDepth + 2, ray, surfacePoint, glm::vec4(1),
+                      density, false, random, &escapedRadiance);
+}
+
+int BidirectionalIntegrator::traceLightPath(Random& random, Vertex* path) const
+{
+    Vertex& vertex = path[0];
+    vertex.type = Vertex::LightVertex;
+    vertex.point = SurfacePoint();
+    vertex.forwardProbability = m_lights.generatePoint(random, vertex.point, vertex.light);
+    vertex.reverseProbability = 0;
+    vertex.delta = false;
+    if (!(vertex.forwardProbability > 0))
+        return 0;
+    vertex.throughput = glm::vec4(1 / vertex.forwardProbability);
+
+    // Emit in a cosine weighted direction around the normal
+    RandomValue<glm::vec3> direction = m_lights.generateDirection(vertex.point.normal, random);
+    if (!direction.probability)
+        return 1;
+
+    Ray ray;
+    ray.direction = direction.value;
+    ray.origin = vertex.point.position + ray.direction * g_surfaceEpsilon;
+    glm::vec4 throughput = vertex.throughput * vertex.light->material.emission *
+                           glm::dot(vertex.point.normal, ray.direction) / direction.probability;
+    SurfacePoint surfacePoint = m_raytracer->trace(ray);
+    return extendPath(path, 1, m_options.maxDepth + 1, ray, surfacePoint, throughput,
+                      direction.probability, true, random, 0);
+}
+
+int BidirectionalIntegrator::extendPath(Vertex* path, int count, int maxCount, Ray ray, SurfacePoint surfacePoint,
+                                        glm::vec4 throughput, float directionProbability, bool fromLight,
+                                        Random& random, glm::vec4* escapedRadiance) const
+{
+    // Product of the scattering weights, which drives Russian roulette like
+    // the throughput does in Shader. It leaves out the emission of the light.
+    glm::vec4 scattering(1);
+
+    while (count < maxCount) {
+        if (!surfacePoint.valid() || !surfacePoint.material) {
+            if (escapedRadiance)
+                *escapedRadiance += throughput * m_scene->backgroundColor;
+            break;
+        }
+
+        Vertex& previous = path[count - 1];
+        Vertex& vertex = path[count++];
+        vertex.type = Vertex::SurfaceVertex;
+        vertex.point = surfacePoint;
+        vertex.light = 0;
+        vertex.throughput = throughput;
+        vertex.forwardProbability = previous.convertToArea(directionProbability, vertex);
+        vertex.reverseProbability = 0;
+        vertex.delta = false;
+        if (count == maxCount)
+            break;
+
+        float continueProbability = 1;
+        if (count - 2 >= m_options.rouletteDepth) {
+            auto shouldContinue = random.russianRoulette(scattering);
+            if (!shouldContinue.value)
+                break;
+            continueProbability = shouldContinue.probability;
+        }
+
+        glm::vec3 direction;
+        glm::vec4 weight;
+        float reverseProbability;
+        if (!scatter(vertex, -ray.direction, fromLight, random, direction, weight,
+                     directionProbability, reverseProbability, vertex.delta))
+            break;
+        weight /= continueProbability;
+        throughput *= weight;
+        scattering *= weight;
+        previous.reverseProbability = vertex.convertToArea(reverseProbability, previous);
+
+        ray = Ray();
+        ray.direction = direction;
+        ray.origin = vertex.point.position + direction * g_surfaceEpsilon;
+        surfacePoint = m_raytracer->trace(ray);
+    }
+    return count;
+}
+
+bool BidirectionalIntegrator::scatter(const Vertex& vertex, const glm::vec3& fixedDirection, bool fromLight,
+                                      Random& random, glm::vec3& direction, glm::vec4& weight,
+                                      float& forwardProbability, float& reverseProbability, bool& delta) const
+{
+    const Material& material = *vertex.point.material;
+    const glm::vec3& normal = vertex.point.normal;
+    Lobes lobes(material);
+    SurfacePoint surfacePoint = vertex.point;
+    surfacePoint.view = -fixedDirection;
+
+    // The delta lobes can only be sampled, so they are chosen on their own.
+    float u = random.generateUniform();
+    delta = u < lobes.transmission + lobes.mirror;
+    if (delta) {
+        forwardProbability = reverseProbability = 0;
+        if (u < lobes.transmission) {
+            IdealTransmissionBSDF bsdf(&surfacePoint, material.specular, material.refractiveIndex);
+            direction = bsdf.generateSample(random).value;
+            weight = material.specular / lobes.transmission;
+            return true;
+        }
+        // Like in Shader, mirrors only reflect light arriving from the front.
+        direction = glm::reflect(surfacePoint.view, normal);
+        weight = material.specular / lobes.mirror;
+        return glm::dot(normal, direction) > 0;
+    }
+
+    // Sample one of the other lobes, and weight the direction by the density
+    // of all of them.
+    if (u < lobes.transmission + lobes.mirror + lobes.diffuse)
+        direction = LambertBSDF(&surfacePoint, material.diffuse).generateSample(random).value;
+    else
+        direction = PhongBSDF(&surfacePoint, material.specular, material.specularExponent).generateSample(random).value;
+
+    forwardProbability = scatterProbability(vertex, fixedDirection, direction);
+    if (!(forwardProbability > 0))
+        return false;
+    glm::vec4 f = fromLight ? evaluate(vertex, direction, fixedDirection) :
+                              evaluate(vertex, fixedDirection, direction);
+    weight = f * std::abs(glm::dot(normal, direction)) / forwardProbability;
+    if (weight == glm::vec4(0))
+        return false;
+    reverseProbability = scatterProbability(vertex, direction, fixedDirection);
+    return true;
+}
+
+glm::vec4 BidirectionalIntegrator::evaluate(const Vertex& vertex, const glm::vec3& cameraDirection,
+                                            const glm::vec3& lightDirection) const
+{
+    const glm::vec3& normal = vertex.point.normal;
+
+    // Lights emit outwards only
+    if (vertex.type == Vertex::LightVertex)
+        return glm::dot(normal, cameraDirection) > 0 ? vertex.light->material.emission : glm::vec4(0);
+
+    // Like in Shader, surfaces only reflect light arriving from the front.
+    if (glm::dot(normal, lightDirection) <= 0)
+        return glm::vec4(0);
+
+    const Material& material = *vertex.point.material;
+    SurfacePoint surfacePoint = vertex.point;
+    surfacePoint.view = -cameraDirection;
+    glm::vec4 result = LambertBSDF(&surfacePoint, material.diffuse).evaluateSample(lightDirection);
+    if (material.specularExponent)
+        result += PhongBSDF(&surfacePoint, material.specular, material.specularExponent).evaluateSample(lightDirection);
+    return result;
+}
+
+float BidirectionalIntegrator::scatterProbability(const Vertex& vertex, const glm::vec3& fixedDirection,
+                                                  const glm::vec3& direction) const
+{
+    const glm::vec3& normal = vertex.point.normal;
+    if (vertex.type == Vertex::LightVertex)
+        return std::max(0.f, glm::dot(normal, direction)) * float(M_1_PI);
+
+    const Material& material = *vertex.point.material;
+    Lobes lobes(material);
+    SurfacePoint surfacePoint = vertex.point;
+    surfacePoint.view = -fixedDirection;
+    float result = 0;
+    if (lobes.diffuse)
+        result += lobes.diffuse * std::max(0.f, LambertBSDF(&surfacePoint, material.diffuse).sampleProbability(direction));
+    if (lobes.glossy)
+        result += lobes.glossy * PhongBSDF(&surfacePoint, material.specular, material.specularExponent).sampleProbability(direction);
+    return result;
+}
+
+glm::vec4 BidirectionalIntegrator::connect(const Vertex* cameraPath, int t, const Vertex* lightPath, int s) const
+{
+    const Vertex& z = cameraPath[t - 1];
+    const Vertex& previous = cameraPath[t - 2];
+    glm::vec3 toCamera = glm::normalize(previous.point.position - z.point.position);
+
+    // The camera subpath hit an emitter by itself
+    if (!s) {
+        const glm::vec4& emission = z.point.material->emission;
+        if (emission == glm::vec4(0))
+            return glm::vec4(0);
+        const Sphere* light = m_lights.find(z.point.objectId);
+        if (!light)
+            return z.throughput * emission;
+        if (glm::dot(z.point.normal, toCamera) <= 0)
+            return glm::vec4(0);
+
+        float cameraReverse = m_lights.probability(*light, z.point.position);
+        float cameraPreviousReverse =
+            z.convertToArea(std::max(0.f, glm::dot(z.point.normal, toCamera)) * float(M_1_PI), previous);
+        return z.throughput * emission * misWeight(cameraPath, t, lightPath, s, cameraReverse,
+                                                   cameraPreviousReverse, 0, 0);
+    }
+
+    const Vertex& y = lightPath[s - 1];
+    if (!z.connectible() || !y.connectible())
+        return glm::vec4(0);
+
+    glm::vec3 offset = y.point.position - z.point.position;
+    float distanceSquared = glm::dot(offset, offset);
+    glm::vec3 toLight = offset / sqrtf(distanceSquared);
+    glm::vec3 yToLight = s > 1 ? glm::normalize(lightPath[s - 2].point.position - y.point.position) : glm::vec3();
+
+    glm::vec4 contribution = z.throughput * evaluate(z, toCamera, toLight) *
+                             evaluate(y, -toLight, yToLight) * y.throughput *
+                             (std::abs(glm::dot(z.point.normal, toLight)) *
+                              std::abs(glm::dot(y.point.normal, toLight)) / distanceSquared);
+    if (contribution == glm::vec4(0) || !visible(z.point.position, y.point.position))
+        return glm::vec4(0);
+
+    // Densities of generating the connection vertices from the other side
+    float cameraReverse = y.convertToArea(scatterProbability(y, yToLight, -toLight), z);
+    float cameraPreviousReverse = z.convertToArea(scatterProbability(z, toLight, toCamera), previous);
+    float lightReverse = z.convertToArea(scatterProbability(z, toCamera, toLight), y);
+    float lightPreviousReverse =
+        s > 1 ? y.convertToArea(scatterProbability(y, -toLight, yToLight), lightPath[s - 2]) : 0;
+    return contribution * misWeight(cameraPath, t, lightPath, s, cameraReverse, cameraPreviousReverse,
+                                    lightReverse, lightPreviousReverse);
+}
+
+void BidirectionalIntegrator::connectToCamera(const Vertex* lightPath, int s) const
+{
+    const Vertex& y = lightPath[s - 1];
+    if (!y.connectible())
+        return;
+
+    glm::vec3 offset = m_camera->origin - y.point.position;
+    float distanceSquared = glm::dot(offset, offset);
+    glm::vec3 toCamera = offset / sqrtf(distanceSquared);
+    float filmX, filmY, density;
+    if (!m_camera->project(-toCamera, filmX, filmY, density))
+        return;
+
+    // The density of the camera generating |y|
+    float lightReverse = density * std::abs(glm::dot(y.point.normal, toCamera)) / distanceSquared;
+    glm::vec3 yToLight = s > 1 ? glm::normalize(lightPath[s - 2].point.position - y.point.position) : glm::vec3();
+    glm::vec4 contribution = y.throughput * evaluate(y, toCamera, yToLight) * lightReverse;
+    if (contribution == glm::vec4(0) || !visible(y.point.position, m_camera->origin))
+        return;
+
+    float lightPreviousReverse =
+        s > 1 ? y.convertToArea(scatterProbability(y, toCamera, yToLight), lightPath[s - 2]) : 0;
+    float weight = misWeight(0, 1, lightPath, s, 0, 0, lightReverse, lightPreviousReverse);
+    m_splats->add(filmX, filmY, glm::vec3(contribution * weight));
+}
+
+float BidirectionalIntegrator::misWeight(const Vertex* cameraPath, int t, const Vertex* lightPath, int s,
+                                         float cameraReverse, float cameraPreviousReverse,
+                                         float lightReverse, float lightPreviousReverse) const
+{
+    // Balance heuristic, computed as the sum of the density ratios of the
+    // strategies that move the connection along the path to that of this
+    // strategy. The connection vertices and their neighbors have reverse
+    // densities that differ from the stored ones. Strategies that would
+    // connect to a vertex scattered by a delta lobe are impossible.
+    float sum = 0;
+    float ratio = 1;
+    for (int i = t - 1; i > 0; i--) {
+        float reverse = i == t - 1 ? cameraReverse :
+                        i == t - 2 ? cameraPreviousReverse : cameraPath[i].reverseProbability;
+        ratio *= remap(reverse) / remap(cameraPath[i].forwardProbability);
+        bool delta = i < t - 1 && cameraPath[i].delta;
+        if (!delta && !cameraPath[i - 1].delta)
+            sum += ratio;
+    }
+
+    ratio = 1;
+    for (int i = s - 1; i >= 0; i--) {
+        float reverse = i == s - 1 ? lightReverse :
+                        i == s - 2 ? lightPreviousReverse : lightPath[i].reverseProbability;
+        ratio *= remap(reverse) / remap(lightPath[i].forwardProbability);
+        bool delta = i < s - 1 && lightPath[i].delta;
+        if (!delta && !(i > 0 && lightPath[i - 1].delta))
+            sum += ratio;
+    }
+    return 1 / (1 + sum);
+}
+
+bool BidirectionalIntegrator::visible(const glm::vec3& from, const glm::vec3& to) const
+{
+    glm::vec3 offset = to - from;
+    float distance = glm::length(offset);
+    Ray ray;
+    ray.direction = offset / distance;
+    ray.origin = from + ray.direction * g_surfaceEpsilon;
+    ray.maxDistance = distance - 2 * g_surfaceEpsilon;
+    return ray.maxDistance > 0 && !m_raytracer->occluded(ray);
+}
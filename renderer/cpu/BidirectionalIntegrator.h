@@ -0,0 +1,79 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_BIDIRECTIONALINTEGRATOR_H
+#define CPU_BIDIRECTIONALINTEGRATOR_H
+
+#include "Integrator.h"
+#include "LightDistribution.h"
+#include "Options.h"
+#include "Ray.h"
+
+#include <glm/glm.hpp>
+
+namespace cpu
+{
+
+class PinholeCamera;
+class Random;
+class Raytracer;
+class Scene;
+class Sphere;
+class SplatBuffer;
+class SurfacePoint;
+
+/**
+ *  Bidirectional path tracer after Veach, chapter 10. Every camera sample
+ *  traces one subpath from the camera and another from a point on an
+ *  emissive sphere, and connects each vertex of one to each vertex of the
+ *  other. The sampling strategies are combined with the balance heuristic,
+ *  so paths that are easy to find from the light, such as caustics seen
+ *  through glass, are weighted towards the light subpaths. Connections of
+ *  light subpath vertices to the camera are added to the splat buffer.
+ */
+class BidirectionalIntegrator: public Integrator
+{
+public:
+    BidirectionalIntegrator(Scene* scene, Raytracer* raytracer, const PinholeCamera* camera,
+                            SplatBuffer* splats, const Options& options);
+
+    std::unique_ptr<ThreadState> createThreadState(Random& random, int width, int height) const override;
+    glm::vec4 radiance(const SurfacePoint& surfacePoint, Random& random,
+                       const PassState* passState, ThreadState* threadState) const override;
+
+private:
+    class Vertex;
+    class Paths;
+
+    int traceCameraPath(const SurfacePoint& surfacePoint, Random& random, Vertex* path,
+                        glm::vec4& escapedRadiance) const;
+    int traceLightPath(Random& random, Vertex* path) const;
+    int extendPath(Vertex* path, int count, int maxCount, Ray ray, SurfacePoint surfacePoint,
+                   glm::vec4 throughput, float directionProbability, bool fromLight, Random& random,
+                   glm::vec4* escapedRadiance) const;
+
+    bool scatter(const Vertex& vertex, const glm::vec3& fixedDirection, bool fromLight, Random& random,
+                 glm::vec3& direction, glm::vec4& weight, float& forwardProbability,
+                 float& reverseProbability, bool& delta) const;
+    glm::vec4 evaluate(const Vertex& vertex, const glm::vec3& cameraDirection,
+                       const glm::vec3& lightDirection) const;
+    float scatterProbability(const Vertex& vertex, const glm::vec3& fixedDirection,
+                             const glm::vec3& direction) const;
+
+    glm::vec4 connect(const Vertex* cameraPath, int t, const Vertex* lightPath, int s) const;
+    void connectToCamera(const Vertex* lightPath, int s) const;
+    float misWeight(const Vertex* cameraPath, int t, const Vertex* lightPath, int s,
+                    float cameraReverse, float cameraPreviousReverse,
+                    float lightReverse, float lightPreviousReverse) const;
+
+    bool visible(const glm::vec3& from, const glm::vec3& to) const;
+
+    Scene* m_scene;
+    Raytracer* m_raytracer;
+    const PinholeCamera* m_camera;
+    SplatBuffer* m_splats;
+    Options m_options;
+    LightDistribution m_lights;
+};
+
+}
+
+#endif
@@ -0,0 +1,165 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_FASTMATH_H
+#define CPU_FASTMATH_H
+
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+/**
+ *  Approximations of the transcendental functions used for sampling and
+ *  shading, after the single precision Cephes routines. They contain no
+ *  branches, tables or library calls, so loops calling them vectorize in
+ *  every kernel variant. The functions have internal linkage, which keeps the
+ *  copies compiled for different instruction sets apart.
+ *
+ *  Error bounds, measured against double precision with the renderer's
+ *  compiler flags by tools/FastMathCheck.cpp. The argument reductions are not
+ *  exact, so the error of the periodic and exponential functions grows with
+ *  the argument.
+ *
+ *    fastSin, fastCos, fastSinCos  absolute 2e-7 for |x| <= 2 * pi,
+ *                                  1.1e-7 * |x| beyond
+ *    fastExp                       relative 1.3e-7 * max(1, |x|)
+ *    fastLog                       absolute 1.7e-7 * max(1, |log(x)|) for
+ *                                  positive normal x
+ *    fastPow                       relative 2.8e-7 * (1 + |y * log(x)|)
+ *    fastAcos                      absolute 3.6e-7
+ */
+
+namespace cpu
+{
+
+static inline float floatFromBits(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static inline uint32_t bitsFromFloat(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// Rounds to the nearest integer, halfway cases away from zero.
+static inline int roundToInt(float x)
+{
+    return int(x + (x < 0 ? -.5f : .5f));
+}
+
+static inline void fastSinCos(float x, float& sine, float& cosine)
+{
+    // Reduce to [-pi/4, pi/4]. Splitting pi/2 into several constants would
+    // make the reduction exact, but -ffast-math folds the parts back together.
+    int quadrant = roundToInt(x * float(2 / M_PI));
+    float y = x - quadrant * float(M_PI_2);
+    float z = y * y;
+
+    float s = y + y * z * (-1.6666654611e-1f + z * (8.3321608736e-3f + z * -1.9515295891e-4f));
+    float c = 1 - .5f * z + z * z * (4.166664568298827e-2f + z * (-1.388731625493765e-3f + z * 2.443315711809948e-5f));
+
+    bool swap = quadrant & 1;
+    float sineBase = swap ? c : s;
+    float cosineBase = swap ? s : c;
+    sine = (quadrant & 2) ? -sineBase : sineBase;
+    cosine = ((quadrant + 1) & 2) ? -cosineBase : cosineBase;
+}
+
+static inline float fastSin(float x)
+{
+    float sine, cosine;
+    fastSinCos(x, sine, cosine);
+    return sine;
+}
+
+static inline float fastCos(float x)
+{
+    float sine, cosine;
+    fastSinCos(x, sine, cosine);
+    return cosine;
+}
+
+static inline float fastExp(float x)
+{
+    x = x < -87.f ? -87.f : (x > 88.f ? 88.f : x);
+
+    // e^x = 2^n * e^r with |r| <= ln(2) / 2.
+    int n = roundToInt(x * float(M_LOG2E));
+    float r = x - n * float(M_LN2);
+    float z = r * r;
+    float p = 1.9875691500e-4f;
+    p = p * r + 1.3981999507e-3f;
+    p = p * r + 8.3334519073e-3f;
+    p = p * r + 4.1665795894e-2f;
+    p = p * r + 1.6666665459e-1f;
+    p = p * r + 5.0000001201e-1f;
+    p = p * z + r + 1;
+
+    // The product is split in two so that n = 128 does not overflow the
+    // exponent field.
+    int half = n >> 1;
+    return p * floatFromBits(uint32_t(half + 127) << 23) * floatFromBits(uint32_t(n - half + 127) << 23);
+}
+
+static inline float fastLog(float x)
+{
+    // x = m * 2^e with m in [sqrt(1/2), sqrt(2)).
+    uint32_t bits = bitsFromFloat(x);
+    int e = int(bits >> 23) - 126;
+    float m = floatFromBits((bits & 0x007fffff) | 0x3f000000);
+    bool small = m < float(M_SQRT1_2);
+    e = small ? e - 1 : e;
+    m = small ? m + m - 1 : m - 1;
+
+    float z = m * m;
+    float p = 7.0376836292e-2f;
+    p = p * m - 1.1514610310e-1f;
+    p = p * m + 1.1676998740e-1f;
+    p = p * m - 1.2420140846e-1f;
+    p = p * m + 1.4249322787e-1f;
+    p = p * m - 1.6668057665e-1f;
+    p = p * m + 2.0000714765e-1f;
+    p = p * m - 2.4999993993e-1f;
+    p = p * m + 3.3333331174e-1f;
+    return m + p * m * z - .5f * z + e * float(M_LN2);
+}
+
+/**
+ *  Returns |x| to the power of |y| for x >= 0. Zero to any power is zero,
+ *  except to the power of zero, which is one.
+ */
+static inline float fastPow(float x, float y)
+{
+    // Select the result with a bit mask. With a conditional the compiler moves
+    // the exponential into a branch, which stops the loop from vectorizing.
+    uint32_t positive = x > 0 ? ~0u : 0u;
+    float zeroPower = y == 0 ? 1.f : 0.f;
+    float result = fastExp(y * fastLog(x));
+    return floatFromBits((bitsFromFloat(result) & positive) | (bitsFromFloat(zeroPower) & ~positive));
+}
+
+static inline float fastAcos(float x)
+{
+    // acos(x) = pi/2 - asin(x) near zero, and 2 * asin(sqrt((1 - x) / 2))
+    // near one.
+    float a = fabsf(x);
+    bool large = a > .5f;
+    float z = large ? .5f * (1 - a) : a * a;
+    float s = large ? sqrtf(z) : a;
+    float p = 4.2163199048e-2f;
+    p = p * z + 2.4181311049e-2f;
+    p = p * z + 4.5470025998e-2f;
+    p = p * z + 7.4953002686e-2f;
+    p = p * z + 1.6666752422e-1f;
+    float asinS = s + s * z * p;
+
+    float result = large ? 2 * asinS : float(M_PI_2) - asinS;
+    return x < 0 ? float(M_PI) - result : result;
+}
+
+}
+
+#endif
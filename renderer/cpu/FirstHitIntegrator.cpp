@@ -0,0 +1,97 @@
+// Copyright (C) 2013 Sami Kyöstilä
+
+#include "BSDF.h"
+#include "FirstHitIntegrator.h"
+#include "Random.h"
+#include "Ray.h"
+#include "Raytracer.h"
+#include "Scene.h"
+#include "SurfacePoint.h"
+
+using namespace cpu;
+
+namespace
+{
+const float g_surfaceEpsilon = 0.001f;
+}
+
+FirstHitIntegrator::FirstHitIntegrator(Scene* scene, Raytracer* raytracer, const Options& options):
+    m_scene(scene),
+    m_raytracer(raytracer),
+    m_options(options),
+    m_lights(*scene)
+{
+}
+
+glm::vec4 FirstHitIntegrator::radiance(const SurfacePoint& surfacePoint, Random& random,
+                                       const PassState*, ThreadState*) const
+{
+    if (!surfacePoint.valid() || !surfacePoint.material)
+        return m_options.integrator == IntegratorType::DirectLighting ? m_scene->backgroundColor : glm::vec4(0);
+
+    const Material& material = *surfacePoint.material;
+    switch (m_options.integrator)
+    {
+    case IntegratorType::AmbientOcclusion:
+        return glm::vec4(glm::vec3(ambientOcclusion(surfacePoint, random)), 0);
+    case IntegratorType::DirectLighting:
+        return directLighting(surfacePoint, random);
+    case IntegratorType::Normals:
+        return glm::vec4(surfacePoint.normal * .5f + glm::vec3(.5f), 0);
+    case IntegratorType::Albedo:
+        // Lights are shown by their color.
+        return glm::vec4(glm::min(glm::vec3(material.diffuse + material.specular + material.emission),
+                                  glm::vec3(1)), 0);
+    default:
+        break;
+    }
+    return glm::vec4(0);
+}
+
+float FirstHitIntegrator::ambientOcclusion(const SurfacePoint& surfacePoint, Random& random) const
+{
+    // Occlude the side of the surface that faces the camera.
+    glm::vec3 normal = surfacePoint.normal;
+    if (glm::dot(normal, surfacePoint.view) > 0)
+        normal = -normal;
+
+    RandomValue<glm::vec3> direction = random.generateCosineHemispherical();
+    Ray ray;
+    ray.direction = surfacePoint.tangent * direction.value.x +
+                    surfacePoint.binormal * direction.value.y +
+                    normal * direction.value.z;
+    ray.origin = surfacePoint.position + ray.direction * g_surfaceEpsilon;
+    ray.maxDistance = m_options.occlusionDistance;
+    return m_raytracer->occluded(ray) ? 0 : 1;
+}
+
+glm::vec4 FirstHitIntegrator::directLighting(const SurfacePoint& surfacePoint, Random& random) const
+{
+    const Material& material = *surfacePoint.material;
+    glm::vec4 radiance = material.emission;
+
+    SurfacePoint lightPoint;
+    const Sphere* light = nullptr;
+    float density = m_lights.generatePoint(random, lightPoint, light);
+    if (!(density > 0) || reinterpret_cast<intptr_t>(light) == surfacePoint.objectId)
+        return radiance;
+
+    glm::vec3 offset = lightPoint.position - surfacePoint.position;
+    float distanceSquared = glm::dot(offset, offset);
+    Ray shadowRay;
+    shadowRay.direction = offset / sqrtf(distanceSquared);
+    shadowRay.origin = surfacePoint.position + shadowRay.direction * g_surfaceEpsilon;
+    float cosine = glm::dot(surfacePoint.normal, shadowRay.direction);
+    float lightCosine = -glm::dot(lightPoint.normal, shadowRay.direction);
+    if (!(cosine > 0 && lightCosine > 0) || !m_raytracer->canReach(shadowRay, *light))
+        return radiance;
+
+    // The path tracer chooses one of the lobes at random, which on average
+    // reflects as much as all of them together.
+    glm::vec4 reflectance = LambertBSDF(&surfacePoint, material.diffuse).evaluateSample(shadowRay.direction);
+    if (material.specularExponent)
+        reflectance += PhongBSDF(&surfacePoint, material.specular,
+                                 material.specularExponent).evaluateSample(shadowRay.direction);
+    return radiance + reflectance * light->material.emission *
+                      (cosine * lightCosine / (distanceSquared * density));
+}
@@ -0,0 +1,53 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_FIRSTHITINTEGRATOR_H
+#define CPU_FIRSTHITINTEGRATOR_H
+
+#include "Integrator.h"
+#include "LightDistribution.h"
+#include "Options.h"
+
+namespace cpu
+{
+
+class Raytracer;
+class Scene;
+
+/**
+ *  Cheap views of the surfaces the camera rays hit first, for placing the
+ *  camera and the objects of a scene: ambient occlusion within a distance,
+ *  the direct light, shading normals or albedo. Mirrors and glass are shown
+ *  as they are rather than followed.
+ */
+class FirstHitIntegrator: public Integrator
+{
+public:
+    FirstHitIntegrator(Scene* scene, Raytracer* raytracer, const Options& options);
+
+    glm::vec4 radiance(const SurfacePoint& surfacePoint, Random& random,
+                       const PassState* passState, ThreadState* threadState) const override;
+
+private:
+    /**
+     *  Returns one if a cosine weighted ray from |surfacePoint| reaches
+     *  further than the occlusion distance, and zero otherwise. The average
+     *  is the fraction of the light from a uniform sky that the nearby
+     *  surfaces let through.
+     */
+    float ambientOcclusion(const SurfacePoint& surfacePoint, Random& random) const;
+
+    /**
+     *  Returns the light emitted by |surfacePoint| and the light it reflects
+     *  from a single point on a light, which takes one shadow ray. Unlike
+     *  the path tracer, nothing is traced in the direction of the BSDF.
+     */
+    glm::vec4 directLighting(const SurfacePoint& surfacePoint, Random& random) const;
+
+    Scene* m_scene;
+    Raytracer* m_raytracer;
+    Options m_options;
+    LightDistribution m_lights;
+};
+
+}
+
+#endif
@@ -0,0 +1,355 @@
+// Copyright (C) 2013 Sami Kyöstilä
+
+#include "BSDF.h"
+#include "InstantRadiosityIntegrator.h"
+#include "Kernels.h"
+#include "Lobes.h"
+#include "Random.h"
+#include "Ray.h"
+#include "Raytracer.h"
+#include "Scene.h"
+#include "Scheduler.h"
+#include "SurfacePoint.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <future>
+#include <sstream>
+
+using namespace cpu;
+
+namespace
+{
+const float g_surfaceEpsilon = 0.001f;
+
+// The light paths are traced in groups, each with its own random number
+// sequence, so that the virtual lights do not depend on how the groups are
+// spread over threads.
+const size_t g_groupCount = 64;
+const size_t g_pathsPerGroup = 64;
+
+// The virtual lights of a group are weighed in batches of this many.
+const size_t g_batchSize = 64;
+
+// Distances to the virtual lights are clamped to this fraction of the
+// extent of the virtual lights.
+const float g_relativeMinDistance = 1.f / 64;
+
+float luminance(const glm::vec3& color)
+{
+    return .2126f * color.x + .7152f * color.y + .0722f * color.z;
+}
+}
+
+class InstantRadiosityIntegrator::VirtualLight
+{
+public:
+    glm::vec3 position;
+    glm::vec3 normal;
+    // Light sent to a surface per unit of geometry term, i.e. radiance
+    // times area.
+    glm::vec3 color;
+};
+
+class InstantRadiosityIntegrator::VirtualLights: public Integrator::PassState
+{
+public:
+    // Component arrays for the kernels. The lights of each group are next
+    // to each other.
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> normalX;
+    std::vector<float> normalY;
+    std::vector<float> normalZ;
+    std::vector<float> luminance;
+    std::vector<glm::vec3> colors;
+
+    // The lights of group i are from groupStarts[i] to groupStarts[i + 1].
+    std::vector<size_t> groupStarts;
+    float minDistanceSquared;
+};
+
+InstantRadiosityIntegrator::InstantRadiosityIntegrator(Scene* scene, Raytracer* raytracer, const Options& options):
+    m_scene(scene),
+    m_raytracer(raytracer),
+    m_kernels(&Kernels::forIsa(options.isa)),
+    m_options(options),
+    m_lights(*scene)
+{
+}
+
+std::shared_ptr<const Integrator::PassState> InstantRadiosityIntegrator::beginPass(int pass) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_virtualLights)
+        m_virtualLights = createVirtualLights();
+    return m_virtualLights;
+}
+
+std::string InstantRadiosityIntegrator::statistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_virtualLights)
+        return std::string();
+    std::ostringstream result;
+    result << m_virtualLights->colors.size() << " virtual lights";
+    return result.str();
+}
+
+std::shared_ptr<const InstantRadiosityIntegrator::VirtualLights> InstantRadiosityIntegrator::createVirtualLights() const
+{
+    std::vector<std::vector<VirtualLight>> groups(g_groupCount);
+    std::atomic<size_t> nextGroup(0);
+
+    std::vector<std::future<void>> tasks;
+    for (int i = 0; i < cpuCount(); i++) {
+        tasks.push_back(std::async(std::launch::async, [&] {
+            Random random(m_kernels);
+            for (size_t group; (group = nextGroup++) < g_groupCount;) {
+                random.setSeed(0x7f4a7c15u * (group + 1));
+                for (size_t j = 0; j < g_pathsPerGroup && !m_lights.empty(); j++)
+                    tracePath(random, groups[group]);
+            }
+        }));
+    }
+    for (auto& task: tasks)
+        task.wait();
+
+    std::shared_ptr<VirtualLights> lights(new VirtualLights());
+    glm::vec3 lower(HUGE_VALF), upper(-HUGE_VALF);
+    for (const std::vector<VirtualLight>& group: groups) {
+        lights->groupStarts.push_back(lights->colors.size());
+        for (const VirtualLight& light: group) {
+            lights->x.push_back(light.position.x);
+            lights->y.push_back(light.position.y);
+            lights->z.push_back(light.position.z);
+            lights->normalX.push_back(light.normal.x);
+            lights->normalY.push_back(light.normal.y);
+            lights->normalZ.push_back(light.normal.z);
+            lights->luminance.push_back(luminance(light.color));
+            lights->colors.push_back(light.color);
+            lower = glm::min(lower, light.position);
+            upper = glm::max(upper, light.position);
+        }
+    }
+    lights->groupStarts.push_back(lights->colors.size());
+
+    float minDistance = lights->colors.empty() ? 0 : glm::length(upper - lower) * g_relativeMinDistance;
+    lights->minDistanceSquared = minDistance * minDistance;
+    return lights;
+}
+
+void InstantRadiosityIntegrator::tracePath(Random& random, std::vector<VirtualLight>& lights) const
+{
+    // The path starts with a virtual light on the light itself, which
+    // provides the direct light.
+    SurfacePoint lightPoint;
+    const Sphere* light;
+    float pointProbability = m_lights.generatePoint(random, lightPoint, light);
+    if (!(pointProbability > 0))
+        return;
+    glm::vec3 emission = light->material.emission.xyz() / pointProbability;
+    lights.push_back(VirtualLight{lightPoint.position, lightPoint.normal, emission});
+
+    RandomValue<glm::vec3> direction = m_lights.generateDirection(lightPoint.normal, random);
+    if (!direction.probability)
+        return;
+
+    Ray ray;
+    ray.direction = direction.value;
+    ray.origin = lightPoint.position + ray.direction * g_surfaceEpsilon;
+    glm::vec4 power = glm::vec4(emission, 0) * glm::dot(lightPoint.normal, ray.direction) / direction.probability;
+
+    // Like the photons of PhotonMapIntegrator, except that the virtual
+    // lights only reflect diffusely. The last bounce is left for the camera
+    // rays.
+    glm::vec4 scattering(1);
+    for (int depth = 1; depth < m_options.maxDepth; depth++) {
+        SurfacePoint surfacePoint = m_raytracer->trace(ray);
+        if (!surfacePoint.valid() || !surfacePoint.material)
+            break;
+
+        const Material& material = *surfacePoint.material;
+        Lobes lobes(material);
+        if (glm::dot(surfacePoint.normal, ray.direction) < 0 && material.diffuse != glm::vec4(0)) {
+            glm::vec3 color = glm::vec3(power * material.diffuse) * float(M_1_PI);
+            lights.push_back(VirtualLight{surfacePoint.position, surfacePoint.normal, color});
+        }
+
+        float continueProbability = 1;
+        if (depth >= m_options.rouletteDepth) {
+            auto shouldContinue = random.russianRoulette(scattering);
+            if (!shouldContinue.value)
+                break;
+            continueProbability = shouldContinue.probability;
+        }
+
+        surfacePoint.view = ray.direction;
+        float u = random.generateUniform();
+        glm::vec4 weight;
+        if (u < lobes.transmission) {
+            IdealTransmissionBSDF bsdf(&surfacePoint, material.specular, material.refractiveIndex);
+            ray.direction = bsdf.generateSample(random).value;
+            weight = material.specular / lobes.transmission;
+        } else {
+            if (glm::dot(surfacePoint.normal, ray.direction) >= 0)
+                break;
+            if (u < lobes.transmission + lobes.mirror) {
+                ray.direction = glm::reflect(ray.direction, surfacePoint.normal);
+                weight = material.specular / lobes.mirror;
+            } else {
+                bool diffuse = u < lobes.transmission + lobes.mirror + lobes.diffuse;
+                RandomValue<glm::vec3> sample;
+                if (diffuse) {
+                    LambertBSDF bsdf(&surfacePoint, material.diffuse);
+                    sample = bsdf.generateSample(random);
+                    weight = bsdf.evaluateSample(sample.value) / lobes.diffuse;
+                } else {
+                    PhongBSDF bsdf(&surfacePoint, material.specular, material.specularExponent);
+                    sample = bsdf.generateSample(random);
+                    weight = bsdf.evaluateSample(sample.value) / lobes.glossy;
+                }
+                float cosine = glm::dot(surfacePoint.normal, sample.value);
+                if (!sample.probability || cosine <= 0)
+                    break;
+                ray.direction = sample.value;
+                weight *= cosine / sample.probability;
+            }
+        }
+        weight /= continueProbability;
+        power *= weight;
+        scattering *= weight;
+        if (power == glm::vec4(0))
+            break;
+
+        ray.origin = surfacePoint.position + ray.direction * g_surfaceEpsilon;
+        ray.minDistance = 0;
+        ray.maxDistance = HUGE_VALF;
+    }
+}
+
+glm::vec4 InstantRadiosityIntegrator::radiance(const SurfacePoint& surfacePoint, Random& random,
+                                               const PassState* passState, ThreadState*) const
+{
+    const VirtualLights& lights = static_cast<const VirtualLights&>(*passState);
+
+    // Follow the mirrors, glass and glossy reflections from the camera to a
+    // diffuse surface where the virtual lights can be gathered. The virtual
+    // lights are points, which glossy surfaces would show as sharp dots.
+    glm::vec4 radiance;
+    glm::vec4 weight(1);
+    SurfacePoint point = surfacePoint;
+    for (int depth = 0; ; depth++) {
+        if (!point.valid() || !point.material)
+            return radiance + weight * m_scene->backgroundColor;
+
+        const Material& material = *point.material;
+        radiance += weight * material.emission;
+        if (depth >= m_options.maxDepth)
+            break;
+
+        Lobes lobes(material);
+        float u = random.generateUniform();
+        if (u >= lobes.transmission + lobes.mirror + lobes.glossy) {
+            if (lobes.diffuse > 0)
+                radiance += weight * gather(lights, point, random) / lobes.diffuse;
+            break;
+        }
+
+        Ray ray;
+        if (u < lobes.transmission) {
+            IdealTransmissionBSDF bsdf(&point, material.specular, material.refractiveIndex);
+            ray.direction = bsdf.generateSample(random).value;
+            weight *= material.specular / lobes.transmission;
+        } else if (u < lobes.transmission + lobes.mirror) {
+            ray.direction = glm::reflect(point.view, point.normal);
+            if (glm::dot(point.normal, ray.direction) <= 0)
+                break;
+            weight *= material.specular / lobes.mirror;
+        } else {
+            PhongBSDF bsdf(&point, material.specular, material.specularExponent);
+            RandomValue<glm::vec3> sample = bsdf.generateSample(random);
+            float cosine = glm::dot(point.normal, sample.value);
+            if (!sample.probability || cosine <= 0)
+                break;
+            ray.direction = sample.value;
+            weight *= bsdf.evaluateSample(sample.value) * cosine / (sample.probability * lobes.glossy);
+        }
+        ray.origin = point.position + ray.direction * g_surfaceEpsilon;
+        point = m_raytracer->trace(ray);
+    }
+    return radiance;
+}
+
+glm::vec4 InstantRadiosityIntegrator::gather(const VirtualLights& lights, const SurfacePoint& surfacePoint,
+                                             Random& random) const
+{
+    size_t group = std::min(static_cast<size_t>(random.generateUniform() * g_groupCount), g_groupCount - 1);
+    size_t first = lights.groupStarts[group];
+    size_t last = lights.groupStarts[group + 1];
+
+    // Sum the unshadowed light of the group, then weigh the virtual lights
+    // again to find the one a uniform share of the sum falls on. Weighing
+    // twice is cheaper than a random number for each virtual light.
+    const float position[3] = {surfacePoint.position.x, surfacePoint.position.y, surfacePoint.position.z};
+    const float normal[3] = {surfacePoint.normal.x, surfacePoint.normal.y, surfacePoint.normal.z};
+    float weights[g_batchSize];
+    auto weigh = [&](size_t batch) {
+        size_t size = std::min(g_batchSize, last - batch);
+        VirtualLightArrays arrays = {
+            &lights.x[batch], &lights.y[batch], &lights.z[batch],
+            &lights.normalX[batch], &lights.normalY[batch], &lights.normalZ[batch],
+            &lights.luminance[batch],
+        };
+        m_kernels->weighVirtualLights(arrays, size, position, normal, lights.minDistanceSquared, weights);
+        return size;
+    };
+    float total = 0;
+    for (size_t batch = first; batch < last; batch += g_batchSize) {
+        size_t size = weigh(batch);
+        for (size_t i = 0; i < size; i++)
+            total += weights[i];
+    }
+    if (!(total > 0))
+        return glm::vec4(0);
+
+    float remaining = random.generateUniform() * total;
+    size_t chosen = last;
+    for (size_t batch = first; batch < last && remaining >= 0; batch += g_batchSize) {
+        size_t size = weigh(batch);
+        for (size_t i = 0; i < size && remaining >= 0; i++) {
+            if (weights[i] > 0) {
+                chosen = batch + i;
+                remaining -= weights[i];
+            }
+        }
+    }
+    if (chosen == last)
+        return glm::vec4(0);
+
+    // The chosen light stands for the whole group, whose light is its
+    // color times the total weight over its luminance.
+    glm::vec3 lightPosition(lights.x[chosen], lights.y[chosen], lights.z[chosen]);
+    if (!visible(surfacePoint.position, lightPosition))
+        return glm::vec4(0);
+
+    // Like in Shader, surfaces only reflect light arriving from the front,
+    // which the weights already made sure of.
+    LambertBSDF bsdf(&surfacePoint, surfacePoint.material->diffuse);
+    glm::vec3 direction = glm::normalize(lightPosition - surfacePoint.position);
+    return bsdf.evaluateSample(direction) * glm::vec4(lights.colors[chosen], 0) *
+           (total / (lights.luminance[chosen] * g_pathsPerGroup));
+}
+
+bool InstantRadiosityIntegrator::visible(const glm::vec3& from, const glm::vec3& to) const
+{
+    glm::vec3 offset = to - from;
+    float distance = glm::length(offset);
+    Ray ray;
+    ray.direction = offset / distance;
+    ray.origin = from + ray.direction * g_surfaceEpsilon;
+    ray.maxDistance = distance - 2 * g_surfaceEpsilon;
+    return ray.maxDistance > 0 && !m_raytracer->occluded(ray);
+}
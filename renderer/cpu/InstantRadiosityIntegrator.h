@@ -0,0 +1,65 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_INSTANTRADIOSITYINTEGRATOR_H
+#define CPU_INSTANTRADIOSITYINTEGRATOR_H
+
+#include "Integrator.h"
+#include "LightDistribution.h"
+#include "Options.h"
+
+#include <mutex>
+#include <vector>
+
+namespace cpu
+{
+
+class Kernels;
+class Raytracer;
+class Scene;
+
+/**
+ *  Instant radiosity after Keller, for fast previews. Light paths traced
+ *  once from the emissive spheres leave virtual point lights on the diffuse
+ *  surfaces they hit, and camera rays gather the light of the virtual lights
+ *  at their first diffuse hit, following mirrors, glass and glossy
+ *  reflections on the way. The paths are split into groups, each of which
+ *  lights the scene on its own, and each sample gathers a single group. Only
+ *  one virtual light of the group is tested for visibility, chosen by its
+ *  unshadowed light, so what noise there is stays in the shadows.
+ *
+ *  The light of nearby virtual lights is clamped, which hides the bright
+ *  spots around them but loses some of the light in corners.
+ */
+class InstantRadiosityIntegrator: public Integrator
+{
+public:
+    InstantRadiosityIntegrator(Scene* scene, Raytracer* raytracer, const Options& options);
+
+    std::shared_ptr<const PassState> beginPass(int pass) const override;
+    glm::vec4 radiance(const SurfacePoint& surfacePoint, Random& random,
+                       const PassState* passState, ThreadState* threadState) const override;
+    std::string statistics() const override;
+
+private:
+    class VirtualLight;
+    class VirtualLights;
+
+    std::shared_ptr<const VirtualLights> createVirtualLights() const;
+    void tracePath(Random& random, std::vector<VirtualLight>& lights) const;
+    glm::vec4 gather(const VirtualLights& lights, const SurfacePoint& surfacePoint, Random& random) const;
+    bool visible(const glm::vec3& from, const glm::vec3& to) const;
+
+    Scene* m_scene;
+    Raytracer* m_raytracer;
+    const Kernels* m_kernels;
+    Options m_options;
+    LightDistribution m_lights;
+
+    // The virtual lights are traced by the first thread to start a pass and
+    // kept for the rest.
+    mutable std::mutex m_mutex;
+    mutable std::shared_ptr<const VirtualLights> m_virtualLights;
+};
+
+}
+
+#endif
@@ -0,0 +1,118 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#include "BidirectionalIntegrator.h"
+#include "FirstHitIntegrator.h"
+#include "InstantRadiosityIntegrator.h"
+#include "Integrator.h"
+#include "MetropolisIntegrator.h"
+#include "Options.h"
+#include "PhotonMapIntegrator.h"
+#include "Shader.h"
+
+using namespace cpu;
+
+bool cpu::parseIntegratorType(const std::string& name, IntegratorType& type)
+{
+    if (name == "path")
+        type = IntegratorType::PathTracing;
+    else if (name == "bdpt")
+        type = IntegratorType::Bidirectional;
+    else if (name == "ppm")
+        type = IntegratorType::PhotonMapping;
+    else if (name == "mlt")
+        type = IntegratorType::Metropolis;
+    else if (name == "vpl")
+        type = IntegratorType::InstantRadiosity;
+    else if (name == "ao")
+        type = IntegratorType::AmbientOcclusion;
+    else if (name == "direct")
+        type = IntegratorType::DirectLighting;
+    else if (name == "normal")
+        type = IntegratorType::Normals;
+    else if (name == "albedo")
+        type = IntegratorType::Albedo;
+    else
+        return false;
+    return true;
+}
+
+const char* cpu::integratorName(IntegratorType type)
+{
+    switch (type)
+    {
+    case IntegratorType::PathTracing:
+        return "path";
+    case IntegratorType::Bidirectional:
+        return "bdpt";
+    case IntegratorType::PhotonMapping:
+        return "ppm";
+    case IntegratorType::Metropolis:
+        return "mlt";
+    case IntegratorType::InstantRadiosity:
+        return "vpl";
+    case IntegratorType::AmbientOcclusion:
+        return "ao";
+    case IntegratorType::DirectLighting:
+        return "direct";
+    case IntegratorType::Normals:
+        return "normal";
+    case IntegratorType::Albedo:
+        return "albedo";
+    }
+    return "";
+}
+
+Integrator::PassState::~PassState()
+{
+}
+
+Integrator::ThreadState::ThreadState():
+    pixel(0)
+{
+}
+
+Integrator::ThreadState::~ThreadState()
+{
+}
+
+Integrator::~Integrator()
+{
+}
+
+std::shared_ptr<const Integrator::PassState> Integrator::beginPass(int pass) const
+{
+    return nullptr;
+}
+
+std::unique_ptr<Integrator::ThreadState> Integrator::createThreadState(Random& random, int width, int height) const
+{
+    return nullptr;
+}
+
+std::string Integrator::statistics() const
+{
+    return std::string();
+}
+
+std::unique_ptr<Integrator> Integrator::create(Scene* scene, Raytracer* raytracer, const PinholeCamera* camera,
+                                               SplatBuffer* splats, const Options& options)
+{
+    switch (options.integrator)
+    {
+    case IntegratorType::PathTracing:
+        break;
+    case IntegratorType::Bidirectional:
+        return std::unique_ptr<Integrator>(new BidirectionalIntegrator(scene, raytracer, camera, splats, options));
+    case IntegratorType::PhotonMapping:
+        return std::unique_ptr<Integrator>(new PhotonMapIntegrator(scene, raytracer, options));
+    case IntegratorType::Metropolis:
+        return std::unique_ptr<Integrator>(new MetropolisIntegrator(scene, raytracer, camera, splats, options));
+    case IntegratorType::InstantRadiosity:
+        return std::unique_ptr<Integrator>(new InstantRadiosityIntegrator(scene, raytracer, options));
+    case IntegratorType::AmbientOcclusion:
+    case IntegratorType::DirectLighting:
+    case IntegratorType::Normals:
+    case IntegratorType::Albedo:
+        return std::unique_ptr<Integrator>(new FirstHitIntegrator(scene, raytracer, options));
+    }
+    return std::unique_ptr<Integrator>(new Shader(scene, raytracer, camera, options));
+}
@@ -0,0 +1,101 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_INTEGRATOR_H
+#define CPU_INTEGRATOR_H
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+
+namespace cpu
+{
+
+class Options;
+class PinholeCamera;
+class Random;
+class Raytracer;
+class Scene;
+class SplatBuffer;
+class SurfacePoint;
+
+enum class IntegratorType
+{
+    PathTracing,
+    Bidirectional,
+    PhotonMapping,
+    Metropolis,
+    InstantRadiosity,
+    AmbientOcclusion,
+    DirectLighting,
+    Normals,
+    Albedo,
+};
+
+bool parseIntegratorType(const std::string& name, IntegratorType& type);
+const char* integratorName(IntegratorType type);
+
+/**
+ *  Estimates the light transported to the camera. A single integrator is
+ *  shared by all render threads, so its methods must be thread safe.
+ */
+class Integrator
+{
+public:
+    /**
+     *  State shared by the samples of a pass, such as a photon map.
+     */
+    class PassState
+    {
+    public:
+        virtual ~PassState();
+    };
+
+    /**
+     *  State of a single render thread, such as a Markov chain. The renderer
+     *  sets |pixel| to the pixel of its band that is being shaded.
+     */
+    class ThreadState
+    {
+    public:
+        ThreadState();
+        virtual ~ThreadState();
+
+        glm::ivec2 pixel;
+    };
+
+    virtual ~Integrator();
+
+    static std::unique_ptr<Integrator> create(Scene* scene, Raytracer* raytracer, const PinholeCamera* camera,
+                                              SplatBuffer* splats, const Options& options);
+
+    /**
+     *  Returns the state for pass |pass|, counting from one. Every render
+     *  thread calls this when it starts a pass, and gets the same state for
+     *  the same pass while any thread holds on to it. May return null.
+     */
+    virtual std::shared_ptr<const PassState> beginPass(int pass) const;
+
+    /**
+     *  Returns the state of a new render thread, which renders a band of
+     *  |width| by |height| pixels and may use |random| to seed the state.
+     *  May return null.
+     */
+    virtual std::unique_ptr<ThreadState> createThreadState(Random& random, int width, int height) const;
+
+    /**
+     *  Returns the radiance arriving at the camera from |surfacePoint|, which
+     *  is the first hit of a camera ray. Contributions that reach other
+     *  pixels may be added to the splat buffer.
+     */
+    virtual glm::vec4 radiance(const SurfacePoint& surfacePoint, Random& random,
+                               const PassState* passState, ThreadState* threadState) const = 0;
+
+    /**
+     *  Describes the work of the integrator for the render statistics, or
+     *  returns an empty string.
+     */
+    virtual std::string statistics() const;
+};
+
+}
+
+#endif
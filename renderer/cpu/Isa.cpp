@@ -0,0 +1,59 @@
+// Copyright (C) 2013 Sami Kyöstilä
+
+#include "Isa.h"
+
+using namespace cpu;
+
+bool cpu::parseIsa(const std::string& name, Isa& isa)
+{
+    if (name == "sse2")
+        isa = Isa::SSE2;
+    else if (name == "avx2")
+        isa = Isa::AVX2;
+    else if (name == "avx512")
+        isa = Isa::AVX512;
+    else
+        return false;
+    return true;
+}
+
+const char* cpu::isaName(Isa isa)
+{
+    switch (isa)
+    {
+    case Isa::SSE2:
+        return "sse2";
+    case Isa::AVX2:
+        return "avx2";
+    case Isa::AVX512:
+        return "avx512";
+    }
+    return "";
+}
+
+bool cpu::isaSupported(Isa isa)
+{
+    // The checks also cover operating system support for the wider registers.
+    __builtin_cpu_init();
+    switch (isa)
+    {
+    case Isa::SSE2:
+        return true;
+    case Isa::AVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case Isa::AVX512:
+        return isaSupported(Isa::AVX2) &&
+               __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") &&
+               __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl");
+    }
+    return false;
+}
+
+Isa cpu::detectIsa()
+{
+    if (isaSupported(Isa::AVX512))
+        return Isa::AVX512;
+    if (isaSupported(Isa::AVX2))
+        return Isa::AVX2;
+    return Isa::SSE2;
+}
@@ -0,0 +1,34 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_ISA_H
+#define CPU_ISA_H
+
+#include <string>
+
+namespace cpu
+{
+
+/**
+ *  Instruction sets the hot kernels are compiled for. The rest of the
+ *  renderer only assumes SSE2, so one binary runs on every x86-64 machine
+ *  and picks the widest kernels the processor supports at startup.
+ */
+enum class Isa
+{
+    SSE2,
+    AVX2,   // Including FMA
+    AVX512, // Foundation, DQ, BW and VL subsets
+};
+
+bool parseIsa(const std::string& name, Isa& isa);
+const char* isaName(Isa isa);
+
+bool isaSupported(Isa isa);
+
+/**
+ *  Returns the widest instruction set supported by the processor.
+ */
+Isa detectIsa();
+
+}
+
+#endif
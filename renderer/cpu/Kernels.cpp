@@ -0,0 +1,46 @@
+// Copyright (C) 2013 Sami Kyöstilä
+
+#include "Kernels.h"
+
+using namespace cpu;
+
+namespace cpu
+{
+namespace sse2
+{
+const Kernels& kernels();
+}
+namespace avx2
+{
+const Kernels& kernels();
+}
+namespace avx512
+{
+const Kernels& kernels();
+}
+}
+
+PacketDirections::PacketDirections(const RayPacket& packet)
+{
+    for (int i = 0; i < RayPacket::maxSize; i++)
+    {
+        const Ray& ray = packet.rays[i < packet.size ? i : 0];
+        x[i] = ray.direction.x;
+        y[i] = ray.direction.y;
+        z[i] = ray.direction.z;
+    }
+}
+
+const Kernels& Kernels::forIsa(Isa isa)
+{
+    switch (isa)
+    {
+    case Isa::SSE2:
+        break;
+    case Isa::AVX2:
+        return avx2::kernels();
+    case Isa::AVX512:
+        return avx512::kernels();
+    }
+    return sse2::kernels();
+}
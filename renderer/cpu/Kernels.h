@@ -0,0 +1,128 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_KERNELS_H
+#define CPU_KERNELS_H
+
+#include "Isa.h"
+#include "RayPacket.h"
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace cpu
+{
+
+/**
+ *  Directions of the rays of a packet as separate component arrays. Lanes
+ *  past the size of the packet repeat the first ray.
+ */
+class PacketDirections
+{
+public:
+    explicit PacketDirections(const RayPacket& packet);
+
+    alignas(64) float x[RayPacket::maxSize];
+    alignas(64) float y[RayPacket::maxSize];
+    alignas(64) float z[RayPacket::maxSize];
+};
+
+/**
+ *  State of the batched uniform random number generator: independent
+ *  xoshiro128+ streams side by side, one per lane.
+ */
+class RandomState
+{
+public:
+    static const int lanes = 16;
+
+    alignas(64) uint32_t words[4][lanes];
+};
+
+/**
+ *  Batch of sampled unit vectors with their probability densities.
+ */
+class DirectionBatch
+{
+public:
+    static const int size = 16;
+
+    alignas(64) float x[size];
+    alignas(64) float y[size];
+    alignas(64) float z[size];
+    alignas(64) float probability[size];
+};
+
+/**
+ *  Virtual point lights as separate component arrays. |luminance| is the
+ *  luminance of the light each one sends to a surface per unit of geometry
+ *  term.
+ */
+class VirtualLightArrays
+{
+public:
+    const float* x;
+    const float* y;
+    const float* z;
+    const float* normalX;
+    const float* normalY;
+    const float* normalZ;
+    const float* luminance;
+};
+
+/**
+ *  Hot loops compiled once for each instruction set in Isa. The loops are
+ *  plain scalar code over component arrays, which every variant vectorizes
+ *  to the width of its own registers.
+ */
+class Kernels
+{
+public:
+    static const Kernels& forIsa(Isa isa);
+
+    /**
+     *  Intersects the rays of a packet with a sphere in world space. |offset|
+     *  is the common origin of the rays relative to the center of the sphere.
+     *  Writes the distance to the nearest intersection in front of each ray
+     *  to |distances|, or infinity if the ray misses.
+     */
+    void (*intersectSphere)(const PacketDirections& directions, const float offset[3], float radius,
+                            float distances[RayPacket::maxSize]);
+
+    /**
+     *  Fills |values| with uniform random numbers in [0, 1). |count| must be
+     *  a multiple of RandomState::lanes. The numbers do not depend on the
+     *  instruction set.
+     */
+    void (*generateUniform)(RandomState& state, float* values, size_t count);
+
+    /**
+     *  Maps 2 * DirectionBatch::size uniform random numbers to cosine
+     *  weighted directions on the hemisphere around +z.
+     */
+    void (*sampleCosineHemisphere)(const float* uniforms, DirectionBatch& samples);
+
+    /**
+     *  Maps 2 * DirectionBatch::size uniform random numbers to directions
+     *  around +z distributed according to a Phong lobe of |exponent|.
+     */
+    void (*samplePhong)(const float* uniforms, float exponent, DirectionBatch& samples);
+
+    /**
+     *  Writes the luminance of the unshadowed light that each of the first
+     *  |count| virtual lights sends to a surface at |position| facing
+     *  |normal| to |weights|. The light of virtual lights closer than the
+     *  square root of |minDistanceSquared| is clamped, which hides the
+     *  bright spots around them.
+     */
+    void (*weighVirtualLights)(const VirtualLightArrays& lights, size_t count, const float position[3],
+                               const float normal[3], float minDistanceSquared, float* weights);
+
+    /**
+     *  Converts |count| linear RGB colors to sRGB and packs them into RGBA8
+     *  pixels like Image::colorToRGBA8.
+     */
+    void (*tonemap)(const float* colors, uint32_t* pixels, size_t count);
+};
+
+}
+
+#endif
@@ -0,0 +1,5 @@
+// Copyright (C) 2013 Sami Kyöstilä
+
+// Compiled with the AVX2 flags set in renderer/CMakeLists.txt.
+#define KERNEL_NAMESPACE avx2
+#include "KernelsImpl.h"
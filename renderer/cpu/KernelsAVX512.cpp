@@ -0,0 +1,5 @@
+// Copyright (C) 2013 Sami Kyöstilä
+
+// Compiled with the AVX512 flags set in renderer/CMakeLists.txt.
+#define KERNEL_NAMESPACE avx512
+#include "KernelsImpl.h"
@@ -0,0 +1,208 @@
+// Copyright (C) 2013 Sami Kyöstilä
+
+// Kernel bodies shared by the per instruction set translation units, which
+// define KERNEL_NAMESPACE and are compiled with their own flags. The bodies
+// must not call inline functions from other headers: a copy compiled for a
+// wider instruction set could be picked by the linker for every caller. The
+// functions in FastMath.h are fine, since they have internal linkage.
+
+#ifndef KERNEL_NAMESPACE
+#error KERNEL_NAMESPACE must be defined
+#endif
+
+#include "FastMath.h"
+#include "Kernels.h"
+
+#include <cmath>
+
+namespace cpu
+{
+namespace KERNEL_NAMESPACE
+{
+
+namespace
+{
+
+void intersectSphere(const PacketDirections& directions, const float offset[3], float radius,
+                     float distances[RayPacket::maxSize])
+{
+    // Same as the world space test in Raytracer. The offset is copied to
+    // locals so that the compiler can tell that it does not alias the output.
+    float ox = offset[0], oy = offset[1], oz = offset[2];
+    float r2 = radius * radius;
+    float c = ox * ox + oy * oy + oz * oz - r2;
+    for (int i = 0; i < RayPacket::maxSize; i++)
+    {
+        float dx = directions.x[i];
+        float dy = directions.y[i];
+        float dz = directions.z[i];
+        float a = dx * dx + dy * dy + dz * dz;
+        float b = ox * dx + oy * dy + oz * dz;
+        float s = b / a;
+        float closestX = ox - s * dx;
+        float closestY = oy - s * dy;
+        float closestZ = oz - s * dz;
+        float discr = a * (r2 - (closestX * closestX + closestY * closestY + closestZ * closestZ));
+
+        float root = sqrtf(discr >= 0 ? discr : 0);
+        float q = b < 0 ? root - b : -root - b;
+        float t0 = q / a;
+        float t1 = c / q;
+        float near = t0 < t1 ? t0 : t1;
+        float far = t0 < t1 ? t1 : t0;
+        float t = near < 0 ? far : near;
+        distances[i] = (discr < 0 || far < 0) ? HUGE_VALF : t;
+    }
+}
+
+inline uint32_t rotateLeft(uint32_t value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+void generateUniform(RandomState& state, float* values, size_t count)
+{
+    // Keep the state in local arrays so that the compiler can tell that
+    // they do not alias the output.
+    const int lanes = RandomState::lanes;
+    uint32_t s0[lanes], s1[lanes], s2[lanes], s3[lanes];
+    for (int i = 0; i < lanes; i++)
+    {
+        s0[i] = state.words[0][i];
+        s1[i] = state.words[1][i];
+        s2[i] = state.words[2][i];
+        s3[i] = state.words[3][i];
+    }
+
+    for (size_t first = 0; first < count; first += lanes)
+    {
+        for (int i = 0; i < lanes; i++)
+        {
+            uint32_t result = s0[i] + s3[i];
+            uint32_t t = s1[i] << 9;
+            s2[i] ^= s0[i];
+            s3[i] ^= s1[i];
+            s1[i] ^= s2[i];
+            s0[i] ^= s3[i];
+            s2[i] ^= t;
+            s3[i] = rotateLeft(s3[i], 11);
+            values[first + i] = (result >> 8) * (1.f / (1 << 24));
+        }
+    }
+
+    for (int i = 0; i < lanes; i++)
+    {
+        state.words[0][i] = s0[i];
+        state.words[1][i] = s1[i];
+        state.words[2][i] = s2[i];
+        state.words[3][i] = s3[i];
+    }
+}
+
+void sampleCosineHemisphere(const float* uniforms, DirectionBatch& samples)
+{
+    const int size = DirectionBatch::size;
+    for (int i = 0; i < size; i++)
+    {
+        float u = uniforms[i];
+        float phi = uniforms[size + i] * float(2 * M_PI);
+        float r = sqrtf(u);
+        float z = sqrtf(1 - u > 0 ? 1 - u : 0);
+        float sine, cosine;
+        fastSinCos(phi, sine, cosine);
+        samples.x[i] = r * cosine;
+        samples.y[i] = r * sine;
+        samples.z[i] = z;
+        samples.probability[i] = z * float(M_1_PI);
+    }
+}
+
+void samplePhong(const float* uniforms, float exponent, DirectionBatch& samples)
+{
+    const int size = DirectionBatch::size;
+    for (int i = 0; i < size; i++)
+    {
+        // cos(a)^n = cos(a)^(n + 1) / cos(a) = u / cos(a) saves a power
+        // function for the density.
+        float u = uniforms[i];
+        float cosA = fastPow(u, 1 / (exponent + 1));
+        float sinA = sqrtf(1 - cosA * cosA > 0 ? 1 - cosA * cosA : 0);
+        float phi = uniforms[size + i] * float(2 * M_PI);
+        float sine, cosine;
+        fastSinCos(phi, sine, cosine);
+        samples.x[i] = sinA * cosine;
+        samples.y[i] = sinA * sine;
+        samples.z[i] = cosA;
+        samples.probability[i] = cosA > 0 ? (exponent + 1) * float(.5 * M_1_PI) * u / cosA : 0;
+    }
+}
+
+void weighVirtualLights(const VirtualLightArrays& lights, size_t count, const float position[3],
+                        const float normal[3], float minDistanceSquared, float* weights)
+{
+    // The arrays and the surface are copied to locals so that the compiler
+    // can tell that they do not alias the output. The cosines are left
+    // unnormalized and divided by the distance squared once more instead.
+    const float* x = lights.x;
+    const float* y = lights.y;
+    const float* z = lights.z;
+    const float* normalX = lights.normalX;
+    const float* normalY = lights.normalY;
+    const float* normalZ = lights.normalZ;
+    const float* luminance = lights.luminance;
+    float px = position[0], py = position[1], pz = position[2];
+    float nx = normal[0], ny = normal[1], nz = normal[2];
+    for (size_t i = 0; i < count; i++)
+    {
+        float dx = x[i] - px;
+        float dy = y[i] - py;
+        float dz = z[i] - pz;
+        float distanceSquared = dx * dx + dy * dy + dz * dz;
+        float cosine = nx * dx + ny * dy + nz * dz;
+        float lightCosine = -(normalX[i] * dx + normalY[i] * dy + normalZ[i] * dz);
+        float clamped = distanceSquared > minDistanceSquared ? distanceSquared : minDistanceSquared;
+        float nonzero = distanceSquared > 1e-20f ? distanceSquared : 1e-20f;
+        cosine = cosine > 0 ? cosine : 0;
+        lightCosine = lightCosine > 0 ? lightCosine : 0;
+        weights[i] = luminance[i] * cosine * lightCosine / (clamped * nonzero);
+    }
+}
+
+void tonemap(const float* colors, uint32_t* pixels, size_t count)
+{
+    // Convert the channels in chunks with a flat loop, which the compiler
+    // vectorizes.
+    const size_t chunkSize = 64;
+    uint32_t channels[chunkSize * 3];
+    for (size_t first = 0; first < count; first += chunkSize)
+    {
+        size_t size = count - first < chunkSize ? count - first : chunkSize;
+        const float* chunk = colors + first * 3;
+        for (size_t i = 0; i < size * 3; i++)
+        {
+            float value = chunk[i] < 0 ? 0 : (chunk[i] > 1 ? 1 : chunk[i]);
+            channels[i] = uint32_t(fastPow(value, 1 / 2.2f) * 255.f + .5f);
+        }
+        for (size_t i = 0; i < size; i++)
+            pixels[first + i] = 0xff000000 | (channels[i * 3] << 16) | (channels[i * 3 + 1] << 8) | channels[i * 3 + 2];
+    }
+}
+
+}
+
+const Kernels& kernels()
+{
+    static const Kernels kernels =
+    {
+        intersectSphere,
+        generateUniform,
+        sampleCosineHemisphere,
+        samplePhong,
+        weighVirtualLights,
+        tonemap,
+    };
+    return kernels;
+}
+
+}
+}
@@ -0,0 +1,5 @@
+// Copyright (C) 2013 Sami Kyöstilä
+
+// Compiled with the baseline flags.
+#define KERNEL_NAMESPACE sse2
+#include "KernelsImpl.h"
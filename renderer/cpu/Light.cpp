@@ -1,5 +1,6 @@
 // Copyright (C) 2012 Sami Kyöstilä
 
+#include "FastMath.h"
 #include "Light.h"
 #include "Random.h"
 #include "Ray.h"
@@ -7,8 +8,84 @@
 #include "SurfacePoint.h"
 #include "scene/Scene.h"
 
+#include <algorithm>
+
 using namespace cpu;
 
+namespace
+{
+
+// Returns the radius of the smallest world space sphere around the center of
+// |sphere| that contains it.
+float boundingRadius(const Sphere& sphere)
+{
+    if (sphere.transform.transformClass != TransformClass::General)
+        return sphere.worldRadius;
+    const glm::mat4& m = sphere.transform.matrix;
+    return sphere.radius * std::max(glm::length(glm::vec3(m[0])),
+                                    std::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+}
+
+/**
+ *  Cone of directions from a point that hit a sphere. A point inside the
+ *  sphere sees it in every direction, which is a cone with a half angle of
+ *  pi. An ellipsoid is covered by the cone of its bounding sphere; the
+ *  directions that miss it are rejected by the visibility test.
+ */
+class Cone
+{
+public:
+    Cone(const glm::vec3& position, const Sphere& sphere)
+    {
+        float radius = boundingRadius(sphere);
+        glm::vec3 toCenter = sphere.center - position;
+        float dist2 = glm::dot(toCenter, toCenter);
+        sin2ThetaMax = radius * radius / dist2;
+        if (sin2ThetaMax >= 1)
+        {
+            axis = glm::vec3(0, 0, 1);
+            oneMinusCosThetaMax = 2;
+            return;
+        }
+        axis = toCenter / sqrtf(dist2);
+        // 1 - cos = sin^2 / (1 + cos) avoids cancellation for distant spheres.
+        oneMinusCosThetaMax = sin2ThetaMax / (1 + sqrtf(1 - sin2ThetaMax));
+    }
+
+    bool contains(const glm::vec3& direction) const
+    {
+        // Compare sines rather than cosines, which are too close to one to
+        // resolve the edge of a small cone.
+        if (sin2ThetaMax >= 1)
+            return true;
+        glm::vec3 perpendicular = glm::cross(direction, axis);
+        return glm::dot(direction, axis) > 0 &&
+               glm::dot(perpendicular, perpendicular) <= sin2ThetaMax * glm::dot(direction, direction);
+    }
+
+    float probability() const
+    {
+        return 1 / (2 * M_PI * oneMinusCosThetaMax);
+    }
+
+    glm::vec3 axis;
+    float sin2ThetaMax;
+    float oneMinusCosThetaMax;
+};
+
+// Returns two unit vectors perpendicular to the unit vector |n| and each
+// other, after Duff et al., "Building an Orthonormal Basis, Revisited".
+void orthonormalBasis(const glm::vec3& n, glm::vec3& tangent, glm::vec3& binormal)
+{
+    float flip = n.z < 0 ? -1.f : 1.f;
+    float a = -1 / (flip + n.z);
+    float b = n.x * n.y * a;
+    tangent = glm::vec3(1 + flip * n.x * n.x * a, flip * b, -flip * n.x);
+    binormal = glm::vec3(b, flip + n.y * n.y * a, -n.y);
+}
+
+}
+
 Light::Light(const SurfacePoint* surfacePoint, const Raytracer* raytracer):
     m_surfacePoint(surfacePoint),
     m_raytracer(raytracer)
@@ -23,30 +100,23 @@ SphericalLight::SphericalLight(const SurfacePoint* surfacePoint, const Raytracer
 {
 }
 
-float SphericalLight::solidAngle(const glm::vec3& lightPos) const
-{
-    float dist = glm::length(lightPos - m_surfacePoint->position);
-    if (dist < m_sphere->radius)
-        return 4 * M_PI; // Full sphere
-    return 2 * M_PI * (1 - cosf(asinf(m_sphere->radius / dist)));
-}
-
 RandomValue<glm::vec3> SphericalLight::generateSample(Random& random) const
 {
-    // From "Lightcuts: A Scalable Approach to Illumination"
-    glm::vec3 lightPos(m_sphere->transform.matrix * glm::vec4(0, 0, 0, 1));
-    glm::vec4 randomSample = random.generate();
-    float s1 = (randomSample.x * .5f) + .5f;
-    float s2 = (randomSample.y * .5f) + .5f;
-    float s3 = (randomSample.z * .5f) + .5f;
+    // Sample the visible cone of the sphere uniformly, so that the
+    // probability is exact for every direction that hits the light.
+    Cone cone(m_surfacePoint->position, *m_sphere);
+    float oneMinusCosTheta = random.generateUniform() * cone.oneMinusCosThetaMax;
+    float cosTheta = 1 - oneMinusCosTheta;
+    float sinTheta = sqrtf(std::max(0.f, oneMinusCosTheta * (2 - oneMinusCosTheta)));
+    float sinPhi, cosPhi;
+    fastSinCos(2 * M_PI * random.generateUniform(), sinPhi, cosPhi);
 
-    float x = m_sphere->radius * sqrtf(s1) * cosf(2 * M_PI * s2);
-    float y = m_sphere->radius * sqrtf(s1) * sinf(2 * M_PI * s2);
-    float z = sqrtf(m_sphere->radius * m_sphere->radius - x * x - y * y) * sinf(M_PI * (s3 - .5f));
+    glm::vec3 tangent, binormal;
+    orthonormalBasis(cone.axis, tangent, binormal);
 
     RandomValue<glm::vec3> result;
-    result.value = glm::normalize(lightPos + glm::vec3(x, y, z) - m_surfacePoint->position);
-    result.probability = 1 / solidAngle(lightPos);
+    result.value = cone.axis * cosTheta + (tangent * cosPhi + binormal * sinPhi) * sinTheta;
+    result.probability = cone.probability();
     return result;
 }
 
@@ -57,6 +127,6 @@ glm::vec4 SphericalLight::evaluateSample(const glm::vec3& direction) const
 
 float SphericalLight::sampleProbability(const glm::vec3& direction) const
 {
-    glm::vec3 lightPos(m_sphere->transform.matrix * glm::vec4(0, 0, 0, 1));
-    return 1 / solidAngle(lightPos);
+    Cone cone(m_surfacePoint->position, *m_sphere);
+    return cone.contains(direction) ? cone.probability() : 0;
 }
@@ -40,8 +40,6 @@ public:
     float sampleProbability(const glm::vec3& direction) const override;
 
 private:
-    float solidAngle(const glm::vec3& lightPos) const;
-
     const Sphere* m_sphere;
     glm::vec4 m_emission;
 };
@@ -0,0 +1,85 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#include "LightDistribution.h"
+#include "Random.h"
+#include "Scene.h"
+#include "SurfacePoint.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace cpu;
+
+LightDistribution::LightDistribution(const Scene& scene)
+{
+    // The world radius is exact for similarity transforms and close enough
+    // for the rest.
+    float totalPower = 0;
+    for (const Sphere& sphere: scene.spheres) {
+        const glm::vec4& emission = sphere.material.emission;
+        float power = (emission.x + emission.y + emission.z) * sphere.worldRadius * sphere.worldRadius;
+        if (!(power > 0))
+            continue;
+        totalPower += power;
+        m_indices[reinterpret_cast<intptr_t>(&sphere)] = m_lights.size();
+        m_lights.push_back(&sphere);
+        m_distribution.push_back(totalPower);
+    }
+}
+
+bool LightDistribution::empty() const
+{
+    return m_lights.empty();
+}
+
+float LightDistribution::generatePoint(Random& random, SurfacePoint& surfacePoint, const Sphere*& light) const
+{
+    if (m_lights.empty())
+        return 0;
+
+    float u = random.generateUniform() * m_distribution.back();
+    size_t index = std::upper_bound(m_distribution.begin(), m_distribution.end(), u) - m_distribution.begin();
+    light = m_lights[std::min(index, m_lights.size() - 1)];
+
+    // The normal is computed like the raytracer does.
+    glm::vec3 local = random.generateSpherical().value;
+    surfacePoint.objectId = reinterpret_cast<intptr_t>(light);
+    surfacePoint.position = (light->transform.matrix * glm::vec4(local * light->radius, 1)).xyz();
+    surfacePoint.normal = glm::normalize(glm::mat3(light->transform.matrix) * local);
+    surfacePoint.material = &light->material;
+    return probability(*light, surfacePoint.position);
+}
+
+float LightDistribution::probability(const Sphere& light, const glm::vec3& position) const
+{
+    auto found = m_indices.find(reinterpret_cast<intptr_t>(&light));
+    if (found == m_indices.end())
+        return 0;
+
+    // The transform scales the area of the unit sphere around |local| by
+    // |det M| |M^-T local|.
+    glm::vec3 local = glm::normalize((light.transform.invMatrix * glm::vec4(position, 1)).xyz());
+    float scale = std::abs(light.transform.determinant) *
+                  glm::length(glm::transpose(glm::mat3(light.transform.invMatrix)) * local);
+    return choiceProbability(found->second) / (float(4 * M_PI) * light.radius * light.radius * scale);
+}
+
+const Sphere* LightDistribution::find(intptr_t objectId) const
+{
+    auto found = m_indices.find(objectId);
+    return found != m_indices.end() ? m_lights[found->second] : 0;
+}
+
+RandomValue<glm::vec3> LightDistribution::generateDirection(const glm::vec3& normal, Random& random) const
+{
+    RandomValue<glm::vec3> sample = random.generateCosineHemispherical();
+    glm::vec3 tangent = std::abs(normal.x) > .5f ? glm::vec3(normal.y, -normal.x, 0) : glm::vec3(0, normal.z, -normal.y);
+    tangent = glm::normalize(tangent);
+    glm::vec3 binormal = glm::cross(normal, tangent);
+    sample.value = tangent * sample.value.x + binormal * sample.value.y + normal * sample.value.z;
+    return sample;
+}
+
+float LightDistribution::choiceProbability(int index) const
+{
+    return (m_distribution[index] - (index ? m_distribution[index - 1] : 0)) / m_distribution.back();
+}
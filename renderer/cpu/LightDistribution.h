@@ -0,0 +1,67 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_LIGHTDISTRIBUTION_H
+#define CPU_LIGHTDISTRIBUTION_H
+
+#include <glm/glm.hpp>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace cpu
+{
+
+class Random;
+class Scene;
+class Sphere;
+class SurfacePoint;
+
+template <typename T> class RandomValue;
+
+/**
+ *  Chooses points on the emissive spheres of a scene for tracing paths from
+ *  the lights. Each light is chosen in proportion to the power it emits, and
+ *  the point uniformly over its surface.
+ */
+class LightDistribution
+{
+public:
+    explicit LightDistribution(const Scene& scene);
+
+    bool empty() const;
+
+    /**
+     *  Sets the position, normal and material of |surfacePoint| to a point
+     *  on a light, and |light| to the light. Returns the area density of the
+     *  point, or zero if there are no lights.
+     */
+    float generatePoint(Random& random, SurfacePoint& surfacePoint, const Sphere*& light) const;
+
+    /**
+     *  Returns the area density of generatePoint() choosing |position| on
+     *  |light|, which is zero for spheres that are not lights.
+     */
+    float probability(const Sphere& light, const glm::vec3& position) const;
+
+    /**
+     *  Returns the light with the object id |objectId|, or null.
+     */
+    const Sphere* find(intptr_t objectId) const;
+
+    /**
+     *  Generates a cosine weighted emission direction around |normal|.
+     */
+    RandomValue<glm::vec3> generateDirection(const glm::vec3& normal, Random& random) const;
+
+private:
+    float choiceProbability(int index) const;
+
+    // The lights with the cumulative distribution of their power, and the
+    // index of each by object id.
+    std::vector<const Sphere*> m_lights;
+    std::vector<float> m_distribution;
+    std::unordered_map<intptr_t, int> m_indices;
+};
+
+}
+
+#endif
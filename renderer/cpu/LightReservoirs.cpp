@@ -0,0 +1,179 @@
+// Copyright (C) 2013 Sami Kyöstilä
+
+#include "LightDistribution.h"
+#include "LightReservoirs.h"
+#include "Random.h"
+#include "Scene.h"
+#include "SurfacePoint.h"
+
+#include <cmath>
+
+using namespace cpu;
+
+namespace
+{
+// Reservoirs of this many nearby pixels are reused by each sample.
+const int g_neighborCount = 2;
+
+// The nearby pixels are at most this many pixels away on each axis.
+const int g_neighborRadius = 8;
+
+// Neighbours whose normal differs more than this are not reused, since their
+// choices rarely suit the current surface.
+const float g_minNormalCosine = .9f;
+
+// Unshadowed light reflected by a diffuse surface at |position| facing
+// |normal| from |point| on a light facing |lightNormal|.
+glm::vec3 contribution(const glm::vec3& position, const glm::vec3& normal, const glm::vec3& diffuse,
+                       const Sphere& light, const glm::vec3& point, const glm::vec3& lightNormal)
+{
+    glm::vec3 offset = point - position;
+    float distanceSquared = glm::dot(offset, offset);
+    glm::vec3 direction = offset / sqrtf(distanceSquared);
+    float cosine = glm::dot(normal, direction);
+    float lightCosine = -glm::dot(lightNormal, direction);
+    if (!(cosine > 0 && lightCosine > 0))
+        return glm::vec3(0);
+    return diffuse * light.material.emission.xyz() * float(M_1_PI * cosine * lightCosine / distanceSquared);
+}
+
+// The candidates are chosen in proportion to the luminance of their
+// contribution.
+float targetFunction(const glm::vec3& contribution)
+{
+    return .2126f * contribution.x + .7152f * contribution.y + .0722f * contribution.z;
+}
+
+/**
+ *  Keeps one of a stream of weighted candidates, each with the probability
+ *  of its share of the total weight.
+ */
+class Resampler
+{
+public:
+    Resampler():
+        light(nullptr),
+        target(0),
+        weightSum(0)
+    {
+    }
+
+    void add(const Sphere* candidateLight, const glm::vec3& candidatePoint, const glm::vec3& candidateNormal,
+             float candidateTarget, float weight, Random& random)
+    {
+        if (!(weight > 0))
+            return;
+        weightSum += weight;
+        if (random.generateUniform() * weightSum < weight) {
+            light = candidateLight;
+            point = candidatePoint;
+            lightNormal = candidateNormal;
+            target = candidateTarget;
+        }
+    }
+
+    const Sphere* light;
+    glm::vec3 point;
+    glm::vec3 lightNormal;
+    float target;
+    float weightSum;
+};
+}
+
+const size_t LightReservoirs::bytesPerPixel = sizeof(Reservoir);
+
+LightReservoirs::Reservoir::Reservoir():
+    light(nullptr),
+    weight(0),
+    valid(false)
+{
+}
+
+LightReservoirs::LightReservoirs(int width, int height):
+    m_reservoirs(width * height),
+    m_width(width),
+    m_height(height)
+{
+}
+
+glm::vec4 LightReservoirs::sample(const SurfacePoint& surfacePoint, const LightDistribution& lights, int candidates,
+                                  Random& random, const Sphere*& light, glm::vec3& point)
+{
+    glm::vec3 diffuse = surfacePoint.material->diffuse.xyz();
+    Resampler resampler;
+    for (int i = 0; i < candidates; i++) {
+        SurfacePoint lightPoint;
+        const Sphere* candidate = nullptr;
+        float density = lights.generatePoint(random, lightPoint, candidate);
+        if (!(density > 0))
+            continue;
+        float target = targetFunction(contribution(surfacePoint.position, surfacePoint.normal, diffuse,
+                                                   *candidate, lightPoint.position, lightPoint.normal));
+        resampler.add(candidate, lightPoint.position, lightPoint.normal, target, target / density, random);
+    }
+
+    // Only the choice among the fresh candidates is kept. Had the final
+    // choices been kept, the same candidates would reach a pixel along
+    // several paths, and the correlated samples would converge much slower.
+    Reservoir& current = m_reservoirs[pixel.y * m_width + pixel.x];
+    Reservoir previous = current;
+    current.light = resampler.light;
+    current.point = resampler.point;
+    current.lightNormal = resampler.lightNormal;
+    current.weight = resampler.light && resampler.target > 0 ?
+                     resampler.weightSum / (candidates * resampler.target) : 0;
+    current.valid = true;
+    current.position = surfacePoint.position;
+    current.normal = surfacePoint.normal;
+    current.diffuse = diffuse;
+
+    // Resample the fresh choice together with the previous choice of this
+    // pixel, which may come from the previous pass, and the choices of a few
+    // pixels nearby.
+    const Reservoir* reused[2 + g_neighborCount];
+    int reusedCount = 0;
+    reused[reusedCount++] = &current;
+    if (previous.valid)
+        reused[reusedCount++] = &previous;
+    const int span = 2 * g_neighborRadius + 1;
+    for (int i = 0; i < g_neighborCount; i++) {
+        glm::ivec2 neighbor = pixel - glm::ivec2(g_neighborRadius) +
+                              glm::ivec2(static_cast<int>(random.generateUniform() * span),
+                                         static_cast<int>(random.generateUniform() * span));
+        if (neighbor.x < 0 || neighbor.y < 0 || neighbor.x >= m_width || neighbor.y >= m_height ||
+            neighbor == pixel)
+            continue;
+        const Reservoir& reservoir = m_reservoirs[neighbor.y * m_width + neighbor.x];
+        if (reservoir.valid && glm::dot(reservoir.normal, surfacePoint.normal) >= g_minNormalCosine)
+            reused[reusedCount++] = &reservoir;
+    }
+
+    // Each choice is weighted by the balance heuristic over the shading
+    // points of all the reservoirs, which keeps the result unbiased even
+    // where some of them cannot see the chosen point. All the reservoirs
+    // were chosen from the same number of candidates, so it cancels out.
+    auto target = [](const Reservoir& at, const Reservoir& reservoir) {
+        return targetFunction(contribution(at.position, at.normal, at.diffuse,
+                                           *reservoir.light, reservoir.point, reservoir.lightNormal));
+    };
+    Resampler combined;
+    for (int i = 0; i < reusedCount; i++) {
+        const Reservoir& reservoir = *reused[i];
+        if (!(reservoir.weight > 0))
+            continue;
+        float targetSum = 0;
+        for (int j = 0; j < reusedCount; j++)
+            targetSum += target(*reused[j], reservoir);
+        float currentTarget = target(current, reservoir);
+        combined.add(reservoir.light, reservoir.point, reservoir.lightNormal, currentTarget,
+                     target(reservoir, reservoir) / targetSum * currentTarget * reservoir.weight, random);
+    }
+
+    if (!combined.light || !(combined.target > 0))
+        return glm::vec4(0);
+    light = combined.light;
+    point = combined.point;
+    return glm::vec4(contribution(surfacePoint.position, surfacePoint.normal, diffuse,
+                                  *combined.light, combined.point, combined.lightNormal) *
+                     (combined.weightSum / combined.target), 0);
+}
@@ -0,0 +1,77 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_LIGHTRESERVOIRS_H
+#define CPU_LIGHTRESERVOIRS_H
+
+#include "Integrator.h"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace cpu
+{
+
+class LightDistribution;
+class Random;
+class Sphere;
+class SurfacePoint;
+
+/**
+ *  Chooses the light of the first diffuse hit of each pixel by resampling,
+ *  after Bitterli et al., "Spatiotemporal Reservoir Resampling for Real-Time
+ *  Ray Tracing with Dynamic Direct Lighting". Many candidate points on the
+ *  lights are weighed by their unshadowed contribution, which needs no rays,
+ *  and only the chosen one is tested for visibility. Each pixel keeps its
+ *  choice as a reservoir, which its next sample, even in the next pass, and
+ *  the samples of nearby pixels resample along with their own candidates.
+ *
+ *  The reservoirs cover the band of a render thread, so they are not shared
+ *  between threads.
+ */
+class LightReservoirs: public Integrator::ThreadState
+{
+public:
+    LightReservoirs(int width, int height);
+
+    static const size_t bytesPerPixel;
+
+    /**
+     *  Chooses a point on a light for the diffuse |surfacePoint| of the
+     *  current pixel from |candidates| points generated by |lights| and the
+     *  reservoirs of this and nearby pixels. Sets |light| and |point| to
+     *  the chosen point and returns its unshadowed contribution to the light
+     *  reflected by the surface, or zero if nothing was chosen.
+     */
+    glm::vec4 sample(const SurfacePoint& surfacePoint, const LightDistribution& lights, int candidates,
+                     Random& random, const Sphere*& light, glm::vec3& point);
+
+private:
+    /**
+     *  Point on a light chosen for a shading point, with its unbiased
+     *  contribution weight.
+     */
+    class Reservoir
+    {
+    public:
+        Reservoir();
+
+        const Sphere* light;
+        glm::vec3 point;
+        glm::vec3 lightNormal;
+        float weight;
+        // False until the pixel has been shaded.
+        bool valid;
+
+        // The shading point the light was chosen for.
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec3 diffuse;
+    };
+
+    std::vector<Reservoir> m_reservoirs;
+    int m_width;
+    int m_height;
+};
+
+}
+
+#endif
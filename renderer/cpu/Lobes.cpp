@@ -0,0 +1,33 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#include "Lobes.h"
+
+using namespace cpu;
+
+Lobes::Lobes(const Material& material):
+    transmission(0),
+    diffuse(0),
+    glossy(0),
+    mirror(0)
+{
+    float totalDiffuse = material.diffuse.x + material.diffuse.y + material.diffuse.z;
+    float totalSpecular = material.specular.x + material.specular.y + material.specular.z;
+    float totalTransparency = material.transparency.x + material.transparency.y + material.transparency.z;
+    float total = totalDiffuse + totalSpecular + totalTransparency;
+    if (!(total > 0))
+        return;
+
+    transmission = totalTransparency / total;
+    if (!(totalDiffuse + totalSpecular > 0))
+        return;
+    diffuse = (1 - transmission) * totalDiffuse / (totalDiffuse + totalSpecular);
+    float specular = 1 - transmission - diffuse;
+    if (material.specularExponent)
+        glossy = specular;
+    else
+        mirror = specular;
+}
+
+bool Lobes::scattersDiffusely() const
+{
+    return diffuse > 0 || glossy > 0;
+}
@@ -0,0 +1,33 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_LOBES_H
+#define CPU_LOBES_H
+
+#include "Scene.h"
+
+namespace cpu
+{
+
+/**
+ *  Probabilities of choosing each lobe of a material when scattering, in the
+ *  same proportions as Shader uses. Specular reflection is glossy when the
+ *  material has a Phong exponent and a mirror otherwise. The probabilities
+ *  are all zero for materials that do not scatter.
+ */
+class Lobes
+{
+public:
+    explicit Lobes(const Material& material);
+
+    // True if light is scattered from the material to more than a single
+    // direction.
+    bool scattersDiffusely() const;
+
+    float transmission;
+    float diffuse;
+    float glossy;
+    float mirror;
+};
+
+}
+
+#endif
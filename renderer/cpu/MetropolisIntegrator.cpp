@@ -0,0 +1,239 @@
+// Copyright (C) 2013 Sami Kyöstilä
+
+#include "Kernels.h"
+#include "MetropolisIntegrator.h"
+#include "PinholeCamera.h"
+#include "PrimarySample.h"
+#include "Random.h"
+#include "Ray.h"
+#include "Raytracer.h"
+#include "Scheduler.h"
+#include "SplatBuffer.h"
+#include "SurfacePoint.h"
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <new>
+#include <vector>
+#include <xmmintrin.h>
+
+using namespace cpu;
+
+namespace
+{
+// Independent paths traced to normalize the image and to start the chains.
+const size_t g_bootstrapSamples = 1 << 16;
+const size_t g_bootstrapSamplesPerChunk = 1024;
+const unsigned g_bootstrapSeed = 0xb0075eed;
+
+const float g_largeStepProbability = .3f;
+
+// Target function of the chains. Paths are visited in proportion to their
+// luminance compressed like a tone mapping operator would, so that the chains
+// do not spend most of their time on the lights, which are burnt out anyway.
+// The splats are divided by it, so any function that is positive wherever
+// the radiance is would do.
+inline float importance(const glm::vec4& radiance)
+{
+    float luminance = .2126f * radiance.x + .7152f * radiance.y + .0722f * radiance.z;
+    return luminance > 0 ? luminance / (1 + luminance) : 0;
+}
+
+// A chain must find the same radiance for the same random numbers, which a
+// radiance cache that learns while the chains run would break.
+Options shaderOptions(const Options& options)
+{
+    Options result(options);
+    result.radianceCache = false;
+    return result;
+}
+}
+
+class MetropolisIntegrator::Bootstrap: public Integrator::PassState
+{
+public:
+    // Mean importance of a path, i.e. the integral of the importance over the
+    // primary sample space.
+    float normalization;
+
+    // Cumulative importance of the bootstrap paths, for choosing the start of
+    // each chain in proportion to its importance.
+    std::vector<float> distribution;
+};
+
+class MetropolisIntegrator::Chain: public Integrator::ThreadState
+{
+public:
+    Chain(const Kernels* kernels, unsigned seed):
+        seed(seed),
+        random(kernels, seed),
+        sample(kernels, seed),
+        replay(kernels),
+        started(false)
+    {
+    }
+
+    // The generators hold 64 byte aligned batches, which plain operator new
+    // only guarantees from C++17 on.
+    static void* operator new(size_t size)
+    {
+        void* pointer = _mm_malloc(size, alignof(Chain));
+        if (!pointer)
+            throw std::bad_alloc();
+        return pointer;
+    }
+
+    static void operator delete(void* pointer)
+    {
+        _mm_free(pointer);
+    }
+
+    unsigned seed;
+    // Chooses the mutations and accepts them.
+    Random random;
+    PrimarySample sample;
+    // Feeds |sample| to the path tracer.
+    Random replay;
+    PathSample current;
+    bool started;
+};
+
+MetropolisIntegrator::MetropolisIntegrator(Scene* scene, Raytracer* raytracer, const PinholeCamera* camera,
+                                           SplatBuffer* splats, const Options& options):
+    m_raytracer(raytracer),
+    m_camera(camera),
+    m_splats(splats),
+    m_options(options),
+    m_shader(scene, raytracer, camera, shaderOptions(options))
+{
+}
+
+std::shared_ptr<const Integrator::PassState> MetropolisIntegrator::beginPass(int pass) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_bootstrap)
+        m_bootstrap = createBootstrap();
+    return m_bootstrap;
+}
+
+std::unique_ptr<Integrator::ThreadState> MetropolisIntegrator::createThreadState(Random& random, int, int) const
+{
+    unsigned seed = unsigned(random.generateUniform() * (1 << 24)) ^
+                    (unsigned(random.generateUniform() * (1 << 24)) << 8);
+    return std::unique_ptr<ThreadState>(new Chain(&Kernels::forIsa(m_options.isa), seed));
+}
+
+std::shared_ptr<const MetropolisIntegrator::Bootstrap> MetropolisIntegrator::createBootstrap() const
+{
+    // Trace the paths with all processors. Each path has its own seed, so
+    // that a chain can replay it.
+    std::vector<float> importances(g_bootstrapSamples);
+    size_t chunkCount = g_bootstrapSamples / g_bootstrapSamplesPerChunk;
+    std::atomic<size_t> nextChunk(0);
+
+    std::vector<std::future<void>> tasks;
+    for (int i = 0; i < cpuCount(); i++) {
+        tasks.push_back(std::async(std::launch::async, [&] {
+            const Kernels* kernels = &Kernels::forIsa(m_options.isa);
+            PrimarySample sample(kernels, 0);
+            Random replay(kernels);
+            for (size_t chunk; (chunk = nextChunk++) < chunkCount;) {
+                size_t first = chunk * g_bootstrapSamplesPerChunk;
+                for (size_t j = first; j < first + g_bootstrapSamplesPerChunk; j++) {
+                    sample.restart(g_bootstrapSeed + j);
+                    sample.startIteration(true);
+                    replay.setPrimarySample(&sample);
+                    importances[j] = evaluate(replay).importance;
+                }
+            }
+        }));
+    }
+    for (auto& task: tasks)
+        task.wait();
+
+    std::shared_ptr<Bootstrap> bootstrap(new Bootstrap());
+    bootstrap->distribution.resize(g_bootstrapSamples);
+    double total = 0;
+    for (size_t i = 0; i < g_bootstrapSamples; i++) {
+        total += importances[i];
+        bootstrap->distribution[i] = total;
+    }
+    bootstrap->normalization = total / g_bootstrapSamples;
+    return bootstrap;
+}
+
+void MetropolisIntegrator::startChain(Chain& chain, const Bootstrap& bootstrap) const
+{
+    // Replay a bootstrap path chosen in proportion to its importance, which
+    // makes the chain start from its stationary distribution. Then give the
+    // chain mutations of its own.
+    float u = chain.random.generateUniform() * bootstrap.distribution.back();
+    size_t index = std::upper_bound(bootstrap.distribution.begin(), bootstrap.distribution.end(), u) -
+                   bootstrap.distribution.begin();
+    index = std::min(index, bootstrap.distribution.size() - 1);
+
+    chain.sample.restart(g_bootstrapSeed + index);
+    chain.sample.startIteration(true);
+    chain.replay.setPrimarySample(&chain.sample);
+    chain.current = evaluate(chain.replay);
+    chain.sample.setSeed(chain.seed);
+    chain.started = true;
+}
+
+glm::vec4 MetropolisIntegrator::radiance(const SurfacePoint&, Random&,
+                                         const PassState* passState, ThreadState* threadState) const
+{
+    const Bootstrap& bootstrap = static_cast<const Bootstrap&>(*passState);
+    Chain& chain = static_cast<Chain&>(*threadState);
+
+    // Each camera sample of the renderer is one mutation. The camera ray
+    // the renderer traced is not used, since the chain picks its own film
+    // position.
+    m_splats->addSample();
+    if (!(bootstrap.normalization > 0))
+        return glm::vec4(0);
+    if (!chain.started)
+        startChain(chain, bootstrap);
+
+    bool largeStep = chain.random.generateUniform() < g_largeStepProbability;
+    chain.sample.startIteration(largeStep);
+    chain.replay.setPrimarySample(&chain.sample);
+    PathSample proposal = evaluate(chain.replay);
+
+    // Splat both paths weighted by the probability of ending up in each, which
+    // makes use of the rejected ones too. Paths without importance carry no
+    // light and are not splatted, which would divide zero by zero.
+    float acceptance = chain.current.importance > 0 ?
+                       std::min(1.f, proposal.importance / chain.current.importance) : 1;
+    if (acceptance > 0 && proposal.importance > 0)
+        splat(proposal, acceptance * bootstrap.normalization / proposal.importance);
+    if (acceptance < 1 && chain.current.importance > 0)
+        splat(chain.current, (1 - acceptance) * bootstrap.normalization / chain.current.importance);
+
+    if (chain.random.generateUniform() < acceptance)
+        chain.current = proposal;
+    else
+        chain.sample.reject();
+    return glm::vec4(0);
+}
+
+MetropolisIntegrator::PathSample MetropolisIntegrator::evaluate(Random& random) const
+{
+    PathSample sample;
+    sample.filmX = random.generateUniform();
+    sample.filmY = random.generateUniform();
+
+    Ray ray;
+    ray.origin = m_camera->origin;
+    ray.direction = m_camera->direction(sample.filmX, sample.filmY);
+    SurfacePoint surfacePoint = m_raytracer->trace(ray);
+    sample.radiance = m_shader.shade(surfacePoint, random);
+    sample.importance = importance(sample.radiance);
+    return sample;
+}
+
+void MetropolisIntegrator::splat(const PathSample& sample, float weight) const
+{
+    m_splats->add(sample.filmX, sample.filmY, glm::vec3(sample.radiance) * weight);
+}
@@ -0,0 +1,72 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_METROPOLISINTEGRATOR_H
+#define CPU_METROPOLISINTEGRATOR_H
+
+#include "Integrator.h"
+#include "Options.h"
+#include "Shader.h"
+
+#include <glm/glm.hpp>
+#include <mutex>
+
+namespace cpu
+{
+
+class PinholeCamera;
+class Random;
+class Raytracer;
+class Scene;
+class SplatBuffer;
+
+/**
+ *  Primary sample space Metropolis light transport after Kelemen et al.
+ *  Every render thread runs a Markov chain over the random numbers that
+ *  Shader turns into a camera path, and mutates them once for every camera
+ *  sample. The chain visits paths in proportion to their brightness, so
+ *  once it finds light that reaches the camera through a small gap or a
+ *  mirror, it keeps exploring the nearby paths. The results go to the splat
+ *  buffer, scaled by the mean brightness of a bootstrap set of independent
+ *  paths.
+ */
+class MetropolisIntegrator: public Integrator
+{
+public:
+    MetropolisIntegrator(Scene* scene, Raytracer* raytracer, const PinholeCamera* camera,
+                         SplatBuffer* splats, const Options& options);
+
+    std::shared_ptr<const PassState> beginPass(int pass) const override;
+    std::unique_ptr<ThreadState> createThreadState(Random& random, int width, int height) const override;
+    glm::vec4 radiance(const SurfacePoint& surfacePoint, Random& random,
+                       const PassState* passState, ThreadState* threadState) const override;
+
+private:
+    class Bootstrap;
+    class Chain;
+
+    class PathSample
+    {
+    public:
+        float filmX;
+        float filmY;
+        glm::vec4 radiance;
+        float importance;
+    };
+
+    std::shared_ptr<const Bootstrap> createBootstrap() const;
+    void startChain(Chain& chain, const Bootstrap& bootstrap) const;
+    PathSample evaluate(Random& random) const;
+    void splat(const PathSample& sample, float weight) const;
+
+    Raytracer* m_raytracer;
+    const PinholeCamera* m_camera;
+    SplatBuffer* m_splats;
+    Options m_options;
+    Shader m_shader;
+
+    mutable std::mutex m_mutex;
+    mutable std::shared_ptr<const Bootstrap> m_bootstrap;
+};
+
+}
+
+#endif
@@ -0,0 +1,30 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#include "Options.h"
+
+#include <sstream>
+
+using namespace cpu;
+
+Options::Options():
+    accumulatorFormat(AccumulatorFormat::Float),
+    isa(detectIsa()),
+    integrator(IntegratorType::PathTracing),
+    rouletteDepth(3),
+    maxDepth(8),
+    lightSplit(1),
+    indirectSplit(1),
+    photonCount(200000),
+    photonRadius(0),
+    pathGuiding(false),
+    radianceCache(false),
+    lightCandidates(0),
+    occlusionDistance(1)
+{
+}
+
+std::string cpu::splitDescription(const Options& options)
+{
+    std::ostringstream result;
+    result << options.lightSplit << " light + " << options.indirectSplit << " indirect rays/hit";
+    return result.str();
+}
@@ -0,0 +1,64 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_OPTIONS_H
+#define CPU_OPTIONS_H
+
+#include "Accumulator.h"
+#include "Integrator.h"
+#include "Isa.h"
+
+#include <string>
+
+namespace cpu
+{
+
+class Options
+{
+public:
+    Options();
+
+    AccumulatorFormat accumulatorFormat;
+    Isa isa;
+    IntegratorType integrator;
+
+    // Paths are terminated with Russian roulette from |rouletteDepth|
+    // bounces on, and unconditionally after |maxDepth| bounces.
+    int rouletteDepth;
+    int maxDepth;
+
+    // Paths are split at their first diffuse or glossy hit into |lightSplit|
+    // light samples and |indirectSplit| continuations.
+    int lightSplit;
+    int indirectSplit;
+
+    // Photon mapping stores about |photonCount| photons per pass. The gather
+    // radius starts from |photonRadius|, or from a fraction of the extent of
+    // the photons if it is zero.
+    int photonCount;
+    float photonRadius;
+
+    // The path tracer guides the indirect rays of diffuse surfaces by the
+    // light found in earlier passes.
+    bool pathGuiding;
+
+    // The path tracer ends paths at their second diffuse surface with the
+    // light cached from earlier paths, which is biased but much faster.
+    bool radianceCache;
+
+    // The path tracer chooses the direct light of the first diffuse hit
+    // from |lightCandidates| points on the lights, reusing the choices of
+    // earlier samples and nearby pixels, unless it is zero.
+    int lightCandidates;
+
+    // Ambient occlusion only counts the surfaces within |occlusionDistance|
+    // of the shaded point.
+    float occlusionDistance;
+};
+
+/**
+ *  Describes the path splitting of |options| for the render statistics.
+ */
+std::string splitDescription(const Options& options);
+
+}
+
+#endif
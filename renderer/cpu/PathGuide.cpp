@@ -0,0 +1,111 @@
+// Copyright (C) 2013 Sami Kyöstilä
+
+#include "PathGuide.h"
+#include "SDTree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+
+using namespace cpu;
+
+namespace
+{
+// Regions are split until they hold at most this many samples times the
+// square root of the number of passes in the round, like in Müller et al.
+const float g_samplesPerRegion = 12000;
+
+// A pass already has many samples per pixel, so the first passes are rounds
+// of their own, which lets the trees refine quickly. The rounds double in
+// length from this pass on.
+const int g_firstLongRound = 8;
+
+// Timing every sample would cost a good part of recording it, so one sample
+// in this many is timed.
+const uint64_t g_timedRecordInterval = 64;
+
+int roundStart(int round)
+{
+    return round < g_firstLongRound ? round + 1 : g_firstLongRound << (round - g_firstLongRound + 1);
+}
+
+int roundOfPass(int pass)
+{
+    int round = 0;
+    while (roundStart(round + 1) <= pass)
+        round++;
+    return round;
+}
+
+int64_t nanosecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+}
+
+PathGuide::PathGuide():
+    m_round(0),
+    m_recordCount(0),
+    m_recordNanoseconds(0),
+    m_refineNanoseconds(0)
+{
+    std::shared_ptr<Pass> pass = std::make_shared<Pass>();
+    pass->training = std::make_shared<SDTree>();
+    m_pass = pass;
+}
+
+PathGuide::~PathGuide()
+{
+}
+
+std::shared_ptr<const PathGuide::Pass> PathGuide::beginPass(int pass)
+{
+    // Threads that are still in the previous round keep recording into its
+    // tree, but those samples are not learned from anymore. Rendering bands
+    // starts the passes over, which keeps the trees of the latest round.
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int round = roundOfPass(std::max(pass, 1));
+    if (round <= m_round)
+        return m_pass;
+
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<Pass> next = std::make_shared<Pass>();
+    std::shared_ptr<SDTree> sampling = std::make_shared<SDTree>(*m_pass->training);
+    sampling->build();
+    next->sampling = sampling;
+    next->training = sampling->refined(g_samplesPerRegion * sqrtf(roundStart(round + 1) - roundStart(round)));
+    m_pass = next;
+    m_round = round;
+    m_refineNanoseconds += nanosecondsSince(start);
+    return m_pass;
+}
+
+void PathGuide::record(const Pass& pass, const glm::vec3& position, const glm::vec3& direction, float value)
+{
+    if (m_recordCount.fetch_add(1, std::memory_order_relaxed) % g_timedRecordInterval) {
+        pass.training->record(position, direction, value);
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    pass.training->record(position, direction, value);
+    m_recordNanoseconds.fetch_add(nanosecondsSince(start) * g_timedRecordInterval, std::memory_order_relaxed);
+}
+
+std::string PathGuide::statistics() const
+{
+    std::shared_ptr<const Pass> pass;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        pass = m_pass;
+    }
+    const SDTree& tree = pass->sampling ? *pass->sampling : *pass->training;
+
+    std::ostringstream result;
+    result.precision(3);
+    result << "guided by " << tree.regionCount() << " regions in "
+           << (tree.bytes() + pass->training->bytes()) / float(1 << 20) << " MB, learned in "
+           << (m_recordNanoseconds + m_refineNanoseconds) * 1e-9 << " thread s from "
+           << m_recordCount << " samples";
+    return result.str();
+}
@@ -0,0 +1,74 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_PATHGUIDE_H
+#define CPU_PATHGUIDE_H
+
+#include "Integrator.h"
+
+#include <atomic>
+#include <glm/glm.hpp>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+namespace cpu
+{
+
+class SDTree;
+
+/**
+ *  Learns where the indirect light of a scene comes from, after Müller et
+ *  al., "Practical Path Guiding for Efficient Light-Transport Simulation".
+ *  The passes are grouped into rounds, which double in length after the
+ *  first few. Every round records the light found by the paths into a new
+ *  spatial-directional tree, whose regions and directions are refined where
+ *  the previous round found light, and the paths of the next round are
+ *  guided by the finished tree.
+ */
+class PathGuide
+{
+public:
+    /**
+     *  Trees of a pass. |sampling| is null until the first round is over.
+     */
+    class Pass: public Integrator::PassState
+    {
+    public:
+        std::shared_ptr<const SDTree> sampling;
+        std::shared_ptr<SDTree> training;
+    };
+
+    PathGuide();
+    ~PathGuide();
+
+    /**
+     *  Returns the trees for pass |pass|, counting from one. Starts a new
+     *  round when the pass is the first of one.
+     */
+    std::shared_ptr<const Pass> beginPass(int pass);
+
+    /**
+     *  Records that |value| arrived at |position| from |direction| in the
+     *  training tree of |pass|.
+     */
+    void record(const Pass& pass, const glm::vec3& position, const glm::vec3& direction, float value);
+
+    /**
+     *  Describes the size of the trees and the time spent learning them.
+     */
+    std::string statistics() const;
+
+private:
+    mutable std::mutex m_mutex;
+    int m_round;
+    std::shared_ptr<const Pass> m_pass;
+
+    // Thread time spent recording samples and refining the trees.
+    std::atomic<uint64_t> m_recordCount;
+    std::atomic<int64_t> m_recordNanoseconds;
+    std::atomic<int64_t> m_refineNanoseconds;
+};
+
+}
+
+#endif
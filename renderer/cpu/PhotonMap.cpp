@@ -0,0 +1,41 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#include "PhotonMap.h"
+
+#include <algorithm>
+
+using namespace cpu;
+
+const size_t PhotonMap::bytesPerPhoton = sizeof(Photon) + 2 * sizeof(uint32_t);
+
+PhotonMap::PhotonMap(const std::vector<Photon>& photons, size_t emittedCount, float radius):
+    emittedCount(emittedCount),
+    radius(radius),
+    m_cellSize(2 * radius)
+{
+    // Use about two buckets per photon
+    size_t bucketCount = 1;
+    while (bucketCount < 2 * photons.size())
+        bucketCount *= 2;
+    m_bucketMask = bucketCount - 1;
+
+    // Counting sort by bucket
+    std::vector<uint32_t> buckets(photons.size());
+    m_bucketStarts.assign(bucketCount + 1, 0);
+    for (size_t i = 0; i < photons.size(); i++) {
+        buckets[i] = bucket(glm::ivec3(glm::floor(photons[i].position / m_cellSize)));
+        m_bucketStarts[buckets[i] + 1]++;
+    }
+    for (size_t i = 0; i < bucketCount; i++)
+        m_bucketStarts[i + 1] += m_bucketStarts[i];
+
+    std::vector<uint32_t> next(m_bucketStarts.begin(), m_bucketStarts.end() - 1);
+    m_photons.resize(photons.size());
+    for (size_t i = 0; i < photons.size(); i++)
+        m_photons[next[buckets[i]]++] = photons[i];
+}
+
+size_t PhotonMap::bucket(const glm::ivec3& cell) const
+{
+    uint32_t hash = uint32_t(cell.x) * 73856093u ^ uint32_t(cell.y) * 19349663u ^ uint32_t(cell.z) * 83492791u;
+    return hash & m_bucketMask;
+}
@@ -0,0 +1,90 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_PHOTONMAP_H
+#define CPU_PHOTONMAP_H
+
+#include "Integrator.h"
+
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <stdint.h>
+#include <vector>
+
+namespace cpu
+{
+
+class Photon
+{
+public:
+    glm::vec3 position;
+    // Unit direction towards where the photon came from.
+    glm::vec3 direction;
+    glm::vec3 power;
+};
+
+/**
+ *  Photons of a pass in a hashed uniform grid. The cells are twice the
+ *  lookup radius wide, so a lookup visits the eight cells around the query
+ *  point. The photons are sorted by cell, which keeps the photons of a
+ *  lookup close together in memory.
+ */
+class PhotonMap: public Integrator::PassState
+{
+public:
+    /**
+     *  Builds a map of |photons|, which were traced from |emittedCount|
+     *  emitted photons, for lookups within |radius|.
+     */
+    PhotonMap(const std::vector<Photon>& photons, size_t emittedCount, float radius);
+
+    static const size_t bytesPerPhoton;
+
+    /**
+     *  Calls |function| for every photon within the radius of |position|.
+     */
+    template <typename Function>
+    void lookup(const glm::vec3& position, Function function) const;
+
+    size_t emittedCount;
+    float radius;
+
+private:
+    size_t bucket(const glm::ivec3& cell) const;
+
+    std::vector<Photon> m_photons;
+    // Photons of bucket i are [m_bucketStarts[i], m_bucketStarts[i + 1]).
+    std::vector<uint32_t> m_bucketStarts;
+    size_t m_bucketMask;
+    float m_cellSize;
+};
+
+template <typename Function>
+void PhotonMap::lookup(const glm::vec3& position, Function function) const
+{
+    if (m_photons.empty())
+        return;
+
+    // Cells of different coordinates can share a bucket, so each bucket is
+    // only visited once.
+    glm::ivec3 first(glm::floor(position / m_cellSize - glm::vec3(.5f)));
+    size_t buckets[8];
+    int bucketCount = 0;
+    for (int i = 0; i < 8; i++) {
+        size_t index = bucket(first + glm::ivec3(i & 1, (i >> 1) & 1, i >> 2));
+        if (std::find(buckets, buckets + bucketCount, index) == buckets + bucketCount)
+            buckets[bucketCount++] = index;
+    }
+
+    float radiusSquared = radius * radius;
+    for (int i = 0; i < bucketCount; i++) {
+        for (uint32_t j = m_bucketStarts[buckets[i]]; j < m_bucketStarts[buckets[i] + 1]; j++) {
+            const Photon& photon = m_photons[j];
+            glm::vec3 offset = photon.position - position;
+            if (glm::dot(offset, offset) < radiusSquared)
+                function(photon);
+        }
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,272 @@
+// Copyright (C) 2013 Sami Kyöstilä
+
+#include "BSDF.h"
+#include "Kernels.h"
+#include "Lobes.h"
+#include "PhotonMap.h"
+#include "PhotonMapIntegrator.h"
+#include "Random.h"
+#include "Ray.h"
+#include "Raytracer.h"
+#include "Scene.h"
+#include "Scheduler.h"
+#include "SurfacePoint.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <future>
+
+using namespace cpu;
+
+namespace
+{
+const float g_surfaceEpsilon = 0.001f;
+
+// Photons are traced in chunks, each with its own random number sequence,
+// so that a map does not depend on how the chunks are spread over threads.
+const size_t g_photonsPerChunk = 4096;
+
+// A chunk gives up if lights emit this many photons per stored photon,
+// e.g. when the lights shine into empty space.
+const size_t g_maxEmittedPerStored = 64;
+
+// Rate of the radius reduction, between 0 and 1. Smaller values shrink the
+// radius faster, which trades noise for bias.
+const float g_radiusAlpha = 2.f / 3;
+
+// Automatic initial radius relative to the extent of the photons.
+const float g_relativeRadius = 1.f / 256;
+}
+
+PhotonMapIntegrator::PhotonMapIntegrator(Scene* scene, Raytracer* raytracer, const Options& options):
+    m_scene(scene),
+    m_raytracer(raytracer),
+    m_options(options),
+    m_lights(*scene),
+    m_initialRadius(options.photonRadius)
+{
+}
+
+std::shared_ptr<const Integrator::PassState> PhotonMapIntegrator::beginPass(int pass) const
+{
+    // Threads starting the same pass wait for the first one to build the map.
+    // The map is built with all processors, so threads waiting for another
+    // pass lose little.
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::shared_ptr<const PhotonMap> photonMap = m_photonMaps[pass].lock();
+    if (!photonMap) {
+        photonMap = buildPhotonMap(pass);
+        m_photonMaps[pass] = photonMap;
+    }
+
+    for (auto i = m_photonMaps.begin(); i != m_photonMaps.end();) {
+        if (i->second.expired())
+            i = m_photonMaps.erase(i);
+        else
+            ++i;
+    }
+    return photonMap;
+}
+
+std::shared_ptr<const PhotonMap> PhotonMapIntegrator::buildPhotonMap(int pass) const
+{
+    if (m_lights.empty())
+        return std::make_shared<PhotonMap>(std::vector<Photon>(), 0, radius(pass));
+
+    size_t chunkCount = (std::max<size_t>(m_options.photonCount, 1) + g_photonsPerChunk - 1) / g_photonsPerChunk;
+    std::vector<std::vector<Photon>> chunks(chunkCount);
+    std::vector<size_t> emittedCounts(chunkCount);
+    std::atomic<size_t> nextChunk(0);
+
+    std::vector<std::future<void>> tasks;
+    for (int i = 0; i < cpuCount(); i++) {
+        tasks.push_back(std::async(std::launch::async, [&] {
+            Random random(&Kernels::forIsa(m_options.isa));
+            for (size_t chunk; (chunk = nextChunk++) < chunkCount;) {
+                random.setSeed(0x9e3779b9u * pass + 0x7f4a7c15u * chunk);
+                emittedCounts[chunk] = 0;
+                while (chunks[chunk].size() < g_photonsPerChunk &&
+                       emittedCounts[chunk] < g_photonsPerChunk * g_maxEmittedPerStored) {
+                    tracePhoton(random, chunks[chunk]);
+                    emittedCounts[chunk]++;
+                }
+            }
+        }));
+    }
+    for (auto& task: tasks)
+        task.wait();
+
+    std::vector<Photon> photons;
+    size_t emittedCount = 0;
+    for (size_t i = 0; i < chunkCount; i++) {
+        photons.insert(photons.end(), chunks[i].begin(), chunks[i].end());
+        std::vector<Photon>().swap(chunks[i]);
+        emittedCount += emittedCounts[i];
+    }
+
+    if (!(m_initialRadius > 0)) {
+        glm::vec3 lower(HUGE_VALF), upper(-HUGE_VALF);
+        for (const Photon& photon: photons) {
+            lower = glm::min(lower, photon.position);
+            upper = glm::max(upper, photon.position);
+        }
+        m_initialRadius = photons.empty() ? 1 : std::max(glm::length(upper - lower) * g_relativeRadius, 1e-4f);
+    }
+    return std::make_shared<PhotonMap>(photons, emittedCount, radius(pass));
+}
+
+void PhotonMapIntegrator::tracePhoton(Random& random, std::vector<Photon>& photons) const
+{
+    SurfacePoint lightPoint;
+    const Sphere* light;
+    float pointProbability = m_lights.generatePoint(random, lightPoint, light);
+    if (!(pointProbability > 0))
+        return;
+    RandomValue<glm::vec3> direction = m_lights.generateDirection(lightPoint.normal, random);
+    if (!direction.probability)
+        return;
+
+    Ray ray;
+    ray.direction = direction.value;
+    ray.origin = lightPoint.position + ray.direction * g_surfaceEpsilon;
+    glm::vec4 power = light->material.emission * glm::dot(lightPoint.normal, ray.direction) /
+                      (pointProbability * direction.probability);
+
+    // The scattering weights without the emitted power drive Russian
+    // roulette.
+    glm::vec4 scattering(1);
+    for (int depth = 0; depth < m_options.maxDepth; depth++) {
+        SurfacePoint surfacePoint = m_raytracer->trace(ray);
+        if (!surfacePoint.valid() || !surfacePoint.material)
+            break;
+
+        const Material& material = *surfacePoint.material;
+        Lobes lobes(material);
+        if (lobes.scattersDiffusely())
+            photons.push_back(Photon{surfacePoint.position, -ray.direction, glm::vec3(power)});
+
+        float continueProbability = 1;
+        if (depth >= m_options.rouletteDepth) {
+            auto shouldContinue = random.russianRoulette(scattering);
+            if (!shouldContinue.value)
+                break;
+            continueProbability = shouldContinue.probability;
+        }
+
+        // Scatter with a single lobe like Shader does. Reflections need
+        // light arriving from the front, like in Shader.
+        surfacePoint.view = ray.direction;
+        float u = random.generateUniform();
+        glm::vec4 weight;
+        if (u < lobes.transmission) {
+            IdealTransmissionBSDF bsdf(&surfacePoint, material.specular, material.refractiveIndex);
+            ray.direction = bsdf.generateSample(random).value;
+            weight = material.specular / lobes.transmission;
+        } else {
+            if (glm::dot(surfacePoint.normal, ray.direction) >= 0)
+                break;
+            if (u < lobes.transmission + lobes.mirror) {
+                ray.direction = glm::reflect(ray.direction, surfacePoint.normal);
+                weight = material.specular / lobes.mirror;
+            } else {
+                bool diffuse = u < lobes.transmission + lobes.mirror + lobes.diffuse;
+                RandomValue<glm::vec3> sample;
+                if (diffuse) {
+                    LambertBSDF bsdf(&surfacePoint, material.diffuse);
+                    sample = bsdf.generateSample(random);
+                    weight = bsdf.evaluateSample(sample.value) / lobes.diffuse;
+                } else {
+                    PhongBSDF bsdf(&surfacePoint, material.specular, material.specularExponent);
+                    sample = bsdf.generateSample(random);
+                    weight = bsdf.evaluateSample(sample.value) / lobes.glossy;
+                }
+                float cosine = glm::dot(surfacePoint.normal, sample.value);
+                if (!sample.probability || cosine <= 0)
+                    break;
+                ray.direction = sample.value;
+                weight *= cosine / sample.probability;
+            }
+        }
+        weight /= continueProbability;
+        power *= weight;
+        scattering *= weight;
+        if (power == glm::vec4(0))
+            break;
+
+        ray.origin = surfacePoint.position + ray.direction * g_surfaceEpsilon;
+        ray.minDistance = 0;
+        ray.maxDistance = HUGE_VALF;
+    }
+}
+
+glm::vec4 PhotonMapIntegrator::radiance(const SurfacePoint& surfacePoint, Random& random,
+                                        const PassState* passState, ThreadState*) const
+{
+    const PhotonMap& photons = static_cast<const PhotonMap&>(*passState);
+
+    // Follow the mirrors and glass from the camera to a surface where the
+    // photons can be gathered.
+    glm::vec4 radiance;
+    glm::vec4 weight(1);
+    SurfacePoint point = surfacePoint;
+    for (int depth = 0; ; depth++) {
+        if (!point.valid() || !point.material)
+            return radiance + weight * m_scene->backgroundColor;
+
+        const Material& material = *point.material;
+        radiance += weight * material.emission;
+        if (depth >= m_options.maxDepth)
+            break;
+
+        Lobes lobes(material);
+        float u = random.generateUniform();
+        if (u >= lobes.transmission + lobes.mirror) {
+            if (lobes.scattersDiffusely())
+                radiance += weight * gather(photons, point) / (1 - lobes.transmission - lobes.mirror);
+            break;
+        }
+
+        Ray ray;
+        if (u < lobes.transmission) {
+            IdealTransmissionBSDF bsdf(&point, material.specular, material.refractiveIndex);
+            ray.direction = bsdf.generateSample(random).value;
+            weight *= material.specular / lobes.transmission;
+        } else {
+            ray.direction = glm::reflect(point.view, point.normal);
+            if (glm::dot(point.normal, ray.direction) <= 0)
+                break;
+            weight *= material.specular / lobes.mirror;
+        }
+        ray.origin = point.position + ray.direction * g_surfaceEpsilon;
+        point = m_raytracer->trace(ray);
+    }
+    return radiance;
+}
+
+glm::vec4 PhotonMapIntegrator::gather(const PhotonMap& photons, const SurfacePoint& surfacePoint) const
+{
+    // Like in Shader, surfaces only reflect light arriving from the front.
+    const Material& material = *surfacePoint.material;
+    LambertBSDF lambert(&surfacePoint, material.diffuse);
+    PhongBSDF phong(&surfacePoint, material.specular, material.specularExponent);
+    glm::vec4 result;
+    photons.lookup(surfacePoint.position, [&] (const Photon& photon) {
+        if (glm::dot(surfacePoint.normal, photon.direction) <= 0)
+            return;
+        glm::vec4 f = lambert.evaluateSample(photon.direction);
+        if (material.specularExponent)
+            f += phong.evaluateSample(photon.direction);
+        result += f * glm::vec4(photon.power, 0);
+    });
+    return result / (float(M_PI) * photons.radius * photons.radius * photons.emittedCount);
+}
+
+float PhotonMapIntegrator::radius(int pass) const
+{
+    // r(i + 1)^2 = r(i)^2 (i + alpha) / (i + 1)
+    float radiusSquared = m_initialRadius * m_initialRadius;
+    for (int i = 1; i < pass; i++)
+        radiusSquared *= (i + g_radiusAlpha) / (i + 1);
+    return sqrtf(radiusSquared);
+}
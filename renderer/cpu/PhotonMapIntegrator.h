@@ -0,0 +1,59 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_PHOTONMAPINTEGRATOR_H
+#define CPU_PHOTONMAPINTEGRATOR_H
+
+#include "Integrator.h"
+#include "LightDistribution.h"
+#include "Options.h"
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace cpu
+{
+
+class Photon;
+class PhotonMap;
+class Raytracer;
+class Scene;
+
+/**
+ *  Progressive photon mapping after Knaus and Zwicker. Every pass traces a
+ *  new photon map from the emissive spheres, and camera rays gather the
+ *  photons around their first diffuse or glossy hit, following mirrors and
+ *  glass on the way. The gather radius shrinks from pass to pass, so that
+ *  the average of the passes converges to the correct image. Caustics
+ *  converge much faster than with path tracing.
+ */
+class PhotonMapIntegrator: public Integrator
+{
+public:
+    PhotonMapIntegrator(Scene* scene, Raytracer* raytracer, const Options& options);
+
+    std::shared_ptr<const PassState> beginPass(int pass) const override;
+    glm::vec4 radiance(const SurfacePoint& surfacePoint, Random& random,
+                       const PassState* passState, ThreadState* threadState) const override;
+
+private:
+    std::shared_ptr<const PhotonMap> buildPhotonMap(int pass) const;
+    void tracePhoton(Random& random, std::vector<Photon>& photons) const;
+    glm::vec4 gather(const PhotonMap& photons, const SurfacePoint& surfacePoint) const;
+    float radius(int pass) const;
+
+    Scene* m_scene;
+    Raytracer* m_raytracer;
+    Options m_options;
+    LightDistribution m_lights;
+
+    // Photon maps of the passes in progress. A map is freed when no thread
+    // renders its pass anymore, and rebuilt identically if it is needed
+    // again.
+    mutable std::mutex m_mutex;
+    mutable std::map<int, std::weak_ptr<const PhotonMap>> m_photonMaps;
+    mutable float m_initialRadius;
+};
+
+}
+
+#endif
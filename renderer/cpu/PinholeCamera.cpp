@@ -0,0 +1,49 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#include "PinholeCamera.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace cpu;
+
+PinholeCamera::PinholeCamera(const Camera& camera)
+{
+    const glm::vec4 viewport(0, 0, 1, 1);
+    glm::vec3 p1 = glm::unProject(glm::vec3(0.f, 0.f, 0.f), camera.transform, camera.projection, viewport);
+    glm::vec3 p2 = glm::unProject(glm::vec3(1.f, 0.f, 0.f), camera.transform, camera.projection, viewport);
+    glm::vec3 p3 = glm::unProject(glm::vec3(0.f, 1.f, 0.f), camera.transform, camera.projection, viewport);
+    origin = glm::vec3(glm::inverse(camera.transform) * glm::vec4(0.f, 0.f, 0.f, 1.f));
+
+    m_corner = p1 - origin;
+    m_right = p2 - p1;
+    m_up = p3 - p1;
+    glm::vec3 normal = glm::cross(m_right, m_up);
+    m_area = glm::length(normal);
+    m_normal = normal / m_area;
+    if (glm::dot(m_normal, m_corner) < 0)
+        m_normal = -m_normal;
+    m_distance = glm::dot(m_normal, m_corner);
+}
+
+glm::vec3 PinholeCamera::direction(float filmX, float filmY) const
+{
+    return glm::normalize(m_corner + m_right * filmX + m_up * filmY);
+}
+
+bool PinholeCamera::project(const glm::vec3& direction, float& filmX, float& filmY, float& density) const
+{
+    float cosTheta = glm::dot(direction, m_normal);
+    if (cosTheta <= 0)
+        return false;
+
+    // The film vectors are perpendicular, so the film position is the
+    // projection of the hit point on each of them.
+    glm::vec3 filmPoint = direction * (m_distance / cosTheta) - m_corner;
+    filmX = glm::dot(filmPoint, m_right) / glm::dot(m_right, m_right);
+    filmY = glm::dot(filmPoint, m_up) / glm::dot(m_up, m_up);
+    if (filmX < 0 || filmX >= 1 || filmY < 0 || filmY >= 1)
+        return false;
+
+    // A unit of solid angle covers distance^2 / cos^3 of film area.
+    density = m_distance * m_distance / (cosTheta * cosTheta * cosTheta * m_area);
+    return true;
+}
@@ -0,0 +1,49 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_PINHOLECAMERA_H
+#define CPU_PINHOLECAMERA_H
+
+#include "Scene.h"
+
+#include <glm/glm.hpp>
+
+namespace cpu
+{
+
+/**
+ *  Maps positions on the film to camera rays and back. Film positions are in
+ *  [0, 1) on both axes, with y pointing up.
+ */
+class PinholeCamera
+{
+public:
+    explicit PinholeCamera(const Camera& camera);
+
+    /**
+     *  Returns the unit direction of the ray through the given film position.
+     */
+    glm::vec3 direction(float filmX, float filmY) const;
+
+    /**
+     *  Finds the film position hit by a ray leaving the camera in |direction|.
+     *  |density| is set to the probability density of direction() with a
+     *  uniformly distributed film position, per unit solid angle. Returns
+     *  false if the ray misses the film.
+     */
+    bool project(const glm::vec3& direction, float& filmX, float& filmY, float& density) const;
+
+    glm::vec3 origin;
+
+private:
+    // Corner of the film relative to the origin, the vectors spanning the
+    // film and its unit normal facing away from the origin.
+    glm::vec3 m_corner;
+    glm::vec3 m_right;
+    glm::vec3 m_up;
+    glm::vec3 m_normal;
+    float m_distance;
+    float m_area;
+};
+
+}
+
+#endif
@@ -0,0 +1,98 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#include "PrimarySample.h"
+
+#include <cmath>
+
+using namespace cpu;
+
+namespace
+{
+// Bounds of the small step perturbation.
+const float g_minPerturbation = 1.f / 1024;
+const float g_maxPerturbation = 1.f / 64;
+}
+
+PrimarySample::PrimarySample(const Kernels* kernels, unsigned seed):
+    m_random(kernels, seed),
+    m_index(0),
+    m_iteration(0),
+    m_lastLargeStep(0),
+    m_backupLastLargeStep(0),
+    m_largeStep(true)
+{
+}
+
+void PrimarySample::startIteration(bool largeStep)
+{
+    m_iteration++;
+    m_largeStep = largeStep;
+    if (largeStep) {
+        m_backupLastLargeStep = m_lastLargeStep;
+        m_lastLargeStep = m_iteration;
+    }
+    m_index = 0;
+}
+
+void PrimarySample::reject()
+{
+    for (Value& value: m_values) {
+        if (value.modified == m_iteration) {
+            value.value = value.backup;
+            value.modified = value.backupModified;
+        }
+    }
+    if (m_largeStep)
+        m_lastLargeStep = m_backupLastLargeStep;
+}
+
+void PrimarySample::generate(float* values, size_t count)
+{
+    for (size_t i = 0; i < count; i++, m_index++) {
+        // New numbers are uniform whatever the step.
+        if (m_index == m_values.size()) {
+            float value = m_random.generateUniform();
+            m_values.push_back(Value{value, value, m_iteration, m_iteration});
+        }
+        mutate(m_values[m_index]);
+        values[i] = m_values[m_index].value;
+    }
+}
+
+void PrimarySample::restart(unsigned seed)
+{
+    m_random.setSeed(seed);
+    m_values.clear();
+    m_index = 0;
+    m_iteration = 0;
+    m_lastLargeStep = 0;
+    m_backupLastLargeStep = 0;
+    m_largeStep = true;
+}
+
+void PrimarySample::setSeed(unsigned seed)
+{
+    m_random.setSeed(seed);
+}
+
+void PrimarySample::mutate(Value& value)
+{
+    if (value.modified == m_iteration)
+        return;
+
+    // Values not read since the last accepted large step are replaced, as
+    // that step would have done.
+    value.backup = value.value;
+    value.backupModified = value.modified;
+    if (m_largeStep || value.modified < m_lastLargeStep) {
+        value.value = m_random.generateUniform();
+    } else {
+        // Exponentially distributed perturbation in either direction
+        float u = m_random.generateUniform();
+        bool increase = u < .5f;
+        u = increase ? 2 * u : 2 * u - 1;
+        float delta = g_maxPerturbation * std::exp(-std::log(g_maxPerturbation / g_minPerturbation) * u);
+        value.value += increase ? delta : -delta;
+        value.value -= std::floor(value.value);
+    }
+    value.modified = m_iteration;
+}
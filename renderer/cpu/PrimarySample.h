@@ -0,0 +1,81 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_PRIMARYSAMPLE_H
+#define CPU_PRIMARYSAMPLE_H
+
+#include "Random.h"
+
+#include <stdint.h>
+#include <vector>
+
+namespace cpu
+{
+
+class Kernels;
+
+/**
+ *  A point in primary sample space, i.e. the sequence of uniform random
+ *  numbers that a path was generated from, after Kelemen et al. Random reads
+ *  the numbers in order when it replays the sample. Each iteration proposes
+ *  a mutation of the numbers, which is then accepted or rejected. The numbers
+ *  are mutated lazily when they are read, so paths only pay for the numbers
+ *  they use.
+ */
+class PrimarySample: public NonCopyable
+{
+public:
+    PrimarySample(const Kernels* kernels, unsigned seed);
+
+    /**
+     *  Starts a new iteration from the first number. A large step replaces
+     *  every number with a new one, and a small step perturbs them slightly.
+     *  The mutated numbers are kept unless the iteration is rejected.
+     */
+    void startIteration(bool largeStep);
+
+    /**
+     *  Restores the numbers the current iteration mutated.
+     */
+    void reject();
+
+    /**
+     *  Stores the next |count| numbers of the current iteration in |values|.
+     */
+    void generate(float* values, size_t count);
+
+    /**
+     *  Forgets all numbers and seeds the generator of the numbers with
+     *  |seed|, so that the next iteration replays the first iteration of a
+     *  sample created with the same seed.
+     */
+    void restart(unsigned seed);
+
+    /**
+     *  Reseeds the generator of the numbers, keeping the current ones.
+     */
+    void setSeed(unsigned seed);
+
+private:
+    class Value
+    {
+    public:
+        float value;
+        float backup;
+        // Iterations in which the value was last mutated.
+        int64_t modified;
+        int64_t backupModified;
+    };
+
+    void mutate(Value& value);
+
+    Random m_random;
+    std::vector<Value> m_values;
+    size_t m_index;
+    int64_t m_iteration;
+    int64_t m_lastLargeStep;
+    int64_t m_backupLastLargeStep;
+    bool m_largeStep;
+};
+
+}
+
+#endif
@@ -0,0 +1,159 @@
+// Copyright (C) 2013 Sami Kyöstilä
+
+#include "RadianceCache.h"
+#include "Random.h"
+#include "SurfacePoint.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace cpu;
+
+namespace
+{
+// Number of cells in the table, which must be a power of two.
+const size_t g_cellCount = 1 << 20;
+
+// A cell is searched for in this many consecutive slots of the table. Samples
+// of cells that find no slot are dropped.
+const size_t g_maxProbes = 8;
+
+// Cells are about this fraction of their distance from the camera wide,
+// rounded down to a power of two.
+const float g_relativeCellSize = 1.f / 32;
+
+// Lookups miss cells with fewer samples, whose average is still too noisy.
+const uint32_t g_minSamples = 8;
+
+// Fraction of the lookups that miss on purpose, so that the cells keep
+// improving after they have enough samples.
+const float g_refreshProbability = 1.f / 16;
+
+void addAtomic(std::atomic<float>& sum, float value)
+{
+    float current = sum.load(std::memory_order_relaxed);
+    while (!sum.compare_exchange_weak(current, current + value, std::memory_order_relaxed))
+        ;
+}
+
+uint64_t mix(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+int cellLevel(float distance)
+{
+    return std::ilogb(std::max(distance * g_relativeCellSize, 1e-6f));
+}
+}
+
+RadianceCache::RadianceCache(const glm::vec3& cameraPosition):
+    m_cameraPosition(cameraPosition),
+    m_cells(new Cell[g_cellCount]),
+    m_cellCount(0)
+{
+    for (size_t i = 0; i < g_cellCount; i++) {
+        m_cells[i].key.store(0, std::memory_order_relaxed);
+        m_cells[i].samples.store(0, std::memory_order_relaxed);
+        for (int j = 0; j < 3; j++)
+            m_cells[i].sums[j].store(0, std::memory_order_relaxed);
+    }
+}
+
+RadianceCache::~RadianceCache()
+{
+}
+
+uint64_t RadianceCache::cellKey(const glm::vec3& position, const glm::vec3& normal, int level) const
+{
+    // The coordinates are relative to the camera, so they stay within a few
+    // hundred cells of the origin and fit in 16 bits each.
+    glm::ivec3 cell(glm::floor((position - m_cameraPosition) * ldexpf(1, -level)));
+    glm::vec3 size = glm::abs(normal);
+    int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+    int face = 2 * axis + (normal[axis] < 0);
+    return (uint64_t(cell.x & 0xffff)) |
+           (uint64_t(cell.y & 0xffff) << 16) |
+           (uint64_t(cell.z & 0xffff) << 32) |
+           (uint64_t(face) << 48) |
+           (uint64_t(level & 0x7f) << 51);
+}
+
+RadianceCache::Cell* RadianceCache::insert(uint64_t key)
+{
+    uint64_t stored = key + 1;
+    size_t index = mix(key);
+    for (size_t i = 0; i < g_maxProbes; i++) {
+        Cell& cell = m_cells[(index + i) & (g_cellCount - 1)];
+        uint64_t current = cell.key.load(std::memory_order_relaxed);
+        if (!current && cell.key.compare_exchange_strong(current, stored, std::memory_order_relaxed)) {
+            m_cellCount.fetch_add(1, std::memory_order_relaxed);
+            return &cell;
+        }
+        if (current == stored)
+            return &cell;
+    }
+    return nullptr;
+}
+
+const RadianceCache::Cell* RadianceCache::find(uint64_t key) const
+{
+    uint64_t stored = key + 1;
+    size_t index = mix(key);
+    for (size_t i = 0; i < g_maxProbes; i++) {
+        const Cell& cell = m_cells[(index + i) & (g_cellCount - 1)];
+        uint64_t current = cell.key.load(std::memory_order_relaxed);
+        if (current == stored)
+            return &cell;
+        if (!current)
+            break;
+    }
+    return nullptr;
+}
+
+void RadianceCache::record(const SurfacePoint& surfacePoint, const glm::vec3& radiance)
+{
+    int level = cellLevel(glm::length(surfacePoint.position - m_cameraPosition));
+    Cell* cell = insert(cellKey(surfacePoint.position, surfacePoint.normal, level));
+    if (!cell)
+        return;
+    for (int i = 0; i < 3; i++)
+        addAtomic(cell->sums[i], radiance[i]);
+    cell->samples.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool RadianceCache::lookup(const SurfacePoint& surfacePoint, Random& random, glm::vec3& radiance) const
+{
+    if (random.generateUniform() < g_refreshProbability)
+        return false;
+
+    int level = cellLevel(glm::length(surfacePoint.position - m_cameraPosition));
+    float size = ldexpf(1, level);
+    glm::vec3 position = surfacePoint.position +
+                         surfacePoint.tangent * ((random.generateUniform() - .5f) * size) +
+                         surfacePoint.binormal * ((random.generateUniform() - .5f) * size);
+    const Cell* cell = find(cellKey(position, surfacePoint.normal, level));
+    if (!cell)
+        return false;
+
+    // The sums and the sample count are updated separately, so a sample
+    // being recorded may be missing from some of them, which is harmless.
+    uint32_t samples = cell->samples.load(std::memory_order_relaxed);
+    if (samples < g_minSamples)
+        return false;
+    for (int i = 0; i < 3; i++)
+        radiance[i] = cell->sums[i].load(std::memory_order_relaxed) / samples;
+    return true;
+}
+
+size_t RadianceCache::cellCount() const
+{
+    return m_cellCount.load(std::memory_order_relaxed);
+}
+
+size_t RadianceCache::bytes() const
+{
+    return g_cellCount * sizeof(Cell);
+}
@@ -0,0 +1,79 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_RADIANCECACHE_H
+#define CPU_RADIANCECACHE_H
+
+#include <atomic>
+#include <glm/glm.hpp>
+#include <memory>
+#include <stdint.h>
+
+namespace cpu
+{
+
+class Random;
+class SurfacePoint;
+
+/**
+ *  Light reflected by diffuse surfaces, averaged over the cells of a hashed
+ *  world-space grid, after Binder et al., "Fast Path Space Filtering by
+ *  Jittered Spatial Hashing". The cells grow with the distance from the
+ *  camera, so that they cover about the same part of the image everywhere,
+ *  and surfaces facing different ways do not share cells. The light is
+ *  stored per unit of albedo, which lets surfaces of different colors share
+ *  a cell. Samples may be recorded and looked up by several threads at once.
+ */
+class RadianceCache
+{
+public:
+    explicit RadianceCache(const glm::vec3& cameraPosition);
+    ~RadianceCache();
+
+    /**
+     *  Adds |radiance|, the light reflected by |surfacePoint| per unit of
+     *  albedo, to the cell of the point.
+     */
+    void record(const SurfacePoint& surfacePoint, const glm::vec3& radiance);
+
+    /**
+     *  Sets |radiance| to the average light per unit of albedo in a cell
+     *  near |surfacePoint|, which is jittered by up to half a cell along
+     *  the surface to hide the cell edges. Returns false if the cell has
+     *  too few samples, and sometimes on purpose, so that the cells keep
+     *  learning from the paths that go on.
+     */
+    bool lookup(const SurfacePoint& surfacePoint, Random& random, glm::vec3& radiance) const;
+
+    size_t cellCount() const;
+    size_t bytes() const;
+
+private:
+    class Cell
+    {
+    public:
+        // The key of the cell plus one, or zero if the cell is free.
+        std::atomic<uint64_t> key;
+        std::atomic<uint32_t> samples;
+        std::atomic<float> sums[3];
+    };
+
+    /**
+     *  Returns the key of the cell containing |position| on a surface
+     *  facing |normal|, in the grid whose cells are 2^|level| wide.
+     */
+    uint64_t cellKey(const glm::vec3& position, const glm::vec3& normal, int level) const;
+
+    /**
+     *  Returns the cell of |key|, which is claimed if it does not exist
+     *  yet, or null if the table has no room for it.
+     */
+    Cell* insert(uint64_t key);
+    const Cell* find(uint64_t key) const;
+
+    glm::vec3 m_cameraPosition;
+    std::unique_ptr<Cell[]> m_cells;
+    std::atomic<size_t> m_cellCount;
+};
+
+}
+
+#endif
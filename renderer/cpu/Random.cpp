@@ -1,67 +1,91 @@
 // Copyright (C) 2012 Sami Kystil
 
+#include "FastMath.h"
+#include "PrimarySample.h"
 #include "Random.h"
 #include <algorithm>
 
 using namespace cpu;
 
-Random::Random(unsigned seed)
+Random::Random(const Kernels* kernels, unsigned seed):
+    m_kernels(kernels),
+    m_primarySample(0)
 {
     setSeed(seed);
 }
 
 void Random::setSeed(unsigned seed)
 {
-#if defined(USE_SSE2)
-    m_state = _mm_set1_epi16(seed);
-#else
-    m_high = seed;
-    m_low = seed ^ 0x49616E42;
-#endif
+    // Seed each stream with SplitMix64, which never leaves a stream with an
+    // all zero state.
+    uint64_t x = seed;
+    for (int lane = 0; lane < RandomState::lanes; lane++)
+    {
+        for (int word = 0; word < 4; word += 2)
+        {
+            x += 0x9e3779b97f4a7c15ull;
+            uint64_t z = x;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            z ^= z >> 31;
+            m_state.words[word][lane] = uint32_t(z);
+            m_state.words[word + 1][lane] = uint32_t(z >> 32);
+        }
+    }
+    discardBatches();
 }
 
-#if defined(USE_SSE2)
-static const __m128 g_invScale = _mm_set1_ps(1.0f / 0x7fffffff);
-#endif
+void Random::setPrimarySample(PrimarySample* sample)
+{
+    m_primarySample = sample;
+    discardBatches();
+}
+
+void Random::discardBatches()
+{
+    m_uniformIndex = uniformBatchSize;
+    m_cosineHemisphericalIndex = DirectionBatch::size;
+    m_phongIndex = DirectionBatch::size;
+    m_phongExponent = 0;
+}
+
+void Random::generateUniforms(float* values, size_t count)
+{
+    if (m_primarySample)
+        m_primarySample->generate(values, count);
+    else
+        m_kernels->generateUniform(m_state, values, count);
+}
+
+void Random::generateUniformBatch()
+{
+    generateUniforms(m_uniforms, uniformBatchSize);
+    m_uniformIndex = 0;
+}
 
 glm::vec4 Random::generate()
 {
-    glm::vec4 result __attribute__((aligned(16)));
-#if defined(USE_SSE2)
-    __m128i tmp1, tmp2;
-    __m128 res;
-
-    // Shuffle and add
-    tmp1 = _mm_shufflelo_epi16(m_state, 0x1e);
-    tmp2 = _mm_shufflehi_epi16(m_state, 0x1e);
-    tmp1 = _mm_unpackhi_epi64(tmp1, tmp2);
-    m_state = _mm_add_epi64(m_state, tmp1);
-
-    // Convert result to floating point
-    res = _mm_cvtepi32_ps(m_state);
-    *reinterpret_cast<__m128*>(&result) = _mm_mul_ps(res, g_invScale);
-#else
-    for (int i = 0; i < 4; i++)
-    {
-        m_high = (m_high << 16) + (m_high >> 16);
-        m_high += m_low;
-        m_low += m_high;
-        result[i] = static_cast<int32_t>(m_high) / float(0x7fffffff);
-    }
-#endif
-    return result;
+    // Discard the end of the batch if it does not hold a whole vector.
+    if (m_uniformIndex > uniformBatchSize - 4)
+        generateUniformBatch();
+    const float* uniforms = &m_uniforms[m_uniformIndex];
+    m_uniformIndex += 4;
+    return glm::vec4(uniforms[0], uniforms[1], uniforms[2], uniforms[3]) * 2.f - glm::vec4(1);
 }
 
 RandomValue<glm::vec3> Random::generateSpherical()
 {
-    glm::vec4 sample = generate();
-    sample.y = (sample.y + 1) * M_PI;
-    float r = sqrtf(1 - sample.x * sample.x);
+    float z = generateUniform() * 2 - 1;
+    float phi = generateUniform() * 2 * M_PI;
+    float r = sqrtf(1 - z * z);
+
+    float sine, cosine;
+    fastSinCos(phi, sine, cosine);
 
     glm::vec3 result;
-    result.x = r * cosf(sample.y);
-    result.y = r * sinf(sample.y);
-    result.z = sample.x;
+    result.x = r * cosine;
+    result.y = r * sine;
+    result.z = z;
     return RandomValue<glm::vec3>(result, 1 / (4 * M_PI));
 }
 
@@ -76,41 +100,43 @@ RandomValue<glm::vec3> Random::generateHemispherical(const glm::vec3& normal)
 
 RandomValue<glm::vec3> Random::generateCosineHemispherical()
 {
-    glm::vec4 sample = generate();
-    float u = .5f * sample.x + .5f;
-    float v = .5f * sample.y + .5f;
-    float r = sqrtf(u);
-    float phi = v * 2 * M_PI;
-    float x = r * cosf(phi);
-    float y = r * sinf(phi);
-    float z = sqrtf(std::max(0.f, 1.f - u));
-    return RandomValue<glm::vec3>(glm::vec3(x, y, z), z * M_1_PI);
+    if (m_cosineHemisphericalIndex == DirectionBatch::size)
+    {
+        alignas(64) float uniforms[2 * DirectionBatch::size];
+        generateUniforms(uniforms, 2 * DirectionBatch::size);
+        m_kernels->sampleCosineHemisphere(uniforms, m_cosineHemispherical);
+        m_cosineHemisphericalIndex = 0;
+    }
+    const DirectionBatch& batch = m_cosineHemispherical;
+    int i = m_cosineHemisphericalIndex++;
+    return RandomValue<glm::vec3>(glm::vec3(batch.x[i], batch.y[i], batch.z[i]), batch.probability[i]);
 }
 
 RandomValue<glm::vec3> Random::generatePhong(float exponent)
 {
-    glm::vec4 sample = generate();
-    float u = .5f * sample.x + .5f;
-    float v = .5f * sample.y + .5f;
-    float a = acosf(powf(u, 1.f / (exponent + 1)));
-    float phi = 2 * M_PI * v;
-
-    glm::vec3 result = glm::vec3(sinf(a) * cosf(phi),
-                                 sinf(a) * sinf(phi),
-                                 cosf(a));
-    return RandomValue<glm::vec3>(result, (exponent + 1) / (2 * M_PI) * powf(cosf(a), exponent));
+    if (m_phongIndex == DirectionBatch::size || m_phongExponent != exponent)
+    {
+        alignas(64) float uniforms[2 * DirectionBatch::size];
+        generateUniforms(uniforms, 2 * DirectionBatch::size);
+        m_kernels->samplePhong(uniforms, exponent, m_phong);
+        m_phongExponent = exponent;
+        m_phongIndex = 0;
+    }
+    const DirectionBatch& batch = m_phong;
+    int i = m_phongIndex++;
+    return RandomValue<glm::vec3>(glm::vec3(batch.x[i], batch.y[i], batch.z[i]), batch.probability[i]);
 }
 
 RandomValue<bool> Random::russianRoulette(const glm::vec4& probability)
 {
     // Note: w component ignored
     float p = std::max(probability.x, std::max(probability.y, probability.z));
-    return flipCoin(p);
+    return flipCoin(std::min(p, 1.f));
 }
 
 RandomValue<bool> Random::flipCoin(float probability)
 {
-    float r = generate().x * .5f + .5f;
+    float r = generateUniform();
     if (probability && r <= probability)
         return RandomValue<bool>(true, probability);
     return RandomValue<bool>(false, 1 - probability);
@@ -4,16 +4,13 @@
 
 #include <glm/glm.hpp>
 #include "renderer/Util.h"
-
-#if defined(USE_SSE2)
-#    include <pmmintrin.h>
-#else
-#    include <stdint.h>
-#endif
+#include "Kernels.h"
 
 namespace cpu
 {
 
+class PrimarySample;
+
 template <typename T>
 struct RandomValue
 {
@@ -36,14 +33,32 @@ struct RandomValue
     float probability;
 };
 
-// TODO: Use alignas(__m128i) once the compilers support it
+/**
+ *  Random number generator for one thread. The numbers and the hemisphere and
+ *  Phong samples are generated in batches with the vectorized kernels and
+ *  handed out one at a time.
+ */
 class Random: public NonCopyable
 {
 public:
-    Random(unsigned seed = 0715517);
+    static const int uniformBatchSize = 64;
+
+    explicit Random(const Kernels* kernels, unsigned seed = 0715517);
 
     void setSeed(unsigned seed);
 
+    /**
+     *  Draws the numbers from |sample| instead of the generator, which makes
+     *  the sequence replayable. Discards the numbers generated so far. Null
+     *  switches back to the generator.
+     */
+    void setPrimarySample(PrimarySample* sample);
+
+    /**
+     *  Generates a random number with uniform distribution [0..1)
+     */
+    float generateUniform();
+
     /**
      *  Generates a vector of random numbers with approximately uniform
      *  distribution [-1..1]
@@ -59,13 +74,33 @@ public:
     RandomValue<bool> russianRoulette(const glm::vec4& probability);
 
 private:
-#if defined(USE_SSE2)
-    __m128i m_state;
-#else
-    uint32_t m_high;
-    uint32_t m_low;
-#endif
-} __attribute__((aligned(16)));
+    void generateUniformBatch();
+    void generateUniforms(float* values, size_t count);
+    void discardBatches();
+
+    const Kernels* m_kernels;
+    RandomState m_state;
+    PrimarySample* m_primarySample;
+
+    alignas(64) float m_uniforms[uniformBatchSize];
+    int m_uniformIndex;
+
+    DirectionBatch m_cosineHemispherical;
+    int m_cosineHemisphericalIndex;
+
+    // Phong samples depend on the exponent, so a different exponent discards
+    // the rest of the batch.
+    DirectionBatch m_phong;
+    float m_phongExponent;
+    int m_phongIndex;
+};
+
+inline float Random::generateUniform()
+{
+    if (m_uniformIndex == uniformBatchSize)
+        generateUniformBatch();
+    return m_uniforms[m_uniformIndex++];
+}
 
 }
 
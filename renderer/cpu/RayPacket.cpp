@@ -0,0 +1,30 @@
+// Copyright (C) 2013 Sami Kyöstilä
+
+#include "RayPacket.h"
+
+using namespace cpu;
+
+RayPacket::RayPacket():
+    size(0)
+{
+}
+
+bool RayPacket::coherent() const
+{
+    if (!size)
+        return false;
+
+    const Ray& first = rays[0];
+    for (int i = 1; i < size; i++)
+    {
+        const Ray& ray = rays[i];
+        if (ray.origin != first.origin)
+            return false;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if ((ray.direction[axis] < 0) != (first.direction[axis] < 0))
+                return false;
+        }
+    }
+    return true;
+}
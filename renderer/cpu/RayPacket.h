@@ -0,0 +1,35 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_RAYPACKET_H
+#define CPU_RAYPACKET_H
+
+#include "Ray.h"
+
+namespace cpu
+{
+
+/**
+ *  Rays from a common origin that are traced together, such as camera rays
+ *  through a tile of neighbouring pixels. Coherent packets share their
+ *  hierarchy traversal, which tests whole nodes against the frustum bounding
+ *  all the rays at once.
+ */
+class RayPacket
+{
+public:
+    static const int maxSize = 16;
+
+    RayPacket();
+
+    /**
+     *  Returns true if the rays share their origin and the signs of their
+     *  direction components, which the frustum tests rely on.
+     */
+    bool coherent() const;
+
+    Ray rays[maxSize];
+    int size;
+};
+
+}
+
+#endif
@@ -2,8 +2,10 @@
 
 #include "renderer/Util.h"
 #include "scene/Scene.h"
+#include "Kernels.h"
 #include "Raytracer.h"
 #include "Ray.h"
+#include "RayPacket.h"
 #include "SurfacePoint.h"
 
 #include <algorithm>
@@ -13,12 +15,221 @@
 
 using namespace cpu;
 
-Raytracer::Raytracer(Scene* scene):
-    m_scene(scene)
+namespace
+{
+
+// Returns an arbitrary unit vector perpendicular to |normal|.
+inline glm::vec3 tangentFor(const glm::vec3& normal)
+{
+#if 1
+    glm::vec3 tangent;
+    float smallest = std::min(normal.z, std::min(normal.x, normal.y));
+    if (normal.x == smallest)
+        tangent = glm::vec3(0, -normal.z, normal.y);
+    else if (normal.y == smallest)
+        tangent = glm::vec3(-normal.z, 0, normal.x);
+    else
+        tangent = glm::vec3(-normal.y, normal.x, 0);
+    return glm::normalize(tangent);
+#else
+    return glm::cross(normal, glm::vec3(0.f, 1.f, 0.f));
+#endif
+}
+
+// Returns |ray| in the local space of |transform|. The direction is not
+// renormalized, so distances along the local ray equal those along |ray|.
+inline Ray transformed(const Ray& ray, const Transform&, TransformTag<TransformClass::Identity>)
+{
+    return ray;
+}
+
+inline Ray transformed(const Ray& ray, const Transform& transform, TransformTag<TransformClass::Translation>)
+{
+    Ray localRay = ray;
+    localRay.origin = ray.origin - glm::vec3(transform.matrix[3]);
+    return localRay;
+}
+
+template <TransformClass Class>
+inline Ray transformed(const Ray& ray, const Transform& transform, TransformTag<Class>)
+{
+    Ray localRay = ray;
+    localRay.direction = glm::mat3(transform.invMatrix) * ray.direction;
+    localRay.origin = ((transform.invMatrix * glm::vec4(ray.origin, 1.f))).xyz();
+    return localRay;
+}
+
+// Returns the unit world space normal for the local space |normal|.
+inline glm::vec3 worldNormal(const glm::vec3& normal, const Transform&, TransformTag<TransformClass::Identity>)
+{
+    return glm::normalize(normal);
+}
+
+inline glm::vec3 worldNormal(const glm::vec3& normal, const Transform&, TransformTag<TransformClass::Translation>)
+{
+    return glm::normalize(normal);
+}
+
+template <TransformClass Class>
+inline glm::vec3 worldNormal(const glm::vec3& normal, const Transform& transform, TransformTag<Class>)
+{
+    return glm::normalize(glm::transpose(glm::mat3(transform.invMatrix)) * normal);
+}
+
+// Returns the world space direction of the local space unit |tangent|.
+inline glm::vec3 worldTangent(const glm::vec3& tangent, const Transform&, TransformTag<TransformClass::Identity>)
+{
+    return tangent;
+}
+
+inline glm::vec3 worldTangent(const glm::vec3& tangent, const Transform&, TransformTag<TransformClass::Translation>)
+{
+    return tangent;
+}
+
+template <TransformClass Class>
+inline glm::vec3 worldTangent(const glm::vec3& tangent, const Transform& transform, TransformTag<Class>)
+{
+    return glm::normalize(glm::mat3(transform.matrix) * tangent);
+}
+
+/**
+ *  Ray prepared for the watertight ray/triangle test of Woop, Benthin and
+ *  Wald. The triangle is sheared into a space where the ray points along +z,
+ *  which makes the edge tests consistent for triangles sharing an edge.
+ */
+class WatertightRay
+{
+public:
+    WatertightRay()
+    {
+    }
+
+    explicit WatertightRay(const Ray& ray):
+        origin(ray.origin)
+    {
+        glm::vec3 d = glm::abs(ray.direction);
+        kz = (d.x > d.y) ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+        kx = (kz + 1) % 3;
+        ky = (kx + 1) % 3;
+        // Preserve the winding of the triangles.
+        if (ray.direction[kz] < 0)
+            std::swap(kx, ky);
+        shear = glm::vec3(ray.direction[kx] / ray.direction[kz],
+                          ray.direction[ky] / ray.direction[kz],
+                          1.f / ray.direction[kz]);
+    }
+
+    bool intersect(const scene::Triangle& triangle, float minDistance, float maxDistance,
+                   float& distance) const
+    {
+        glm::vec3 a = triangle.v0 - origin;
+        glm::vec3 b = triangle.v1 - origin;
+        glm::vec3 c = triangle.v2 - origin;
+        float ax = a[kx] - shear.x * a[kz];
+        float ay = a[ky] - shear.y * a[kz];
+        float bx = b[kx] - shear.x * b[kz];
+        float by = b[ky] - shear.y * b[kz];
+        float cx = c[kx] - shear.x * c[kz];
+        float cy = c[ky] - shear.y * c[kz];
+
+        float u = cx * by - cy * bx;
+        float v = ax * cy - ay * cx;
+        float w = bx * ay - by * ax;
+
+        // Redo the edge tests in double precision when the ray passes
+        // exactly through an edge or a vertex.
+        if (u == 0 || v == 0 || w == 0)
+        {
+            u = float(double(cx) * double(by) - double(cy) * double(bx));
+            v = float(double(ax) * double(cy) - double(ay) * double(cx));
+            w = float(double(bx) * double(ay) - double(by) * double(ax));
+        }
+
+        if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
+            return false;
+
+        float determinant = u + v + w;
+        if (determinant == 0)
+            return false;
+
+        float t = (u * shear.z * a[kz] + v * shear.z * b[kz] + w * shear.z * c[kz]) / determinant;
+        if (t < minDistance || t > maxDistance)
+            return false;
+        distance = t;
+        return true;
+    }
+
+private:
+    glm::vec3 origin;
+    glm::vec3 shear;
+    int kx;
+    int ky;
+    int kz;
+};
+
+}
+
+Raytracer::Raytracer(Scene* scene, const Kernels* kernels):
+    m_scene(scene),
+    m_kernels(kernels)
 {
 }
 
 void Raytracer::intersect(Ray& ray, SurfacePoint& surfacePoint, const Sphere& sphere) const
+{
+    // The world space test covers every class up to similarity, since the
+    // center and radius are precomputed.
+    if (sphere.transform.transformClass == TransformClass::General)
+        intersect(ray, surfacePoint, sphere, TransformTag<TransformClass::General>());
+    else
+        intersect(ray, surfacePoint, sphere, TransformTag<TransformClass::Similarity>());
+}
+
+template <typename ObjectType, TransformClass Class>
+void Raytracer::intersect(Ray& ray, SurfacePoint& surfacePoint, const ObjectType& object,
+                          TransformTag<Class>) const
+{
+    intersect(ray, surfacePoint, object);
+}
+
+template <TransformClass Class>
+void Raytracer::intersect(Ray& ray, SurfacePoint& surfacePoint, const Sphere& sphere,
+                          TransformTag<Class>) const
+{
+    // The transform keeps the sphere round, so it can be intersected in world
+    // space. The discriminant is computed from the distance between the ray
+    // and the center, which avoids the cancellation in |f|^2 - r^2 for small
+    // spheres far from the ray origin.
+    glm::vec3 f = ray.origin - sphere.center;
+    float r2 = sphere.worldRadius * sphere.worldRadius;
+    float a = glm::dot(ray.direction, ray.direction);
+    float b = glm::dot(f, ray.direction);
+    float c = glm::dot(f, f) - r2;
+    glm::vec3 closest = f - (b / a) * ray.direction;
+
+    float discr = a * (r2 - glm::dot(closest, closest));
+    if (discr < 0)
+        return;
+
+    float q = b < 0 ? sqrtf(discr) - b : -sqrtf(discr) - b;
+    float t0 = q / a;
+    float t1 = c / q;
+
+    if (t0 > t1)
+        std::swap(t0, t1);
+
+    if (t1 < 0)
+        return;
+
+    if (t0 < 0)
+        t0 = t1;
+
+    processIntersection(ray, surfacePoint, t0, sphere);
+}
+
+void Raytracer::intersect(Ray& ray, SurfacePoint& surfacePoint, const Sphere& sphere,
+                          TransformTag<TransformClass::General>) const
 {
     // From http://wiki.cgsociety.org/index.php/Ray_Sphere_Intersection
     glm::vec3 dir = glm::mat3(sphere.transform.invMatrix) * ray.direction;
@@ -52,49 +263,29 @@ void Raytracer::intersect(Ray& ray, SurfacePoint& surfacePoint, const Sphere& sp
     glm::vec3 normal = origin + dir * t0;
     normal = glm::normalize(glm::mat3(sphere.transform.matrix) * normal);
     intptr_t objectId = reinterpret_cast<intptr_t>(&sphere);
-#if 1
-    glm::vec3 tangent;
-    float smallest = std::min(normal.z, std::min(normal.x, normal.y));
-    if (normal.x == smallest)
-        tangent = glm::vec3(0, -normal.z, normal.y);
-    else if (normal.y == smallest)
-        tangent = glm::vec3(-normal.z, 0, normal.x);
-    else
-        tangent = glm::vec3(-normal.y, normal.x, 0);
-    tangent = glm::normalize(tangent);
-#else
-    glm::vec3 tangent = glm::cross(normal, glm::vec3(0.f, 1.f, 0.f));
-#endif
+    glm::vec3 tangent = tangentFor(normal);
     glm::vec3 binormal = glm::cross(normal, tangent);
 
-    processIntersection(ray, surfacePoint, t0 * sphere.transform.determinant, objectId, normal,
+    processIntersection(ray, surfacePoint, t0, objectId, normal,
                         tangent, binormal, &sphere.material);
 }
 
 void Raytracer::intersect(Ray& ray, SurfacePoint& surfacePoint, const Plane& plane) const
 {
-    glm::vec3 dir = glm::mat3(plane.transform.invMatrix) * ray.direction;
-    glm::vec3 origin = ((plane.transform.invMatrix * glm::vec4(ray.origin, 1.f))).xyz();
-    glm::vec3 normal(0, 1, 0);
-
-    float denom = glm::dot(dir, normal);
+    float denom = glm::dot(plane.planeNormal, ray.direction);
 
     if (fabs(denom) < std::numeric_limits<float>::epsilon())
         return;
 
-    float t = -glm::dot(origin, normal) / denom;
+    float t = (plane.planeDistance - glm::dot(plane.planeNormal, ray.origin)) / denom;
 
     if (t < 0)
         return;
 
-    normal = glm::mat3(plane.transform.matrix) * -normal;
-    glm::vec3 tangent = glm::mat3(plane.transform.matrix) * glm::vec3(1, 0, 0);
-    glm::vec3 binormal = glm::cross(normal, tangent);
-
     intptr_t objectId = reinterpret_cast<intptr_t>(&plane);
 
-    processIntersection(ray, surfacePoint, t * plane.transform.determinant, objectId, normal,
-                        tangent, binormal, &plane.material);
+    processIntersection(ray, surfacePoint, t, objectId, plane.normal,
+                        plane.tangent, plane.binormal, &plane.material);
 }
 
 template <typename ObjectType>
@@ -105,6 +296,342 @@ void Raytracer::intersectAll(const std::vector<ObjectType>& objects,
         intersect(ray, surfacePoint, object);
 }
 
+
+template <TransformClass Class, typename ObjectType>
+void Raytracer::intersectBVH(const WideBVH& bvh, const std::vector<ObjectType>& objects,
+                             Ray& ray, SurfacePoint& surfacePoint) const
+{
+    const uint32_t* indices = bvh.indices();
+    bvh.traverse(ray, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++)
+            intersect(ray, surfacePoint, objects[indices[i]], TransformTag<Class>());
+        return false;
+    });
+}
+
+template <TransformClass Class, typename ObjectType>
+void Raytracer::intersectBVH(const WideBVH& bvh, const std::vector<ObjectType>& objects,
+                             RayPacket& packet, SurfacePoint* surfacePoints) const
+{
+    const uint32_t* indices = bvh.indices();
+    bvh.traverse(packet, [&](uint32_t first, uint32_t count, uint32_t rays) {
+        for (; rays; rays &= rays - 1)
+        {
+            int j = __builtin_ctz(rays);
+            for (uint32_t i = first; i < first + count; i++)
+                intersect(packet.rays[j], surfacePoints[j], objects[indices[i]], TransformTag<Class>());
+        }
+        return false;
+    });
+}
+
+void Raytracer::intersectSpheres(const WideBVH& bvh, const std::vector<Sphere>& spheres,
+                                 RayPacket& packet, SurfacePoint* surfacePoints) const
+{
+    // Intersect each sphere with all the rays at once and only keep the hits
+    // of the rays that reached the leaf.
+    PacketDirections directions(packet);
+    const glm::vec3& origin = packet.rays[0].origin;
+    const uint32_t* indices = bvh.indices();
+    bvh.traverse(packet, [&](uint32_t first, uint32_t count, uint32_t rays) {
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            const Sphere& sphere = spheres[indices[i]];
+            glm::vec3 offset = origin - sphere.center;
+            float distances[RayPacket::maxSize];
+            m_kernels->intersectSphere(directions, &offset.x, sphere.worldRadius, distances);
+            for (uint32_t hits = rays; hits; hits &= hits - 1)
+            {
+                int j = __builtin_ctz(hits);
+                if (distances[j] != HUGE_VALF)
+                    processIntersection(packet.rays[j], surfacePoints[j], distances[j], sphere);
+            }
+        }
+        return false;
+    });
+}
+
+template <TransformClass Class, typename ObjectType>
+bool Raytracer::occludedBy(const WideBVH& bvh, const std::vector<ObjectType>& objects,
+                           const Ray& ray, intptr_t ignoredId) const
+{
+    const uint32_t* indices = bvh.indices();
+    bool occluded = false;
+    bvh.traverse(ray, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count && !occluded; i++)
+            occluded = occludedBy(ray, objects[indices[i]], ignoredId, TransformTag<Class>());
+        return occluded;
+    });
+    return occluded;
+}
+
+template <typename ObjectType, TransformClass Class>
+bool Raytracer::occludedBy(const Ray& ray, const ObjectType& object, intptr_t ignoredId,
+                           TransformTag<Class> tag) const
+{
+    Ray objectRay = ray;
+    SurfacePoint surfacePoint;
+    intersect(objectRay, surfacePoint, object, tag);
+    return surfacePoint.valid() && surfacePoint.objectId != ignoredId;
+}
+
+bool Raytracer::occludedBy(const Ray& ray, const Mesh& mesh, intptr_t ignoredId) const
+{
+    switch (mesh.transform.transformClass)
+    {
+    case TransformClass::Identity:
+        return occludedBy(ray, mesh, ignoredId, TransformTag<TransformClass::Identity>());
+    case TransformClass::Translation:
+        return occludedBy(ray, mesh, ignoredId, TransformTag<TransformClass::Translation>());
+    case TransformClass::Similarity:
+        return occludedBy(ray, mesh, ignoredId, TransformTag<TransformClass::Similarity>());
+    case TransformClass::General:
+        break;
+    }
+    return occludedBy(ray, mesh, ignoredId, TransformTag<TransformClass::General>());
+}
+
+template <TransformClass Class>
+bool Raytracer::occludedBy(const Ray& ray, const Mesh& mesh, intptr_t, TransformTag<Class> tag) const
+{
+    Ray localRay = transformed(ray, mesh.transform, tag);
+    WatertightRay watertightRay(localRay);
+    const scene::Triangle* triangles = mesh.data->triangles();
+    bool occluded = false;
+    mesh.bvh.traverse(localRay, [&](uint32_t first, uint32_t count) {
+        float t;
+        for (uint32_t i = first; i < first + count && !occluded; i++)
+            occluded = watertightRay.intersect(triangles[i], localRay.minDistance, localRay.maxDistance, t);
+        return occluded;
+    });
+    return occluded;
+}
+
+bool Raytracer::occludedBy(const Ray& ray, const Instance& instance, intptr_t ignoredId) const
+{
+    switch (instance.transform.transformClass)
+    {
+    case TransformClass::Identity:
+        return occludedBy(ray, instance, ignoredId, TransformTag<TransformClass::Identity>());
+    case TransformClass::Translation:
+        return occludedBy(ray, instance, ignoredId, TransformTag<TransformClass::Translation>());
+    case TransformClass::Similarity:
+        return occludedBy(ray, instance, ignoredId, TransformTag<TransformClass::Similarity>());
+    case TransformClass::General:
+        break;
+    }
+    return occludedBy(ray, instance, ignoredId, TransformTag<TransformClass::General>());
+}
+
+template <TransformClass Class>
+bool Raytracer::occludedBy(const Ray& ray, const Instance& instance, intptr_t ignoredId,
+                           TransformTag<Class> tag) const
+{
+    Ray localRay = transformed(ray, instance.transform, tag);
+    const Prototype& prototype = *instance.prototype;
+    if (occludedBy<TransformClass::Similarity>(prototype.sphereBVH, prototype.spheres, localRay, ignoredId) ||
+        occludedBy<TransformClass::General>(prototype.generalSphereBVH, prototype.spheres, localRay, ignoredId))
+        return true;
+    for (const Mesh& mesh: prototype.meshes)
+    {
+        if (occludedBy(localRay, mesh, ignoredId))
+            return true;
+    }
+    return false;
+}
+
+bool Raytracer::occludedByInstances(const Ray& ray, intptr_t ignoredId) const
+{
+    const uint32_t* indices = m_scene->instanceBVH.indices();
+    bool occluded = false;
+    m_scene->instanceBVH.traverse(ray, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count && !occluded; i++)
+            occluded = occludedBy(ray, m_scene->instances[indices[i]], ignoredId);
+        return occluded;
+    });
+    return occluded;
+}
+
+void Raytracer::intersect(Ray& ray, SurfacePoint& surfacePoint, const Mesh& mesh) const
+{
+    switch (mesh.transform.transformClass)
+    {
+    case TransformClass::Identity:
+        intersect(ray, surfacePoint, mesh, TransformTag<TransformClass::Identity>());
+        break;
+    case TransformClass::Translation:
+        intersect(ray, surfacePoint, mesh, TransformTag<TransformClass::Translation>());
+        break;
+    case TransformClass::Similarity:
+        intersect(ray, surfacePoint, mesh, TransformTag<TransformClass::Similarity>());
+        break;
+    case TransformClass::General:
+        intersect(ray, surfacePoint, mesh, TransformTag<TransformClass::General>());
+        break;
+    }
+}
+
+template <TransformClass Class>
+void Raytracer::intersect(Ray& ray, SurfacePoint& surfacePoint, const Mesh& mesh, TransformTag<Class> tag) const
+{
+    Ray localRay = transformed(ray, mesh.transform, tag);
+    WatertightRay watertightRay(localRay);
+    const scene::Triangle* triangles = mesh.data->triangles();
+    const scene::Triangle* hit = nullptr;
+    mesh.bvh.traverse(localRay, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            float t;
+            if (watertightRay.intersect(triangles[i], localRay.minDistance, localRay.maxDistance, t))
+            {
+                localRay.maxDistance = t;
+                hit = &triangles[i];
+            }
+        }
+        return false;
+    });
+    if (hit)
+        processIntersection(ray, surfacePoint, localRay.maxDistance, mesh, *hit, tag);
+}
+
+void Raytracer::intersect(RayPacket& packet, SurfacePoint* surfacePoints, const Mesh& mesh) const
+{
+    switch (mesh.transform.transformClass)
+    {
+    case TransformClass::Identity:
+        intersect(packet, surfacePoints, mesh, TransformTag<TransformClass::Identity>());
+        break;
+    case TransformClass::Translation:
+        intersect(packet, surfacePoints, mesh, TransformTag<TransformClass::Translation>());
+        break;
+    case TransformClass::Similarity:
+        intersect(packet, surfacePoints, mesh, TransformTag<TransformClass::Similarity>());
+        break;
+    case TransformClass::General:
+        intersect(packet, surfacePoints, mesh, TransformTag<TransformClass::General>());
+        break;
+    }
+}
+
+template <TransformClass Class>
+void Raytracer::intersect(RayPacket& packet, SurfacePoint* surfacePoints, const Mesh& mesh,
+                          TransformTag<Class> tag) const
+{
+    RayPacket localPacket;
+    localPacket.size = packet.size;
+    for (int i = 0; i < packet.size; i++)
+        localPacket.rays[i] = transformed(packet.rays[i], mesh.transform, tag);
+
+    // A rotation may break the coherence of the packet.
+    if (!localPacket.coherent())
+    {
+        for (int i = 0; i < packet.size; i++)
+            intersect(packet.rays[i], surfacePoints[i], mesh, tag);
+        return;
+    }
+
+    WatertightRay watertightRays[RayPacket::maxSize];
+    const scene::Triangle* hits[RayPacket::maxSize];
+    for (int i = 0; i < packet.size; i++)
+    {
+        watertightRays[i] = WatertightRay(localPacket.rays[i]);
+        hits[i] = nullptr;
+    }
+
+    const scene::Triangle* triangles = mesh.data->triangles();
+    mesh.bvh.traverse(localPacket, [&](uint32_t first, uint32_t count, uint32_t rays) {
+        for (; rays; rays &= rays - 1)
+        {
+            int j = __builtin_ctz(rays);
+            Ray& localRay = localPacket.rays[j];
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                float t;
+                if (watertightRays[j].intersect(triangles[i], localRay.minDistance, localRay.maxDistance, t))
+                {
+                    localRay.maxDistance = t;
+                    hits[j] = &triangles[i];
+                }
+            }
+        }
+        return false;
+    });
+
+    for (int i = 0; i < packet.size; i++)
+    {
+        if (hits[i])
+            processIntersection(packet.rays[i], surfacePoints[i], localPacket.rays[i].maxDistance, mesh, *hits[i], tag);
+    }
+}
+
+void Raytracer::intersect(Ray& ray, SurfacePoint& surfacePoint, const Instance& instance) const
+{
+    switch (instance.transform.transformClass)
+    {
+    case TransformClass::Identity:
+        intersect(ray, surfacePoint, instance, TransformTag<TransformClass::Identity>());
+        break;
+    case TransformClass::Translation:
+        intersect(ray, surfacePoint, instance, TransformTag<TransformClass::Translation>());
+        break;
+    case TransformClass::Similarity:
+        intersect(ray, surfacePoint, instance, TransformTag<TransformClass::Similarity>());
+        break;
+    case TransformClass::General:
+        intersect(ray, surfacePoint, instance, TransformTag<TransformClass::General>());
+        break;
+    }
+}
+
+template <TransformClass Class>
+void Raytracer::intersect(Ray& ray, SurfacePoint& surfacePoint, const Instance& instance,
+                          TransformTag<Class> tag) const
+{
+    Ray localRay = transformed(ray, instance.transform, tag);
+    const Prototype& prototype = *instance.prototype;
+    SurfacePoint localPoint;
+    intersectBVH<TransformClass::Similarity>(prototype.sphereBVH, prototype.spheres, localRay, localPoint);
+    intersectBVH<TransformClass::General>(prototype.generalSphereBVH, prototype.spheres, localRay, localPoint);
+    intersectAll(prototype.meshes, localRay, localPoint);
+    if (!localPoint.valid())
+        return;
+
+    glm::vec3 normal = worldNormal(localPoint.normal, instance.transform, tag);
+    glm::vec3 tangent = worldTangent(localPoint.tangent, instance.transform, tag);
+    glm::vec3 binormal = glm::cross(normal, tangent);
+    intptr_t objectId = reinterpret_cast<intptr_t>(&instance);
+
+    processIntersection(ray, surfacePoint, localRay.maxDistance, objectId, normal,
+                        tangent, binormal, localPoint.material);
+}
+
+void Raytracer::intersectInstances(Ray& ray, SurfacePoint& surfacePoint) const
+{
+    const uint32_t* indices = m_scene->instanceBVH.indices();
+    m_scene->instanceBVH.traverse(ray, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++)
+            intersect(ray, surfacePoint, m_scene->instances[indices[i]]);
+        return false;
+    });
+}
+
+void Raytracer::intersectInstances(RayPacket& packet, SurfacePoint* surfacePoints) const
+{
+    const uint32_t* indices = m_scene->instanceBVH.indices();
+    m_scene->instanceBVH.traverse(packet, [&](uint32_t first, uint32_t count, uint32_t rays) {
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            const Instance& instance = m_scene->instances[indices[i]];
+            for (uint32_t hits = rays; hits; hits &= hits - 1)
+            {
+                int j = __builtin_ctz(hits);
+                intersect(packet.rays[j], surfacePoints[j], instance);
+            }
+        }
+        return false;
+    });
+}
+
 void Raytracer::processIntersection(Ray& ray, SurfacePoint& surfacePoint,
                                     float t, intptr_t objectId,
                                     const glm::vec3& normal,
@@ -123,13 +650,46 @@ void Raytracer::processIntersection(Ray& ray, SurfacePoint& surfacePoint,
     surfacePoint.material = material;
 }
 
+void Raytracer::processIntersection(Ray& ray, SurfacePoint& surfacePoint, float t,
+                                    const Sphere& sphere) const
+{
+    if (t > ray.maxDistance || t < ray.minDistance)
+        return;
+
+    glm::vec3 normal = glm::normalize(ray.origin + ray.direction * t - sphere.center);
+    glm::vec3 tangent = tangentFor(normal);
+    glm::vec3 binormal = glm::cross(normal, tangent);
+    intptr_t objectId = reinterpret_cast<intptr_t>(&sphere);
+
+    processIntersection(ray, surfacePoint, t, objectId, normal,
+                        tangent, binormal, &sphere.material);
+}
+
+template <TransformClass Class>
+void Raytracer::processIntersection(Ray& ray, SurfacePoint& surfacePoint, float t,
+                                    const Mesh& mesh, const scene::Triangle& triangle,
+                                    TransformTag<Class> tag) const
+{
+    glm::vec3 normal = glm::cross(triangle.v1 - triangle.v0, triangle.v2 - triangle.v0);
+    normal = worldNormal(normal, mesh.transform, tag);
+    glm::vec3 tangent = tangentFor(normal);
+    glm::vec3 binormal = glm::cross(normal, tangent);
+    intptr_t objectId = reinterpret_cast<intptr_t>(&mesh);
+
+    processIntersection(ray, surfacePoint, t, objectId, normal,
+                        tangent, binormal, &mesh.material);
+}
+
 SurfacePoint Raytracer::trace(Ray& ray) const
 {
     SurfacePoint surfacePoint;
     surfacePoint.view = ray.direction;
 
     intersectAll(m_scene->planes, ray, surfacePoint);
-    intersectAll(m_scene->spheres, ray, surfacePoint);
+    intersectBVH<TransformClass::Similarity>(m_scene->sphereBVH, m_scene->spheres, ray, surfacePoint);
+    intersectBVH<TransformClass::General>(m_scene->generalSphereBVH, m_scene->spheres, ray, surfacePoint);
+    intersectAll(m_scene->meshes, ray, surfacePoint);
+    intersectInstances(ray, surfacePoint);
 
     if (surfacePoint.valid())
         surfacePoint.position = ray.origin + ray.direction * ray.maxDistance;
@@ -137,8 +697,58 @@ SurfacePoint Raytracer::trace(Ray& ray) const
     return surfacePoint;
 }
 
-bool Raytracer::canReach(Ray& ray, intptr_t objectId) const
+void Raytracer::trace(RayPacket& packet, SurfacePoint* surfacePoints) const
+{
+    if (!packet.coherent())
+    {
+        for (int i = 0; i < packet.size; i++)
+            surfacePoints[i] = trace(packet.rays[i]);
+        return;
+    }
+
+    for (int i = 0; i < packet.size; i++)
+    {
+        surfacePoints[i] = SurfacePoint();
+        surfacePoints[i].view = packet.rays[i].direction;
+        intersectAll(m_scene->planes, packet.rays[i], surfacePoints[i]);
+    }
+    intersectSpheres(m_scene->sphereBVH, m_scene->spheres, packet, surfacePoints);
+    intersectBVH<TransformClass::General>(m_scene->generalSphereBVH, m_scene->spheres, packet, surfacePoints);
+    for (const Mesh& mesh: m_scene->meshes)
+        intersect(packet, surfacePoints, mesh);
+    intersectInstances(packet, surfacePoints);
+
+    for (int i = 0; i < packet.size; i++)
+    {
+        const Ray& ray = packet.rays[i];
+        if (surfacePoints[i].valid())
+            surfacePoints[i].position = ray.origin + ray.direction * ray.maxDistance;
+    }
+}
+
+bool Raytracer::occluded(const Ray& ray, intptr_t ignoredId) const
+{
+    for (const Plane& plane: m_scene->planes)
+    {
+        if (occludedBy(ray, plane, ignoredId, TransformTag<TransformClass::General>()))
+            return true;
+    }
+    if (occludedBy<TransformClass::Similarity>(m_scene->sphereBVH, m_scene->spheres, ray, ignoredId) ||
+        occludedBy<TransformClass::General>(m_scene->generalSphereBVH, m_scene->spheres, ray, ignoredId))
+        return true;
+    for (const Mesh& mesh: m_scene->meshes)
+    {
+        if (occludedBy(ray, mesh, ignoredId))
+            return true;
+    }
+    return occludedByInstances(ray, ignoredId);
+}
+
+bool Raytracer::canReach(Ray& ray, const Sphere& light) const
 {
-    SurfacePoint result = trace(ray);
-    return result.valid() && result.objectId == objectId;
+    // Find the light first and then look for anything in front of it, which
+    // can stop at the first hit instead of searching for the closest one.
+    SurfacePoint lightPoint;
+    intersect(ray, lightPoint, light);
+    return lightPoint.valid() && !occluded(ray, lightPoint.objectId);
 }
@@ -12,37 +12,113 @@
 namespace cpu
 {
 
+class Kernels;
 class Ray;
+class RayPacket;
 class Shader;
 class SurfacePoint;
 class Material;
 class Sphere;
 class Plane;
+class Mesh;
+class Instance;
 class PointLight;
 class Scene;
 
 class Raytracer
 {
 public:
-    Raytracer(Scene* scene);
+    Raytracer(Scene* scene, const Kernels* kernels);
 
+    /**
+     *  Returns the closest surface hit by the ray and shortens the ray to it.
+     */
     SurfacePoint trace(Ray&) const;
-    bool canReach(Ray&, intptr_t objectId) const;
+
+    /**
+     *  Traces every ray of |packet| like trace(Ray&), storing the results in
+     *  |surfacePoints|. Coherent packets share their hierarchy traversal.
+     */
+    void trace(RayPacket& packet, SurfacePoint* surfacePoints) const;
+
+    /**
+     *  Returns true if the ray hits anything other than |ignoredId| within its
+     *  distance range. Stops at the first such hit.
+     */
+    bool occluded(const Ray&, intptr_t ignoredId = 0) const;
+
+    /**
+     *  Returns true if the ray hits |light| with nothing in between.
+     */
+    bool canReach(Ray&, const Sphere& light) const;
 
     void intersect(Ray&, SurfacePoint&, const Sphere&) const;
     void intersect(Ray&, SurfacePoint&, const Plane&) const;
+    void intersect(Ray&, SurfacePoint&, const Mesh&) const;
+    void intersect(Ray&, SurfacePoint&, const Instance&) const;
 
 private:
+    /**
+     *  Intersection routines specialized for the transform class of the
+     *  object. Sphere hierarchies hold spheres of a single class, which
+     *  selects the routine at compile time. Meshes and instances pick the
+     *  instantiation for their class once per object, which then transforms
+     *  the ray and the shading frame with as little work as the class allows.
+     *  Objects without a specialized routine use the general one.
+     */
+    template <typename ObjectType, TransformClass Class>
+    void intersect(Ray&, SurfacePoint&, const ObjectType&, TransformTag<Class>) const;
+    template <TransformClass Class>
+    void intersect(Ray&, SurfacePoint&, const Sphere&, TransformTag<Class>) const;
+    void intersect(Ray&, SurfacePoint&, const Sphere&, TransformTag<TransformClass::General>) const;
+    template <TransformClass Class>
+    void intersect(Ray&, SurfacePoint&, const Mesh&, TransformTag<Class>) const;
+    template <TransformClass Class>
+    void intersect(RayPacket&, SurfacePoint* surfacePoints, const Mesh&, TransformTag<Class>) const;
+    template <TransformClass Class>
+    void intersect(Ray&, SurfacePoint&, const Instance&, TransformTag<Class>) const;
+
     template <typename ObjectType>
     void intersectAll(const std::vector<ObjectType>& objects,
                       Ray&, SurfacePoint&) const;
 
+    template <TransformClass Class, typename ObjectType>
+    void intersectBVH(const WideBVH&, const std::vector<ObjectType>& objects,
+                      Ray&, SurfacePoint&) const;
+
+    template <TransformClass Class, typename ObjectType>
+    void intersectBVH(const WideBVH&, const std::vector<ObjectType>& objects,
+                      RayPacket&, SurfacePoint* surfacePoints) const;
+    void intersect(RayPacket&, SurfacePoint* surfacePoints, const Mesh&) const;
+    void intersectInstances(Ray&, SurfacePoint&) const;
+    void intersectInstances(RayPacket&, SurfacePoint* surfacePoints) const;
+    void intersectSpheres(const WideBVH&, const std::vector<Sphere>& spheres,
+                          RayPacket&, SurfacePoint* surfacePoints) const;
+
+    template <TransformClass Class, typename ObjectType>
+    bool occludedBy(const WideBVH&, const std::vector<ObjectType>& objects,
+                    const Ray&, intptr_t ignoredId) const;
+    template <typename ObjectType, TransformClass Class>
+    bool occludedBy(const Ray&, const ObjectType&, intptr_t ignoredId, TransformTag<Class>) const;
+    bool occludedBy(const Ray&, const Mesh&, intptr_t ignoredId) const;
+    template <TransformClass Class>
+    bool occludedBy(const Ray&, const Mesh&, intptr_t ignoredId, TransformTag<Class>) const;
+    bool occludedBy(const Ray&, const Instance&, intptr_t ignoredId) const;
+    template <TransformClass Class>
+    bool occludedBy(const Ray&, const Instance&, intptr_t ignoredId, TransformTag<Class>) const;
+    bool occludedByInstances(const Ray&, intptr_t ignoredId) const;
+
     void processIntersection(Ray&, SurfacePoint&, float t, intptr_t objectId,
                              const glm::vec3& normal, const glm::vec3& tangent,
                              const glm::vec3& binormal,
                              const Material* material) const;
+    void processIntersection(Ray&, SurfacePoint&, float t, const Sphere&) const;
+    template <TransformClass Class>
+    void processIntersection(Ray&, SurfacePoint&, float t, const Mesh&,
+                             const scene::Triangle&, TransformTag<Class>) const;
 
     Scene* m_scene;
+    const Kernels* m_kernels;
 };
 
 }
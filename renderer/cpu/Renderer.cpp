@@ -1,80 +1,134 @@
 // Copyright (C) 2012 Sami Kyöstilä
 
+#include "Accumulator.h"
+#include "Integrator.h"
+#include "Kernels.h"
+#include "PinholeCamera.h"
 #include "Random.h"
 #include "Ray.h"
+#include "RayPacket.h"
 #include "Raytracer.h"
 #include "Renderer.h"
-#include "Shader.h"
+#include "SplatBuffer.h"
 #include "SurfacePoint.h"
 #include "renderer/Image.h"
 #include "scene/Scene.h"
 
-#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
 
 namespace cpu
 {
 
-Renderer::Renderer(const scene::Scene& scene):
+namespace
+{
+
+// Width and height of the pixel tiles whose camera rays form a packet.
+const int g_tileSize = 4;
+
+}
+
+Renderer::Renderer(const scene::Scene& scene, const Options& options):
+    m_options(options),
+    m_kernels(&Kernels::forIsa(options.isa)),
     m_scene(new Scene(scene)),
-    m_raytracer(new Raytracer(m_scene.get())),
-    m_shader(new Shader(m_scene.get(), m_raytracer.get())),
-    m_samples(32)
+    m_raytracer(new Raytracer(m_scene.get(), m_kernels)),
+    m_camera(m_scene->camera),
+    m_splats(new SplatBuffer()),
+    m_integrator(Integrator::create(m_scene.get(), m_raytracer.get(), &m_camera, m_splats.get(), m_options)),
+    m_samples(32),
+    m_passLimit(0)
 {
 }
 
 void Renderer::render(Image& image, int xOffset, int yOffset, int width, int height) const
 {
-    Random random(0715517 * (yOffset + 1));
-    const Camera& camera = m_scene->camera;
-
-    const glm::vec4 viewport(0, 0, 1, 1);
-    glm::vec3 p1 = glm::unProject(glm::vec3(0.f, 0.f, 0.f), camera.transform, camera.projection, viewport);
-    glm::vec3 p2 = glm::unProject(glm::vec3(1.f, 0.f, 0.f), camera.transform, camera.projection, viewport);
-    glm::vec3 p3 = glm::unProject(glm::vec3(0.f, 1.f, 0.f), camera.transform, camera.projection, viewport);
-    glm::vec3 origin(glm::inverse(camera.transform) * glm::vec4(0.f, 0.f, 0.f, 1.f));
-
-    std::unique_ptr<glm::vec4[]> radianceMap(new glm::vec4[width * height]);
+    Random random(m_kernels, 0715517 * (yOffset + 1));
+    Random ditherRandom(m_kernels, 0x5eed * (yOffset + 1));
+    Accumulator accumulator(m_options.accumulatorFormat, width * height);
+    m_splats->prepare(image);
 
+    // Only whole rows and columns of samples are traced.
     int samplesPerAxis = sqrt(m_samples);
+    unsigned samples = samplesPerAxis * samplesPerAxis;
     float pixelWidth = 1.f / image.width;
-    float pixelHeight = 1.f / image.height;
+    float pixelHeight = 1.f / image.frameHeight;
     float sampleWidth = pixelWidth / samplesPerAxis;
     float sampleHeight = pixelHeight / samplesPerAxis;
 
-    for (int pass = 1;; pass++)
+    std::unique_ptr<Integrator::ThreadState> threadState = m_integrator->createThreadState(random, width, height);
+    for (int pass = 1; !m_passLimit || pass <= m_passLimit; pass++)
     {
-        for (int y = yOffset; y < yOffset + height; y++)
+        std::shared_ptr<const Integrator::PassState> passState = m_integrator->beginPass(pass);
+
+        // Camera rays are traced in packets with one ray for each pixel of a
+        // small tile.
+        for (int tileY = yOffset; tileY < yOffset + height; tileY += g_tileSize)
         {
-            for (int x = xOffset; x < xOffset + width; x++)
+            int tileHeight = std::min(g_tileSize, yOffset + height - tileY);
+            for (int tileX = xOffset; tileX < xOffset + width; tileX += g_tileSize)
             {
-                glm::vec4 radiance;
+                int tileWidth = std::min(g_tileSize, xOffset + width - tileX);
+
+                // Sum the batch in double precision so that it stays exact
+                // enough to be folded into a low precision accumulator.
+                // Compensated float summation would not survive -ffast-math.
+                glm::dvec3 radiance[RayPacket::maxSize];
                 for (int sampleY = 0; sampleY < samplesPerAxis; sampleY++)
                 {
                     for (int sampleX = 0; sampleX < samplesPerAxis; sampleX++)
                     {
-                        glm::vec4 offset = random.generate() * .5f + glm::vec4(.5f);
-                        float sx = x * pixelWidth + sampleX * sampleWidth + offset.x * sampleWidth;
-                        float sy = (image.height - y) * pixelHeight + sampleY * sampleHeight + offset.y * sampleHeight;
-                        glm::vec3 direction = p1 + (p2 - p1) * sx + (p3 - p1) * sy - origin;
-                        direction = glm::normalize(direction);
-
-                        Ray ray;
-                        ray.origin = origin;
-                        ray.direction = direction;
-
-                        SurfacePoint surfacePoint = m_raytracer->trace(ray);
-                        radiance += m_shader->shade(surfacePoint, random);
+                        RayPacket packet;
+                        packet.size = tileWidth * tileHeight;
+                        for (int i = 0; i < packet.size; i++)
+                        {
+                            int x = tileX + i % tileWidth;
+                            int y = tileY + i / tileWidth;
+                            float offsetX = random.generateUniform();
+                            float offsetY = random.generateUniform();
+                            float sx = x * pixelWidth + sampleX * sampleWidth + offsetX * sampleWidth;
+                            float sy = (image.frameHeight - 1 - y) * pixelHeight + sampleY * sampleHeight + offsetY * sampleHeight;
+
+                            packet.rays[i].origin = m_camera.origin;
+                            packet.rays[i].direction = m_camera.direction(sx, sy);
+                        }
+
+                        SurfacePoint surfacePoints[RayPacket::maxSize];
+                        m_raytracer->trace(packet, surfacePoints);
+                        for (int i = 0; i < packet.size; i++)
+                        {
+                            if (threadState)
+                                threadState->pixel = glm::ivec2(tileX - xOffset + i % tileWidth,
+                                                                tileY - yOffset + i / tileWidth);
+                            glm::vec4 sample = m_integrator->radiance(surfacePoints[i], random, passState.get(),
+                                                                      threadState.get());
+                            radiance[i] += glm::dvec3(glm::vec3(sample));
+                        }
                     }
                 }
-                // Combine new sample with the previous passes.
-                glm::vec4& totalRadiance = radianceMap[(y - yOffset) * width + (x - xOffset)];
-                totalRadiance += radiance / m_samples;
 
-                glm::vec4 pixel = Image::linearToSRGB(glm::clamp(totalRadiance / pass, glm::vec4(0), glm::vec4(1)));
-                pixel.a = 1;
-                image.pixels[y * image.width + x] = Image::colorToRGBA8(pixel);
+                // Combine new sample with the previous passes, and add the
+                // light that other samples splatted on the pixel.
+                glm::vec3 means[RayPacket::maxSize];
+                for (int i = 0; i < tileWidth * tileHeight; i++)
+                {
+                    int x = tileX + i % tileWidth;
+                    int y = tileY + i / tileWidth;
+                    means[i] = accumulator.add((y - yOffset) * width + (x - xOffset),
+                                               glm::vec3(radiance[i] / static_cast<double>(samples)),
+                                               pass, ditherRandom);
+                    means[i] += m_splats->radiance(x, y);
+                }
+
+                uint32_t pixels[RayPacket::maxSize];
+                m_kernels->tonemap(&means[0].x, pixels, tileWidth * tileHeight);
+                for (int i = 0; i < tileWidth * tileHeight; i++)
+                {
+                    int x = tileX + i % tileWidth;
+                    int y = tileY + i / tileWidth;
+                    image.pixels[(y - image.frameTop) * image.width + x] = pixels[i];
+                }
             }
-            if (m_observer && !m_observer(pass, m_samples, 0, y, width, 1))
+            if (m_observer && !m_observer(pass, samples, 0, tileY, width, tileHeight))
                 return;
         }
     }
@@ -85,4 +139,21 @@ void Renderer::setObserver(RenderObserver observer)
     m_observer = observer;
 }
 
+void Renderer::setPassLimit(int passes)
+{
+    m_passLimit = passes;
+}
+
+void Renderer::setIntegrator(IntegratorType type)
+{
+    m_options.integrator = type;
+    m_splats.reset(new SplatBuffer());
+    m_integrator = Integrator::create(m_scene.get(), m_raytracer.get(), &m_camera, m_splats.get(), m_options);
+}
+
+std::string Renderer::statistics() const
+{
+    return m_integrator->statistics();
+}
+
 }
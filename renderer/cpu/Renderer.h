@@ -2,8 +2,14 @@
 #ifndef CPU_RENDERER_H
 #define CPU_RENDERER_H
 
+#include "Integrator.h"
+#include "Options.h"
+#include "PinholeCamera.h"
 #include "Raytracer.h"
-#include "Shader.h"
+#include "SplatBuffer.h"
+
+#include <functional>
+#include <string>
 
 class Image;
 
@@ -15,21 +21,44 @@ class Scene;
 namespace cpu
 {
 
+class Kernels;
+
 typedef std::function<bool(int pass, int samples, int xOffset, int yOffset, int width, int height)> RenderObserver;
 
 class Renderer
 {
 public:
-    Renderer(const scene::Scene& scene);
+    Renderer(const scene::Scene& scene, const Options& options = Options());
 
     void setObserver(RenderObserver observer);
+
+    // Stops rendering after the given number of passes. Zero means render
+    // until the observer says otherwise.
+    void setPassLimit(int passes);
+
+    /**
+     *  Replaces the integrator with a new one of |type|, which renders from
+     *  the first pass on. Must not be called while rendering.
+     */
+    void setIntegrator(IntegratorType type);
+
     void render(Image& image, int xOffset, int yOffset, int width, int height) const;
 
+    /**
+     *  Describes the work of the integrator, or returns an empty string.
+     */
+    std::string statistics() const;
+
 private:
+    Options m_options;
+    const Kernels* m_kernels;
     std::unique_ptr<Scene> m_scene;
     std::unique_ptr<Raytracer> m_raytracer;
-    std::unique_ptr<Shader> m_shader;
+    PinholeCamera m_camera;
+    std::unique_ptr<SplatBuffer> m_splats;
+    std::unique_ptr<Integrator> m_integrator;
     unsigned m_samples;
+    int m_passLimit;
     RenderObserver m_observer;
 };
 
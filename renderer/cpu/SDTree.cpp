@@ -0,0 +1,364 @@
+// Copyright (C) 2013 Sami Kyöstilä
+
+#include "FastMath.h"
+#include "Random.h"
+#include "SDTree.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace cpu;
+
+namespace
+{
+// Quadrants that receive more than this fraction of the light of a region
+// are split when the tree is refined.
+const float g_splitFraction = .01f;
+
+// Limits the directional resolution to 2^-20 of the square, which is far
+// below the precision the recorded samples can support.
+const int g_maxDirectionDepth = 20;
+
+// Sums stay within the range of a float, but the tree is shared by all
+// render threads, so additions have to be atomic.
+void addAtomic(std::atomic<float>& sum, float value)
+{
+    float current = sum.load(std::memory_order_relaxed);
+    while (!sum.compare_exchange_weak(current, current + value, std::memory_order_relaxed))
+        ;
+}
+
+// The square is (cos(theta) + 1) / 2 by phi / (2 pi), which maps equal
+// areas of the sphere to equal areas of the square.
+glm::vec2 squareFromDirection(const glm::vec3& direction)
+{
+    float length = sqrtf(direction.x * direction.x + direction.y * direction.y);
+    float phi = length > 0 ? fastAcos(glm::clamp(direction.x / length, -1.f, 1.f)) : 0;
+    if (direction.y < 0)
+        phi = 2 * M_PI - phi;
+    return glm::clamp(glm::vec2((direction.z + 1) * .5f, phi * float(.5 * M_1_PI)), glm::vec2(0), glm::vec2(1));
+}
+
+glm::vec3 directionFromSquare(const glm::vec2& point)
+{
+    float cosTheta = 2 * point.x - 1;
+    float sinTheta = sqrtf(std::max(0.f, 1 - cosTheta * cosTheta));
+    float sinPhi, cosPhi;
+    fastSinCos(2 * M_PI * point.y, sinPhi, cosPhi);
+    return glm::vec3(sinTheta * cosPhi, sinTheta * sinPhi, cosTheta);
+}
+}
+
+DirectionTree::Node::Node()
+{
+    for (int i = 0; i < 4; i++) {
+        sums[i].store(0, std::memory_order_relaxed);
+        children[i] = 0;
+    }
+}
+
+DirectionTree::Node::Node(const Node& node)
+{
+    *this = node;
+}
+
+DirectionTree::Node& DirectionTree::Node::operator=(const Node& node)
+{
+    for (int i = 0; i < 4; i++) {
+        sums[i].store(node.sums[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        children[i] = node.children[i];
+    }
+    return *this;
+}
+
+float DirectionTree::Node::total() const
+{
+    return sums[0].load(std::memory_order_relaxed) + sums[1].load(std::memory_order_relaxed) +
+           sums[2].load(std::memory_order_relaxed) + sums[3].load(std::memory_order_relaxed);
+}
+
+DirectionTree::DirectionTree():
+    m_nodes(1)
+{
+}
+
+void DirectionTree::record(const glm::vec3& direction, float value)
+{
+    glm::vec2 point = squareFromDirection(direction);
+    size_t index = 0;
+    for (;;) {
+        int quadrant = (point.x >= .5f) + 2 * (point.y >= .5f);
+        uint32_t child = m_nodes[index].children[quadrant];
+        if (!child) {
+            addAtomic(m_nodes[index].sums[quadrant], value);
+            return;
+        }
+        point = point * 2.f - glm::vec2(quadrant & 1, quadrant >> 1);
+        index = child;
+    }
+}
+
+void DirectionTree::build()
+{
+    // Children are always stored after their parents.
+    for (size_t i = m_nodes.size(); i-- > 0;) {
+        Node& node = m_nodes[i];
+        for (int j = 0; j < 4; j++)
+            if (node.children[j])
+                node.sums[j].store(m_nodes[node.children[j]].total(), std::memory_order_relaxed);
+    }
+}
+
+float DirectionTree::flux() const
+{
+    return m_nodes[0].total();
+}
+
+RandomValue<glm::vec3> DirectionTree::generateSample(Random& random) const
+{
+    glm::vec2 origin(0);
+    float size = 1;
+    float probability = 1;
+    for (const Node* node = &m_nodes[0]; node; ) {
+        // Quadrants are chosen in proportion to their light, or uniformly
+        // in the parts of the tree that no sample reached.
+        float total = node->total();
+        int quadrant = 0;
+        if (total > 0) {
+            float u = random.generateUniform() * total;
+            for (int i = 0; i < 4; i++) {
+                float sum = node->sums[i].load(std::memory_order_relaxed);
+                if (sum > 0)
+                    quadrant = i;
+                if (u < sum)
+                    break;
+                u -= sum;
+            }
+            probability *= 4 * node->sums[quadrant].load(std::memory_order_relaxed) / total;
+        } else {
+            quadrant = std::min(static_cast<int>(random.generateUniform() * 4), 3);
+        }
+
+        size *= .5f;
+        origin += glm::vec2(quadrant & 1, quadrant >> 1) * size;
+        node = node->children[quadrant] ? &m_nodes[node->children[quadrant]] : nullptr;
+    }
+
+    glm::vec2 point = origin + glm::vec2(random.generateUniform(), random.generateUniform()) * size;
+    return RandomValue<glm::vec3>(directionFromSquare(point), probability * float(.25 * M_1_PI));
+}
+
+float DirectionTree::sampleProbability(const glm::vec3& direction) const
+{
+    glm::vec2 point = squareFromDirection(direction);
+    float probability = 1;
+    for (const Node* node = &m_nodes[0]; node; ) {
+        int quadrant = (point.x >= .5f) + 2 * (point.y >= .5f);
+        float total = node->total();
+        if (total > 0)
+            probability *= 4 * node->sums[quadrant].load(std::memory_order_relaxed) / total;
+        point = point * 2.f - glm::vec2(quadrant & 1, quadrant >> 1);
+        node = node->children[quadrant] ? &m_nodes[node->children[quadrant]] : nullptr;
+    }
+    return probability * float(.25 * M_1_PI);
+}
+
+DirectionTree DirectionTree::refined() const
+{
+    DirectionTree result;
+    float total = flux();
+    if (!(total > 0)) {
+        // Nothing was learned, so keep the resolution for the next round.
+        result.m_nodes = m_nodes;
+        for (Node& node: result.m_nodes)
+            for (int i = 0; i < 4; i++)
+                node.sums[i].store(0, std::memory_order_relaxed);
+        return result;
+    }
+    refine(m_nodes[0], 1, total * g_splitFraction, result, 0);
+    return result;
+}
+
+void DirectionTree::refine(const Node& node, int depth, float limit, DirectionTree& result, size_t index) const
+{
+    for (int i = 0; i < 4; i++) {
+        if (depth >= g_maxDirectionDepth || !(node.sums[i].load(std::memory_order_relaxed) > limit))
+            continue;
+        uint32_t child = result.m_nodes.size();
+        result.m_nodes.emplace_back();
+        result.m_nodes[index].children[i] = child;
+        if (node.children[i])
+            refine(m_nodes[node.children[i]], depth + 1, limit, result, child);
+    }
+}
+
+size_t DirectionTree::bytes() const
+{
+    return sizeof(DirectionTree) + m_nodes.size() * sizeof(Node);
+}
+
+SDTree::Node::Node():
+    directions(0),
+    samples(0)
+{
+    children[0] = children[1] = 0;
+}
+
+SDTree::Node::Node(const Node& node):
+    directions(node.directions),
+    samples(node.samples.load(std::memory_order_relaxed))
+{
+    children[0] = node.children[0];
+    children[1] = node.children[1];
+}
+
+SDTree::SDTree():
+    m_nodes(1),
+    m_directions(1),
+    m_bounded(false)
+{
+    for (int i = 0; i < 3; i++) {
+        m_lower[i].store(HUGE_VALF, std::memory_order_relaxed);
+        m_upper[i].store(-HUGE_VALF, std::memory_order_relaxed);
+    }
+}
+
+SDTree::SDTree(const SDTree& tree):
+    m_nodes(tree.m_nodes),
+    m_directions(tree.m_directions),
+    m_bounded(tree.m_bounded)
+{
+    for (int i = 0; i < 3; i++) {
+        m_lower[i].store(tree.m_lower[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        m_upper[i].store(tree.m_upper[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+}
+
+size_t SDTree::findNode(const glm::vec3& position) const
+{
+    if (!m_nodes[0].children[0])
+        return 0;
+
+    // Positions outside the bounds end up in the regions at the boundary.
+    glm::vec3 lower(m_lower[0].load(std::memory_order_relaxed), m_lower[1].load(std::memory_order_relaxed),
+                    m_lower[2].load(std::memory_order_relaxed));
+    glm::vec3 upper(m_upper[0].load(std::memory_order_relaxed), m_upper[1].load(std::memory_order_relaxed),
+                    m_upper[2].load(std::memory_order_relaxed));
+    size_t index = 0;
+    for (int depth = 0; m_nodes[index].children[0]; depth++) {
+        int axis = depth % 3;
+        float middle = (lower[axis] + upper[axis]) * .5f;
+        bool upperHalf = position[axis] >= middle;
+        if (upperHalf)
+            lower[axis] = middle;
+        else
+            upper[axis] = middle;
+        index = m_nodes[index].children[upperHalf];
+    }
+    return index;
+}
+
+const DirectionTree& SDTree::find(const glm::vec3& position) const
+{
+    return m_directions[m_nodes[findNode(position)].directions];
+}
+
+void SDTree::extendBounds(const glm::vec3& position)
+{
+    for (int i = 0; i < 3; i++) {
+        float lower = m_lower[i].load(std::memory_order_relaxed);
+        while (position[i] < lower &&
+               !m_lower[i].compare_exchange_weak(lower, position[i], std::memory_order_relaxed))
+            ;
+        float upper = m_upper[i].load(std::memory_order_relaxed);
+        while (position[i] > upper &&
+               !m_upper[i].compare_exchange_weak(upper, position[i], std::memory_order_relaxed))
+            ;
+    }
+}
+
+void SDTree::build()
+{
+    for (DirectionTree& directions: m_directions)
+        directions.build();
+}
+
+void SDTree::record(const glm::vec3& position, const glm::vec3& direction, float value)
+{
+    if (!m_bounded)
+        extendBounds(position);
+    Node& node = m_nodes[findNode(position)];
+    node.samples.fetch_add(1, std::memory_order_relaxed);
+    if (value > 0)
+        m_directions[node.directions].record(direction, value);
+}
+
+std::unique_ptr<SDTree> SDTree::refined(size_t maxSamples) const
+{
+    std::unique_ptr<SDTree> result(new SDTree());
+    result->m_nodes.clear();
+    result->m_directions.clear();
+    result->m_nodes.emplace_back();
+
+    // The bounds are fixed by the positions recorded in the first tree.
+    bool bounded = m_bounded;
+    for (int i = 0; i < 3; i++) {
+        float lower = m_lower[i].load(std::memory_order_relaxed);
+        float upper = m_upper[i].load(std::memory_order_relaxed);
+        if (!m_bounded) {
+            bounded = bounded || lower <= upper;
+            float margin = std::max(upper - lower, 1.f) * 1e-3f;
+            lower -= margin;
+            upper += margin;
+        }
+        result->m_lower[i].store(lower, std::memory_order_relaxed);
+        result->m_upper[i].store(upper, std::memory_order_relaxed);
+    }
+    result->m_bounded = bounded;
+    refine(m_nodes[0], *result, 0, std::max<size_t>(maxSamples, 1));
+    return result;
+}
+
+void SDTree::refine(const Node& node, SDTree& result, size_t index, size_t maxSamples) const
+{
+    if (!node.children[0]) {
+        result.split(index, node.samples.load(std::memory_order_relaxed), maxSamples,
+                     m_directions[node.directions].refined());
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        uint32_t child = result.m_nodes.size();
+        result.m_nodes.emplace_back();
+        result.m_nodes[index].children[i] = child;
+        refine(m_nodes[node.children[i]], result, child, maxSamples);
+    }
+}
+
+void SDTree::split(size_t index, size_t samples, size_t maxSamples, const DirectionTree& directions)
+{
+    // Samples are assumed to divide evenly between the halves of a region.
+    if (samples <= maxSamples || !m_bounded) {
+        m_nodes[index].directions = m_directions.size();
+        m_directions.push_back(directions);
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        uint32_t child = m_nodes.size();
+        m_nodes.emplace_back();
+        m_nodes[index].children[i] = child;
+        split(child, samples / 2, maxSamples, directions);
+    }
+}
+
+size_t SDTree::regionCount() const
+{
+    return m_directions.size();
+}
+
+size_t SDTree::bytes() const
+{
+    size_t bytes = sizeof(SDTree) + m_nodes.size() * sizeof(Node);
+    for (const DirectionTree& directions: m_directions)
+        bytes += directions.bytes();
+    return bytes;
+}
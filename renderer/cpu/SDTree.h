@@ -0,0 +1,160 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_SDTREE_H
+#define CPU_SDTREE_H
+
+#include <atomic>
+#include <glm/glm.hpp>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+namespace cpu
+{
+
+class Random;
+
+template <typename T> class RandomValue;
+
+/**
+ *  Distribution of the light arriving at a region from all directions. The
+ *  directions are mapped to the unit square with an area preserving
+ *  cylindrical projection, and the square is split into a quadtree that is
+ *  finest where most of the light comes from. Samples may be recorded by
+ *  several threads at once. Recording only sums the light of the quadrants
+ *  that are leaves, which keeps it cheap, so the tree has to be built before
+ *  it is sampled or refined.
+ */
+class DirectionTree
+{
+public:
+    DirectionTree();
+
+    /**
+     *  Adds |value| to the light arriving from |direction|.
+     */
+    void record(const glm::vec3& direction, float value);
+
+    /**
+     *  Sums the light of the inner quadrants from the recorded leaves.
+     */
+    void build();
+
+    /**
+     *  Returns the sum of the recorded values.
+     */
+    float flux() const;
+
+    /**
+     *  Generates a direction in proportion to the recorded light. The
+     *  probability is a density over the sphere of directions.
+     */
+    RandomValue<glm::vec3> generateSample(Random& random) const;
+
+    /**
+     *  Returns the density with which generateSample() chooses |direction|.
+     */
+    float sampleProbability(const glm::vec3& direction) const;
+
+    /**
+     *  Returns an empty tree that splits the quadrants which received more
+     *  than a small fraction of the light recorded in this one.
+     */
+    DirectionTree refined() const;
+
+    size_t bytes() const;
+
+private:
+    class Node
+    {
+    public:
+        Node();
+        Node(const Node& node);
+        Node& operator=(const Node& node);
+
+        float total() const;
+
+        // Light recorded in each quadrant, and the node splitting each
+        // quadrant, or zero if it is a leaf.
+        std::atomic<float> sums[4];
+        uint32_t children[4];
+    };
+
+    void refine(const Node& node, int depth, float limit, DirectionTree& result, size_t index) const;
+
+    std::vector<Node> m_nodes;
+};
+
+/**
+ *  Spatial binary tree of regions, each with the directional distribution
+ *  of the light arriving there. The regions are split in half along each
+ *  axis in turn until they contain few enough samples.
+ */
+class SDTree
+{
+public:
+    /**
+     *  Creates a tree with a single region, which finds its bounds from the
+     *  recorded positions.
+     */
+    SDTree();
+    SDTree(const SDTree& tree);
+
+    /**
+     *  Returns the directional distribution of the region containing
+     *  |position|.
+     */
+    const DirectionTree& find(const glm::vec3& position) const;
+
+    /**
+     *  Adds |value| to the light arriving at |position| from |direction|.
+     *  May be called by several threads at once.
+     */
+    void record(const glm::vec3& position, const glm::vec3& direction, float value);
+
+    /**
+     *  Builds the directional distributions once the recording is over.
+     */
+    void build();
+
+    /**
+     *  Returns an empty tree that splits the regions with more than
+     *  |maxSamples| samples and refines the directional distribution of
+     *  each region.
+     */
+    std::unique_ptr<SDTree> refined(size_t maxSamples) const;
+
+    size_t regionCount() const;
+    size_t bytes() const;
+
+private:
+    class Node
+    {
+    public:
+        Node();
+        Node(const Node& node);
+
+        // Children splitting the node at the middle of axis |depth % 3|, or
+        // zero if the node is a region.
+        uint32_t children[2];
+        uint32_t directions;
+        std::atomic<uint32_t> samples;
+    };
+
+    size_t findNode(const glm::vec3& position) const;
+    void extendBounds(const glm::vec3& position);
+    void refine(const Node& node, SDTree& result, size_t index, size_t maxSamples) const;
+    void split(size_t index, size_t samples, size_t maxSamples, const DirectionTree& directions);
+
+    std::vector<Node> m_nodes;
+    std::vector<DirectionTree> m_directions;
+
+    // The first tree has no bounds, since it has a single region, and
+    // records the extent of the positions for its successors instead.
+    bool m_bounded;
+    std::atomic<float> m_lower[3];
+    std::atomic<float> m_upper[3];
+};
+
+}
+
+#endif
@@ -3,26 +3,190 @@
 #include "scene/Scene.h"
 
 #include <algorithm>
+#include <cmath>
 
 using namespace cpu;
 
+namespace
+{
+
+// Two hierarchies over interleaved spheres are traversed twice as often, which
+// is only worth the cheaper sphere test when they cost little more than one.
+const float g_splitCostTolerance = 1.05f;
+
+// Returns |bvh|, or a hierarchy built over |spheres| if |bvh| does not match
+// them.
+scene::BVH sphereBVHFor(const scene::SphereList& spheres, const scene::BVH& bvh)
+{
+    if (bvh.indexCount() == spheres.size())
+        return bvh;
+    std::vector<scene::AABB> bounds;
+    bounds.reserve(spheres.size());
+    for (const scene::Sphere& sphere: spheres)
+        bounds.push_back(sphere.bounds());
+    scene::BVH result;
+    result.build(bounds);
+    return result;
+}
+
+// Returns a hierarchy over the spheres listed in |subset|, indexing the full
+// list.
+scene::BVH sphereBVHFor(const scene::SphereList& spheres, const std::vector<uint32_t>& subset)
+{
+    std::vector<scene::AABB> bounds;
+    bounds.reserve(subset.size());
+    for (uint32_t index: subset)
+        bounds.push_back(spheres[index].bounds());
+
+    struct Storage
+    {
+        scene::BVH bvh;
+        std::vector<uint32_t> indices;
+    };
+    auto storage = std::make_shared<Storage>();
+    storage->bvh.build(bounds);
+    storage->indices.reserve(subset.size());
+    for (size_t i = 0; i < subset.size(); i++)
+        storage->indices.push_back(subset[storage->bvh.indices()[i]]);
+
+    scene::BVH result;
+    result.assign(storage->bvh.nodes(), storage->bvh.nodeCount(),
+                  storage->indices.data(), storage->indices.size(), storage);
+    return result;
+}
+
+// Returns the expected cost of tracing a ray through |bvh| scaled by the area
+// of its root, so that the costs of different hierarchies can be compared.
+float absoluteCost(const scene::BVH& bvh)
+{
+    if (bvh.empty())
+        return 0;
+    const scene::BVHNode& root = bvh.nodes()[0];
+    return bvh.sahCost() * scene::AABB(root.min, root.max).surfaceArea();
+}
+
+// Builds |bvh| over the spheres that can be intersected in world space and
+// |generalBVH| over the rest. |sceneBVH| is reused when all spheres fall on
+// the same side, or when splitting them would make tracing more expensive.
+void buildSphereBVHs(const scene::SphereList& sceneSpheres, const scene::BVH& sceneBVH,
+                     const SphereList& spheres, WideBVH& bvh, WideBVH& generalBVH)
+{
+    std::vector<uint32_t> similar;
+    std::vector<uint32_t> general;
+    for (size_t i = 0; i < spheres.size(); i++)
+    {
+        if (spheres[i].transform.transformClass == TransformClass::General)
+            general.push_back(i);
+        else
+            similar.push_back(i);
+    }
+
+    if (general.empty())
+        bvh = WideBVH(sphereBVHFor(sceneSpheres, sceneBVH));
+    else if (similar.empty())
+        generalBVH = WideBVH(sphereBVHFor(sceneSpheres, sceneBVH));
+    else
+    {
+        scene::BVH combinedBVH = sphereBVHFor(sceneSpheres, sceneBVH);
+        scene::BVH similarBVH = sphereBVHFor(sceneSpheres, similar);
+        scene::BVH remainingBVH = sphereBVHFor(sceneSpheres, general);
+        if (absoluteCost(similarBVH) + absoluteCost(remainingBVH) >
+            g_splitCostTolerance * absoluteCost(combinedBVH))
+        {
+            generalBVH = WideBVH(combinedBVH);
+            return;
+        }
+        bvh = WideBVH(similarBVH);
+        generalBVH = WideBVH(remainingBVH);
+    }
+}
+
+TransformClass classify(const glm::mat4& matrix)
+{
+    const float epsilon = 1e-5f;
+    if (matrix[0][3] != 0 || matrix[1][3] != 0 || matrix[2][3] != 0 || matrix[3][3] != 1)
+        return TransformClass::General;
+
+    // The linear part is a scaled rotation if its columns are orthogonal and
+    // of equal length.
+    glm::mat3 linear(matrix);
+    glm::mat3 gram = glm::transpose(linear) * linear;
+    float scale = gram[0][0];
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            float expected = i == j ? scale : 0;
+            if (fabs(gram[i][j] - expected) > epsilon * scale)
+                return TransformClass::General;
+        }
+    }
+
+    if (linear != glm::mat3())
+        return TransformClass::Similarity;
+    if (matrix[3] != glm::vec4(0, 0, 0, 1))
+        return TransformClass::Translation;
+    return TransformClass::Identity;
+}
+
+}
+
 Transform::Transform(const glm::mat4 matrix):
     matrix(matrix),
     invMatrix(glm::inverse(matrix)),
-    determinant(glm::determinant(matrix))
+    determinant(glm::determinant(matrix)),
+    transformClass(classify(matrix))
 {
 }
 
 Sphere::Sphere(const scene::Sphere& sphere):
     transform(sphere.transform),
     material(sphere.material),
-    radius(sphere.radius)
+    radius(sphere.radius),
+    center(transform.matrix[3].xyz()),
+    worldRadius(radius * glm::length(glm::vec3(transform.matrix[0])))
 {
 }
 
 Plane::Plane(const scene::Plane& plane):
     transform(plane.transform),
     material(plane.material)
+{
+    // The plane is y = 0 in local space, so the second row of the inverse
+    // matrix gives its world space equation.
+    const glm::mat4& invMatrix = transform.invMatrix;
+    planeNormal = glm::vec3(invMatrix[0][1], invMatrix[1][1], invMatrix[2][1]);
+    planeDistance = -invMatrix[3][1];
+
+    normal = -glm::vec3(transform.matrix[1]);
+    tangent = glm::vec3(transform.matrix[0]);
+    binormal = glm::cross(normal, tangent);
+}
+
+Mesh::Mesh(const scene::Mesh& mesh):
+    transform(mesh.transform),
+    material(mesh.material),
+    data(mesh.data),
+    bvh(mesh.data->bvh())
+{
+}
+
+Prototype::Prototype(const scene::Prototype& prototype)
+{
+    spheres.reserve(prototype.spheres.size());
+    for (const scene::Sphere& sphere: prototype.spheres)
+        spheres.push_back(Sphere(sphere));
+    buildSphereBVHs(prototype.spheres, prototype.sphereBVH, spheres, sphereBVH, generalSphereBVH);
+    for (const scene::Mesh& mesh: prototype.meshes)
+    {
+        if (mesh.data)
+            meshes.push_back(Mesh(mesh));
+    }
+}
+
+Instance::Instance(const scene::Instance& instance, const Prototype* prototype):
+    transform(instance.transform),
+    prototype(prototype)
 {
 }
 
@@ -30,8 +194,38 @@ Scene::Scene(const scene::Scene& scene):
     backgroundColor(scene.backgroundColor),
     camera(scene.camera)
 {
+    spheres.reserve(scene.spheres.size());
     for (const scene::Sphere& sphere: scene.spheres)
         spheres.push_back(Sphere(sphere));
+    buildSphereBVHs(scene.spheres, scene.sphereBVH, spheres, sphereBVH, generalSphereBVH);
     for (const scene::Plane& plane: scene.planes)
         planes.push_back(Plane(plane));
+    for (const scene::Mesh& mesh: scene.meshes)
+    {
+        if (mesh.data)
+            meshes.push_back(Mesh(mesh));
+    }
+
+    // Instances point to the prototypes, which must not move afterwards.
+    prototypes.reserve(scene.prototypes.size());
+    for (const scene::Prototype& prototype: scene.prototypes)
+        prototypes.push_back(Prototype(prototype));
+    instances.reserve(scene.instances.size());
+    for (const scene::Instance& instance: scene.instances)
+        instances.push_back(Instance(instance, &prototypes[instance.prototype]));
+
+    // Scenes that were not loaded from a file come without hierarchies.
+    scene::BVH binaryInstanceBVH = scene.instanceBVH;
+    if (binaryInstanceBVH.indexCount() != instances.size())
+    {
+        std::vector<scene::AABB> prototypeBounds;
+        for (const scene::Prototype& prototype: scene.prototypes)
+            prototypeBounds.push_back(prototype.bounds());
+        std::vector<scene::AABB> bounds;
+        bounds.reserve(instances.size());
+        for (const scene::Instance& instance: scene.instances)
+            bounds.push_back(prototypeBounds[instance.prototype].transformed(instance.transform));
+        binaryInstanceBVH.build(bounds);
+    }
+    instanceBVH = WideBVH(binaryInstanceBVH);
 }
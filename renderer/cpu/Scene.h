@@ -3,9 +3,11 @@
 #define CPU_SCENE_H
 
 #include <glm/glm.hpp>
+#include <memory>
 #include <vector>
 
 #include "scene/Scene.h"
+#include "WideBVH.h"
 
 namespace cpu
 {
@@ -13,6 +15,27 @@ namespace cpu
 using scene::Material;
 using scene::Camera;
 
+/**
+ *  Kinds of transforms from the most to the least specific. Everything up to
+ *  a similarity transform keeps spheres round, so they can be intersected in
+ *  world space.
+ */
+enum class TransformClass
+{
+    Identity,
+    Translation,
+    Similarity,
+    General
+};
+
+/**
+ *  Selects the intersection routine for a transform class at compile time.
+ */
+template <TransformClass Class>
+struct TransformTag
+{
+};
+
 class Transform
 {
 public:
@@ -21,6 +44,7 @@ public:
     glm::mat4 matrix;
     glm::mat4 invMatrix;
     float determinant;
+    TransformClass transformClass;
 };
 
 class Sphere
@@ -31,6 +55,10 @@ public:
     Transform transform;
     Material material;
     float radius;
+
+    // World space center and radius, valid unless the transform is general.
+    glm::vec3 center;
+    float worldRadius;
 };
 
 class Plane
@@ -40,10 +68,57 @@ public:
 
     Transform transform;
     Material material;
+
+    // World space plane equation dot(planeNormal, x) = planeDistance and the
+    // shading frame of the plane.
+    glm::vec3 planeNormal;
+    float planeDistance;
+    glm::vec3 normal;
+    glm::vec3 tangent;
+    glm::vec3 binormal;
+};
+
+class Mesh
+{
+public:
+    explicit Mesh(const scene::Mesh& mesh);
+
+    Transform transform;
+    Material material;
+    std::shared_ptr<const scene::MeshData> data;
+    WideBVH bvh;
 };
 
 typedef std::vector<Sphere> SphereList;
 typedef std::vector<Plane> PlaneList;
+typedef std::vector<Mesh> MeshList;
+
+class Prototype
+{
+public:
+    explicit Prototype(const scene::Prototype& prototype);
+
+    SphereList spheres;
+    MeshList meshes;
+    WideBVH sphereBVH;
+    WideBVH generalSphereBVH;
+};
+
+/**
+ *  Placement of a prototype. Instances only hold a transform, so their cost
+ *  does not depend on the size of the prototype.
+ */
+class Instance
+{
+public:
+    Instance(const scene::Instance& instance, const Prototype* prototype);
+
+    Transform transform;
+    const Prototype* prototype;
+};
+
+typedef std::vector<Prototype> PrototypeList;
+typedef std::vector<Instance> InstanceList;
 
 class Scene
 {
@@ -56,6 +131,15 @@ public:
 
     SphereList spheres;
     PlaneList planes;
+    MeshList meshes;
+    PrototypeList prototypes;
+    InstanceList instances;
+
+    // Hierarchies over |spheres| and |instances|, indexed in the same order.
+    // The spheres with general transforms have a hierarchy of their own.
+    WideBVH sphereBVH;
+    WideBVH generalSphereBVH;
+    WideBVH instanceBVH;
 };
 
 }
@@ -14,6 +14,25 @@
 namespace cpu
 {
 
+namespace
+{
+
+// Integrators chosen with the number keys of the preview, from 1 on.
+const IntegratorType g_integratorKeys[] =
+{
+    IntegratorType::PathTracing,
+    IntegratorType::Bidirectional,
+    IntegratorType::PhotonMapping,
+    IntegratorType::Metropolis,
+    IntegratorType::InstantRadiosity,
+    IntegratorType::AmbientOcclusion,
+    IntegratorType::DirectLighting,
+    IntegratorType::Normals,
+    IntegratorType::Albedo,
+};
+
+}
+
 int cpuCount()
 {
     return sysconf(_SC_NPROCESSORS_ONLN);
@@ -50,16 +69,37 @@ void joinTasks(RenderTasks& tasks)
     }
 }
 
-Scheduler::Scheduler(const scene::Scene& scene, Image* image, Preview* preview):
-    m_renderer(new Renderer(scene)),
+Scheduler::Scheduler(const scene::Scene& scene, const Options& options, Image* image, Preview* preview):
+    m_renderer(new Renderer(scene, options)),
     m_image(image),
-    m_preview(preview)
+    m_preview(preview),
+    m_integrator(options.integrator)
 {
+    if (options.lightSplit > 1 || options.indirectSplit > 1)
+        m_splitDescription = splitDescription(options);
+    updateDescription();
+}
+
+void Scheduler::updateDescription()
+{
+    // The integrator statistics change as the passes go on.
+    std::string description = integratorName(m_integrator);
+    if (!m_splitDescription.empty())
+        description += ", " + m_splitDescription;
+    std::string statistics = m_renderer->statistics();
+    if (!statistics.empty())
+        description += ", " + statistics;
+    m_preview->setDescription(description);
 }
 
 void Scheduler::run()
 {
     bool done = false;
+    IntegratorType requestedIntegrator = m_integrator;
+    m_preview->setNumberKeyHandler([&requestedIntegrator] (int number) {
+        if (number >= 1 && number <= int(sizeof(g_integratorKeys) / sizeof(g_integratorKeys[0])))
+            requestedIntegrator = g_integratorKeys[number - 1];
+    });
 
     Queue<RenderUpdate> updateQueue;
     m_renderer->setObserver([&updateQueue, &done] (int pass, int samples, int xOffset, int yOffset, int width, int height) {
@@ -73,15 +113,35 @@ void Scheduler::run()
 
     while (m_preview->processEvents())
     {
+        // Start over with the integrator chosen in the preview. The updates
+        // of the stopped threads are dropped.
+        if (requestedIntegrator != m_integrator) {
+            done = true;
+            joinTasks(tasks);
+            RenderUpdate update;
+            while (updateQueue.pop(update, std::chrono::milliseconds(0)))
+                ;
+            m_integrator = requestedIntegrator;
+            m_renderer->setIntegrator(m_integrator);
+            m_preview->restart();
+            done = false;
+            createTasks(*m_image, *m_renderer, tasks);
+        }
+
         RenderUpdate update;
         if (updateQueue.pop(update, std::chrono::milliseconds(500)))
             m_preview->update(update.threadId, update.pass, update.samples,
                               update.xOffset, update.yOffset,
                               update.width, update.height);
+        updateDescription();
     }
 
     done = true;
     joinTasks(tasks);
+
+    // The handlers refer to the locals of this function.
+    m_preview->setNumberKeyHandler(nullptr);
+    m_renderer->setObserver(nullptr);
 }
 
 }
@@ -2,8 +2,10 @@
 #ifndef CPU_SCHEDULER_H
 #define CPU_SCHEDULER_H
 
+#include "Options.h"
 #include "renderer/Scheduler.h"
 #include <memory>
+#include <string>
 
 class Image;
 class Preview;
@@ -18,17 +20,23 @@ namespace cpu
 
 class Renderer;
 
+int cpuCount();
+
 class Scheduler: public ::Scheduler
 {
 public:
-    Scheduler(const scene::Scene&, Image*, Preview*);
+    Scheduler(const scene::Scene&, const Options&, Image*, Preview*);
 
     virtual void run() override;
 
 private:
+    void updateDescription();
+
     std::unique_ptr<Renderer> m_renderer;
     Image* m_image;
     Preview* m_preview;
+    IntegratorType m_integrator;
+    std::string m_splitDescription;
 };
 
 }
@@ -4,9 +4,13 @@
 #include "scene/Scene.h"
 #include "BSDF.h"
 #include "Light.h"
+#include "LightReservoirs.h"
+#include "PathGuide.h"
+#include "PinholeCamera.h"
 #include "Random.h"
 #include "Ray.h"
 #include "Raytracer.h"
+#include "SDTree.h"
 #include "Shader.h"
 #include "SurfacePoint.h"
 #include "Scene.h"
@@ -15,19 +19,65 @@
 #include <algorithm>
 #include <limits>
 #include <cmath>
+#include <sstream>
 
 using namespace cpu;
 
 namespace
 {
 const float g_surfaceEpsilon = 0.001f;
-const int g_depthLimit = 8;
+
+// Guided surfaces sample the learned distribution with this probability and
+// the BSDF otherwise, so that directions the guide has not seen light from
+// are still sampled.
+const float g_guideProbability = .5f;
 }
 
-Shader::Shader(Scene* scene, Raytracer* raytracer):
+Shader::Shader(Scene* scene, Raytracer* raytracer, const PinholeCamera* camera, const Options& options):
     m_scene(scene),
-    m_raytracer(raytracer)
+    m_raytracer(raytracer),
+    m_options(options),
+    m_guide(options.pathGuiding ? new PathGuide() : nullptr),
+    m_cache(options.radianceCache ? new RadianceCache(camera->origin) : nullptr),
+    m_lights(*scene)
+{
+}
+
+std::shared_ptr<const Integrator::PassState> Shader::beginPass(int pass) const
+{
+    if (!m_guide)
+        return nullptr;
+    return m_guide->beginPass(pass);
+}
+
+std::unique_ptr<Integrator::ThreadState> Shader::createThreadState(Random&, int width, int height) const
+{
+    if (!m_options.lightCandidates)
+        return nullptr;
+    return std::unique_ptr<ThreadState>(new LightReservoirs(width, height));
+}
+
+glm::vec4 Shader::radiance(const SurfacePoint& surfacePoint, Random& random,
+                          const PassState* passState, ThreadState* threadState) const
 {
+    return shade(surfacePoint, random, 0, SampleAllObjects, glm::vec4(1),
+                 static_cast<const PathGuide::Pass*>(passState), false, false,
+                 static_cast<LightReservoirs*>(threadState));
+}
+
+std::string Shader::statistics() const
+{
+    std::ostringstream result;
+    result.precision(3);
+    if (m_guide)
+        result << m_guide->statistics();
+    if (m_cache) {
+        if (m_guide)
+            result << ", ";
+        result << "cached " << m_cache->cellCount() << " cells in "
+               << m_cache->bytes() / float(1 << 20) << " MB";
+    }
+    return result.str();
 }
 
 template <typename ObjectType>
@@ -69,7 +119,7 @@ glm::vec4 Shader::sampleLights(const std::vector<ObjectType>& objects,
         shadowRay.direction = lightDirection.value;
         shadowRay.origin = surfacePoint.position + shadowRay.direction * g_surfaceEpsilon;
         //shadowRay.maxDistance = glm::length(samplePos - surfacePoint.position); // FIXME
-        if (!m_raytracer->canReach(shadowRay, reinterpret_cast<intptr_t>(&object)))
+        if (!m_raytracer->canReach(shadowRay, object))
             continue;
 
         // Calculate BSDF probability in the light direction
@@ -101,7 +151,7 @@ float Shader::calculateLightProbabilities(const std::vector<ObjectType>& objects
         shadowRay.direction = direction;
         shadowRay.origin = surfacePoint.position + shadowRay.direction * g_surfaceEpsilon;
         //shadowRay.maxDistance = glm::length(samplePos - surfacePoint.position); // FIXME
-        if (!m_raytracer->canReach(shadowRay, reinterpret_cast<intptr_t>(&object)))
+        if (!m_raytracer->canReach(shadowRay, object))
             continue;
 
         LightSampler<ObjectType> sampler(&surfacePoint, m_raytracer, &object);
@@ -111,7 +161,9 @@ float Shader::calculateLightProbabilities(const std::vector<ObjectType>& objects
 }
 
 glm::vec4 Shader::shade(const SurfacePoint& surfacePoint, Random& random, int depth,
-                        LightSamplingScheme lightSamplingScheme) const
+                        LightSamplingScheme lightSamplingScheme, const glm::vec4& throughput,
+                        const PathGuide::Pass* guide, bool afterDiffuse, bool split,
+                        LightReservoirs* reservoirs) const
 {
     if (!surfacePoint.valid() || !surfacePoint.material)
         return m_scene->backgroundColor;
@@ -120,16 +172,24 @@ glm::vec4 Shader::shade(const SurfacePoint& surfacePoint, Random& random, int de
     const Material* material = surfacePoint.material;
     glm::vec4 radiance = (lightSamplingScheme == SampleAllObjects) ? material->emission : glm::vec4();
 
-    // Terminate path with Russian roulette
-    auto shouldContinue = random.russianRoulette(
-            glm::max(glm::max(material->diffuse, material->specular), material->transparency));
-    if (!shouldContinue.value || depth >= g_depthLimit)
-        return 1 / shouldContinue.probability * radiance;
-
-    // Choose BSDF to be used
     float totalDiffuse = material->diffuse.x + material->diffuse.y + material->diffuse.z;
     float totalSpecular = material->specular.x + material->specular.y + material->specular.z;
     float totalTransparency = material->transparency.x + material->transparency.y + material->transparency.z;
+    if (depth >= m_options.maxDepth || !(totalDiffuse + totalSpecular + totalTransparency))
+        return radiance;
+
+    // Terminate paths that can no longer contribute much with Russian
+    // roulette. The first bounces are always traced, since their throughput
+    // says little about the rest of the path.
+    float continueProbability = 1;
+    if (depth >= m_options.rouletteDepth) {
+        auto shouldContinue = random.russianRoulette(throughput);
+        if (!shouldContinue.value)
+            return radiance;
+        continueProbability = shouldContinue.probability;
+    }
+
+    // Choose BSDF to be used
     float transparencyProbability = totalTransparency / (totalDiffuse + totalSpecular + totalTransparency);
     auto transparentSample = random.flipCoin(transparencyProbability);
 
@@ -143,73 +203,148 @@ glm::vec4 Shader::shade(const SurfacePoint& surfacePoint, Random& random, int de
         transmittedRay.origin = surfacePoint.position + transmittedRay.direction * g_surfaceEpsilon;
         SurfacePoint result = m_raytracer->trace(transmittedRay);
 
-        return 1 / shouldContinue.probability *
-               1 / transparentSample.probability *
-               bsdf.evaluateSample(transmittedRay.direction) *
-               std::abs(glm::dot(surfacePoint.normal, transmittedRay.direction)) *
-               (radiance + shade(result, random, depth + 1, lightSamplingScheme));
+        glm::vec4 weight = 1 / continueProbability *
+                           1 / transparentSample.probability *
+                           bsdf.evaluateSample(transmittedRay.direction) *
+                           std::abs(glm::dot(surfacePoint.normal, transmittedRay.direction));
+        return radiance + weight * shade(result, random, depth + 1, lightSamplingScheme, throughput * weight,
+                                         guide, afterDiffuse, split);
     }
 
     float diffuseProbability = totalDiffuse / (totalDiffuse + totalSpecular);
     auto diffuseSample = random.flipCoin(diffuseProbability);
+    float weight = 1 / continueProbability *
+                   1 / transparentSample.probability *
+                   1 / diffuseSample.probability;
+
+    // Split the path at its first non-specular hit, so that the cost of the
+    // rays leading there is shared by several light samples and
+    // continuations.
+    int lightSamples = split ? 1 : std::max(1, m_options.lightSplit);
+    int indirectSamples = split ? 1 : std::max(1, m_options.indirectSplit);
 
     // Shade using the BSDF
     if (!diffuseSample.value) {
         if (material->specularExponent) {
             PhongBSDF bsdf(&surfacePoint, material->specular, material->specularExponent);
-            return 1 / shouldContinue.probability *
-                   1 / transparentSample.probability *
-                   1 / diffuseSample.probability *
-                   (radiance + shadeWithBSDF(bsdf, surfacePoint, random, depth, lightSamplingScheme));
+            return radiance + weight * shadeWithBSDF(bsdf, surfacePoint, random, depth, lightSamplingScheme,
+                                                     throughput * weight, lightSamples, indirectSamples,
+                                                     guide, false, afterDiffuse, true, nullptr);
         } else {
             IdealReflectorBSDF bsdf(&surfacePoint, material->specular);
-            return 1 / shouldContinue.probability *
-                   1 / transparentSample.probability *
-                   1 / diffuseSample.probability *
-                   (radiance + shadeWithBSDF(bsdf, surfacePoint, random, depth, lightSamplingScheme));
+            return radiance + weight * shadeWithBSDF(bsdf, surfacePoint, random, depth, lightSamplingScheme,
+                                                     throughput * weight, 1, 1, guide, false, afterDiffuse, split,
+                                                     nullptr);
         }
     }
 
+    // Paths that have already left a diffuse surface end at the next one if
+    // the cache knows the light reflected there.
+    glm::vec3 cachedRadiance;
+    if (m_cache && afterDiffuse && m_cache->lookup(surfacePoint, random, cachedRadiance))
+        return radiance + weight * material->diffuse * glm::vec4(cachedRadiance, 0);
+
     LambertBSDF bsdf(&surfacePoint, material->diffuse);
-    return 1 / shouldContinue.probability *
-           1 / transparentSample.probability *
-           1 / diffuseSample.probability *
-           (radiance + shadeWithBSDF(bsdf, surfacePoint, random, depth, lightSamplingScheme));
+    glm::vec4 reflectedRadiance;
+    const DirectionTree* directions =
+            guide && guide->sampling ? &guide->sampling->find(surfacePoint.position) : nullptr;
+    if (directions && directions->flux() > 0) {
+        GuidedBSDF guidedBSDF(&surfacePoint, bsdf, *directions, g_guideProbability);
+        reflectedRadiance = shadeWithBSDF(guidedBSDF, surfacePoint, random, depth, lightSamplingScheme,
+                                          throughput * weight, lightSamples, indirectSamples,
+                                          guide, true, true, true, reservoirs);
+    } else {
+        reflectedRadiance = shadeWithBSDF(bsdf, surfacePoint, random, depth, lightSamplingScheme,
+                                          throughput * weight, lightSamples, indirectSamples,
+                                          guide, guide != nullptr, true, true, reservoirs);
+    }
+
+    // The cache learns from the surfaces where the lookup missed, which
+    // keeps the first surfaces of the paths from contending for its cells.
+    // The light is stored per unit of albedo.
+    if (m_cache && afterDiffuse) {
+        glm::vec3 albedoRadiance;
+        for (int i = 0; i < 3; i++)
+            albedoRadiance[i] = material->diffuse[i] > 0 ? reflectedRadiance[i] / material->diffuse[i] : 0;
+        m_cache->record(surfacePoint, albedoRadiance);
+    }
+    return radiance + weight * reflectedRadiance;
 }
 
 glm::vec4 Shader::shadeWithBSDF(const BSDF& bsdf, const SurfacePoint& surfacePoint, Random& random,
-                                int depth, LightSamplingScheme lightSamplingScheme) const
+                                int depth, LightSamplingScheme lightSamplingScheme,
+                                const glm::vec4& throughput, int lightSamples, int indirectSamples,
+                                const PathGuide::Pass* guide, bool learn, bool afterDiffuse, bool split,
+                                LightReservoirs* reservoirs) const
 {
     const bool directLighting = true;
     glm::vec4 radiance;
 
-    // Sample all lights
-    if (directLighting)
-        radiance += sampleLights(m_scene->spheres,
-                                 surfacePoint, bsdf, random);
+    // A resampled light gets the only shadow ray. It accounts for all of the
+    // direct light, so the continuations are not weighted against it.
+    if (directLighting && reservoirs) {
+        const Sphere* light = nullptr;
+        glm::vec3 point;
+        glm::vec4 lightRadiance = reservoirs->sample(surfacePoint, m_lights, m_options.lightCandidates,
+                                                     random, light, point);
+        if (light) {
+            Ray shadowRay;
+            shadowRay.direction = glm::normalize(point - surfacePoint.position);
+            shadowRay.origin = surfacePoint.position + shadowRay.direction * g_surfaceEpsilon;
+            if (m_raytracer->canReach(shadowRay, *light))
+                radiance += lightRadiance;
+        }
+    }
 
-    // Generate new ray direction based on BSDF
-    RandomValue<glm::vec3> bsdfDirection = bsdf.generateSample(random);
-    if (!bsdfDirection.probability)
-        return radiance;
+    // Sample all lights. Each split sample keeps the weights of a single one,
+    // so the estimate is their average.
+    if (directLighting && !reservoirs) {
+        glm::vec4 lightRadiance;
+        for (int i = 0; i < lightSamples; i++)
+            lightRadiance += sampleLights(m_scene->spheres,
+                                          surfacePoint, bsdf, random);
+        radiance += lightRadiance / float(lightSamples);
+    }
 
-    // Trace
-    Ray ray;
-    ray.direction = bsdfDirection.value;
-    ray.origin = surfacePoint.position + ray.direction * g_surfaceEpsilon;
-    SurfacePoint result = m_raytracer->trace(ray);
-
-    // Calculate light probabilities in the BSDF direction
-    float lightProbability =
-        directLighting ? calculateLightProbabilities(m_scene->spheres,
-                                                     surfacePoint, bsdfDirection.value) : 0;
-
-    // Evaluate BSDF
-    radiance +=
-            1 / (lightProbability + bsdfDirection.probability) *
-            bsdf.evaluateSample(ray.direction) *
-            std::max(0.f, glm::dot(surfacePoint.normal, ray.direction)) *
-            shade(result, random, depth + 1, directLighting ? SampleNonEmissiveObjects : SampleAllObjects);
+    glm::vec4 indirectRadiance;
+    for (int i = 0; i < indirectSamples; i++) {
+        // Generate new ray direction based on BSDF
+        RandomValue<glm::vec3> bsdfDirection = bsdf.generateSample(random);
+        float cosine = glm::dot(surfacePoint.normal, bsdfDirection.value);
+        if (!bsdfDirection.probability || cosine <= 0)
+            continue;
+
+        // Trace
+        Ray ray;
+        ray.direction = bsdfDirection.value;
+        ray.origin = surfacePoint.position + ray.direction * g_surfaceEpsilon;
+        SurfacePoint result = m_raytracer->trace(ray);
+
+        // Calculate light probabilities in the BSDF direction
+        float lightProbability =
+            directLighting && !reservoirs ? calculateLightProbabilities(m_scene->spheres, surfacePoint,
+                                                                        bsdfDirection.value) : 0;
+
+        // Evaluate BSDF. Each continuation keeps the whole throughput of the
+        // path, so that Russian roulette does not undo the split.
+        glm::vec4 weight =
+                1 / (lightProbability + bsdfDirection.probability) *
+                bsdf.evaluateSample(ray.direction) * cosine;
+        glm::vec4 incidentRadiance = shade(result, random, depth + 1,
+                                           directLighting ? SampleNonEmissiveObjects : SampleAllObjects,
+                                           throughput * weight, learn ? nullptr : guide, afterDiffuse, split);
+        indirectRadiance += weight * incidentRadiance;
+
+        // The guide learns the indirect light, since the lights are sampled
+        // directly anyway.
+        if (learn) {
+            float luminance = .2126f * incidentRadiance.x + .7152f * incidentRadiance.y +
+                              .0722f * incidentRadiance.z;
+            m_guide->record(*guide, surfacePoint.position, ray.direction,
+                            luminance / bsdfDirection.probability);
+        }
+    }
+    radiance += indirectRadiance / float(indirectSamples);
 
     return radiance;
 }
@@ -2,6 +2,11 @@
 #ifndef CPU_SHADER_H
 #define CPU_SHADER_H
 
+#include "Integrator.h"
+#include "LightDistribution.h"
+#include "Options.h"
+#include "PathGuide.h"
+#include "RadianceCache.h"
 #include "Scene.h"
 #include "Random.h"
 #include "Ray.h"
@@ -13,7 +18,9 @@
 namespace cpu
 {
 
+class LightReservoirs;
 class Material;
+class PinholeCamera;
 class Sphere;
 class Plane;
 class PointLight;
@@ -23,10 +30,24 @@ class Random;
 class Raytracer;
 class SurfacePoint;
 
-class Shader
+/**
+ *  Unidirectional path tracer with next event estimation and multiple
+ *  importance sampling of the lights and the BSDFs. Diffuse surfaces may
+ *  also sample the incident light learned by a PathGuide, and paths may end
+ *  early at diffuse surfaces whose light is known by a RadianceCache. The
+ *  direct light of the first diffuse hit may be resampled from the choices
+ *  of nearby samples kept in LightReservoirs instead.
+ */
+class Shader: public Integrator
 {
 public:
-    Shader(Scene* scene, Raytracer* raytracer);
+    Shader(Scene* scene, Raytracer* raytracer, const PinholeCamera* camera, const Options& options);
+
+    std::shared_ptr<const PassState> beginPass(int pass) const override;
+    std::unique_ptr<ThreadState> createThreadState(Random& random, int width, int height) const override;
+    glm::vec4 radiance(const SurfacePoint& surfacePoint, Random& random,
+                       const PassState* passState, ThreadState* threadState) const override;
+    std::string statistics() const override;
 
     enum LightSamplingScheme
     {
@@ -34,10 +55,38 @@ public:
         SampleAllObjects,
     };
 
-    glm::vec4 shade(const SurfacePoint&, Random&, int depth = 0, LightSamplingScheme = SampleAllObjects) const;
+    /**
+     *  Returns the radiance leaving |surfacePoint| towards the viewer.
+     *  |throughput| is the weight of the path so far, which drives Russian
+     *  roulette. The first diffuse surface of the path is guided by the
+     *  trees of |guide|, if given. The surfaces after it are left alone, as
+     *  their noise is damped by the first bounce and guiding them costs
+     *  more than it saves. |afterDiffuse| is set once the path has left a
+     *  diffuse surface, after which it may end at the next diffuse surface
+     *  with the light of the radiance cache. |split| is set once the path
+     *  has been split at a diffuse or glossy surface, which happens only
+     *  once per path. If |reservoirs| are given, the direct light of a
+     *  diffuse |surfacePoint| is resampled with them.
+     */
+    glm::vec4 shade(const SurfacePoint& surfacePoint, Random&, int depth = 0,
+                    LightSamplingScheme = SampleAllObjects, const glm::vec4& throughput = glm::vec4(1),
+                    const PathGuide::Pass* guide = nullptr, bool afterDiffuse = false,
+                    bool split = false, LightReservoirs* reservoirs = nullptr) const;
 
 private:
-    glm::vec4 shadeWithBSDF(const BSDF&, const SurfacePoint&, Random&, int depth, LightSamplingScheme) const;
+    /**
+     *  Shades |surfacePoint| with |bsdf| using |lightSamples| samples of the
+     *  lights and |indirectSamples| continuations of the path. If |learn|
+     *  is set, the light found by the continuations is recorded into the
+     *  training tree of |guide|, and the continuations are not guided.
+     *  |afterDiffuse| and |split| are passed on to the continuations. If
+     *  |reservoirs| are given, they choose the light of a single sample
+     *  instead.
+     */
+    glm::vec4 shadeWithBSDF(const BSDF&, const SurfacePoint&, Random&, int depth, LightSamplingScheme,
+                            const glm::vec4& throughput, int lightSamples, int indirectSamples,
+                            const PathGuide::Pass* guide, bool learn, bool afterDiffuse, bool split,
+                            LightReservoirs* reservoirs) const;
 
     template <typename ObjectType>
     glm::vec4 sampleLights(const std::vector<ObjectType>& lights,
@@ -49,6 +98,10 @@ private:
 
     Scene* m_scene;
     Raytracer* m_raytracer;
+    Options m_options;
+    std::unique_ptr<PathGuide> m_guide;
+    std::unique_ptr<RadianceCache> m_cache;
+    LightDistribution m_lights;
 };
 
 }
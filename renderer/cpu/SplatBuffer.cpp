@@ -0,0 +1,74 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#include "SplatBuffer.h"
+#include "renderer/Image.h"
+
+using namespace cpu;
+
+namespace
+{
+
+void atomicAdd(std::atomic<float>& target, float value)
+{
+    float current = target.load(std::memory_order_relaxed);
+    while (!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed))
+        ;
+}
+
+}
+
+SplatBuffer::SplatBuffer():
+    m_width(0),
+    m_height(0),
+    m_frameHeight(0),
+    m_frameTop(0),
+    m_samples(0)
+{
+}
+
+void SplatBuffer::prepare(const Image& image)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_values && image.width == m_width && image.height == m_height &&
+        image.frameHeight == m_frameHeight && image.frameTop == m_frameTop)
+        return;
+
+    m_width = image.width;
+    m_height = image.height;
+    m_frameHeight = image.frameHeight;
+    m_frameTop = image.frameTop;
+    m_values.reset(new std::atomic<float>[m_width * m_height * 3]());
+    m_samples = 0;
+}
+
+void SplatBuffer::add(float filmX, float filmY, const glm::vec3& radiance)
+{
+    int x = static_cast<int>(filmX * m_width);
+    int y = m_frameHeight - 1 - static_cast<int>(filmY * m_frameHeight) - m_frameTop;
+    if (x < 0 || x >= m_width || y < 0 || y >= m_height)
+        return;
+
+    std::atomic<float>* value = &m_values[(y * m_width + x) * 3];
+    atomicAdd(value[0], radiance.x);
+    atomicAdd(value[1], radiance.y);
+    atomicAdd(value[2], radiance.z);
+}
+
+void SplatBuffer::addSample()
+{
+    m_samples.fetch_add(1, std::memory_order_relaxed);
+}
+
+glm::vec3 SplatBuffer::radiance(int x, int y) const
+{
+    long long samples = m_samples.load(std::memory_order_relaxed);
+    y -= m_frameTop;
+    if (!samples || x < 0 || x >= m_width || y < 0 || y >= m_height)
+        return glm::vec3();
+
+    // A pixel covers 1 / (width * frameHeight) of the film.
+    const std::atomic<float>* value = &m_values[(y * m_width + x) * 3];
+    float scale = float(m_width) * m_frameHeight / samples;
+    return glm::vec3(value[0].load(std::memory_order_relaxed),
+                     value[1].load(std::memory_order_relaxed),
+                     value[2].load(std::memory_order_relaxed)) * scale;
+}
@@ -0,0 +1,68 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_SPLATBUFFER_H
+#define CPU_SPLATBUFFER_H
+
+#include "renderer/Util.h"
+
+#include <atomic>
+#include <glm/glm.hpp>
+#include <memory>
+#include <mutex>
+
+class Image;
+
+namespace cpu
+{
+
+/**
+ *  Radiance added to pixels that were not the source of the sample, such as
+ *  light paths connected to the camera. The render threads add to it
+ *  concurrently. Each pixel holds the sum of its splats, which is divided by
+ *  the number of samples that could have splatted, so every pixel is an
+ *  estimate that converges as samples are added anywhere on the image.
+ */
+class SplatBuffer: public NonCopyable
+{
+public:
+    static const size_t bytesPerPixel = 3 * sizeof(float);
+
+    SplatBuffer();
+
+    /**
+     *  Prepares the buffer for rendering into |image|. The splats are cleared
+     *  if they were gathered for another part of the frame. Must not be
+     *  called while samples for another part are being added.
+     */
+    void prepare(const Image& image);
+
+    /**
+     *  Adds |radiance| to the pixel at the given film position. |radiance| is
+     *  the contribution of a single sample to a pixel covering the whole film;
+     *  splats outside the prepared image are dropped.
+     */
+    void add(float filmX, float filmY, const glm::vec3& radiance);
+
+    /**
+     *  Counts a sample that could have added splats.
+     */
+    void addSample();
+
+    /**
+     *  Returns the splatted radiance of the pixel at |x|, |y| in frame
+     *  coordinates.
+     */
+    glm::vec3 radiance(int x, int y) const;
+
+private:
+    std::mutex m_mutex;
+    int m_width;
+    int m_height;
+    int m_frameHeight;
+    int m_frameTop;
+    std::unique_ptr<std::atomic<float>[]> m_values;
+    std::atomic<long long> m_samples;
+};
+
+}
+
+#endif
@@ -0,0 +1,289 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#include "WideBVH.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using namespace cpu;
+
+namespace
+{
+
+float surfaceArea(const scene::BVHNode& node)
+{
+    glm::vec3 size = node.max - node.min;
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+/**
+ *  Gathers the children of the wide node replacing the binary node |index| by
+ *  repeatedly opening the inner child with the largest surface area, which is
+ *  the one most likely to be hit. Returns the number of children.
+ */
+int gatherChildren(const scene::BVHNode* binaryNodes, uint32_t index, uint32_t children[4])
+{
+    int childCount = 0;
+    if (binaryNodes[index].isLeaf())
+    {
+        children[childCount++] = index;
+        return childCount;
+    }
+    children[childCount++] = index + 1;
+    children[childCount++] = binaryNodes[index].offset;
+
+    while (childCount < 4)
+    {
+        int largest = -1;
+        for (int i = 0; i < childCount; i++)
+        {
+            const scene::BVHNode& child = binaryNodes[children[i]];
+            if (!child.isLeaf() &&
+                (largest < 0 || surfaceArea(child) > surfaceArea(binaryNodes[children[largest]])))
+                largest = i;
+        }
+        if (largest < 0)
+            break;
+        uint32_t opened = children[largest];
+        children[largest] = opened + 1;
+        children[childCount++] = binaryNodes[opened].offset;
+    }
+    return childCount;
+}
+
+/**
+ *  Returns the number of wide nodes replacing the subtree under the binary
+ *  node |index| and sets |depth| to the number of wide nodes on its longest
+ *  path. Also checks whether all leaves fit a quantized child reference.
+ */
+size_t countNodes(const scene::BVHNode* binaryNodes, uint32_t index, bool& quantizable, int& depth)
+{
+    uint32_t children[4];
+    int childCount = gatherChildren(binaryNodes, index, children);
+    size_t count = 1;
+    depth = 1;
+    for (int i = 0; i < childCount; i++)
+    {
+        const scene::BVHNode& child = binaryNodes[children[i]];
+        if (!child.isLeaf())
+        {
+            int childDepth;
+            count += countNodes(binaryNodes, children[i], quantizable, childDepth);
+            depth = std::max(depth, childDepth + 1);
+        }
+        else if (child.count >> QuantizedWideBVHNode::leafCountBits ||
+                 child.offset >> (32 - QuantizedWideBVHNode::leafCountBits))
+            quantizable = false;
+    }
+    return count;
+}
+
+void setChildren(WideBVHNode& node, const scene::BVHNode* const children[4], int childCount)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            node.bounds[axis][0][i] = i < childCount ? children[i]->min[axis] : FLT_MAX;
+            node.bounds[axis][1][i] = i < childCount ? children[i]->max[axis] : -FLT_MAX;
+        }
+    }
+    memset(node.child, 0, sizeof(node.child));
+    memset(node.count, 0, sizeof(node.count));
+}
+
+void setChild(WideBVHNode& node, int i, uint32_t index, uint32_t primitiveCount)
+{
+    node.child[i] = index;
+    node.count[i] = primitiveCount;
+}
+
+void setChildren(QuantizedWideBVHNode& node, const scene::BVHNode* const children[4], int childCount)
+{
+    scene::AABB box;
+    for (int i = 0; i < childCount; i++)
+        box.extend(scene::AABB(children[i]->min, children[i]->max));
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        // Round the step up until it covers the whole box.
+        float origin = box.min[axis];
+        float extent = box.max[axis] - origin;
+        float scale = extent > 0 ? extent / 255 : 1;
+        while (origin + 255 * scale < box.max[axis])
+            scale = nextafterf(scale, FLT_MAX);
+        node.origin[axis] = origin;
+        node.scale[axis] = scale;
+
+        for (int i = 0; i < 4; i++)
+        {
+            if (i >= childCount)
+            {
+                node.bounds[axis][0][i] = 255;
+                node.bounds[axis][1][i] = 0;
+                continue;
+            }
+            // Round outwards so that the quantized box contains the child.
+            int low = std::max(0, int(floorf((children[i]->min[axis] - origin) / scale)));
+            int high = std::min(255, int(ceilf((children[i]->max[axis] - origin) / scale)));
+            while (low > 0 && origin + low * scale > children[i]->min[axis])
+                low--;
+            while (high < 255 && origin + high * scale < children[i]->max[axis])
+                high++;
+            node.bounds[axis][0][i] = low;
+            node.bounds[axis][1][i] = high;
+        }
+    }
+    memset(node.child, 0, sizeof(node.child));
+}
+
+void setChild(QuantizedWideBVHNode& node, int i, uint32_t index, uint32_t primitiveCount)
+{
+    node.child[i] = (index << QuantizedWideBVHNode::leafCountBits) | primitiveCount;
+}
+
+/**
+ *  Collapses the subtree under the binary node |index| into wide nodes
+ *  written in depth first order from |nodes[nodeCount]|, and returns the
+ *  index of the first one.
+ */
+template <typename NodeType>
+uint32_t collapse(const scene::BVHNode* binaryNodes, uint32_t index,
+                  NodeType* nodes, size_t& nodeCount)
+{
+    uint32_t children[4];
+    int childCount = gatherChildren(binaryNodes, index, children);
+    const scene::BVHNode* childNodes[4];
+    for (int i = 0; i < childCount; i++)
+        childNodes[i] = &binaryNodes[children[i]];
+
+    uint32_t nodeIndex = nodeCount++;
+    NodeType& node = nodes[nodeIndex];
+    setChildren(node, childNodes, childCount);
+    for (int i = 0; i < childCount; i++)
+    {
+        if (childNodes[i]->isLeaf())
+            setChild(node, i, childNodes[i]->offset, childNodes[i]->count);
+        else
+            setChild(node, i, collapse(binaryNodes, children[i], nodes, nodeCount), 0);
+    }
+    return nodeIndex;
+}
+
+// Collapses |bvh| into a node array allocated with the alignment of the node
+// type, which the default allocator does not honor.
+template <typename NodeType>
+std::shared_ptr<const NodeType> collapse(const scene::BVH& bvh, size_t nodeCount)
+{
+    void* storage = nullptr;
+    if (posix_memalign(&storage, alignof(NodeType), nodeCount * sizeof(NodeType)))
+        throw std::bad_alloc();
+    NodeType* nodes = static_cast<NodeType*>(storage);
+    std::shared_ptr<const NodeType> result(nodes, free);
+
+    size_t writtenCount = 0;
+    collapse(bvh.nodes(), 0, nodes, writtenCount);
+    return result;
+}
+
+}
+
+PacketFrustum::PacketFrustum(const RayPacket& packet):
+    packet(&packet),
+    origin(packet.rays[0].origin)
+{
+    const Ray& first = packet.rays[0];
+    glm::vec3 invDirectionLow = 1.f / first.direction;
+    glm::vec3 invDirectionHigh = invDirectionLow;
+    minDistance = first.minDistance;
+    for (int i = 1; i < packet.size; i++)
+    {
+        glm::vec3 invDirection = 1.f / packet.rays[i].direction;
+        invDirectionLow = glm::min(invDirectionLow, invDirection);
+        invDirectionHigh = glm::max(invDirectionHigh, invDirection);
+        minDistance = std::min(minDistance, packet.rays[i].minDistance);
+    }
+
+    originX = _mm_set1_ps(first.origin.x);
+    originY = _mm_set1_ps(first.origin.y);
+    originZ = _mm_set1_ps(first.origin.z);
+    invDirectionLowX = _mm_set1_ps(invDirectionLow.x);
+    invDirectionLowY = _mm_set1_ps(invDirectionLow.y);
+    invDirectionLowZ = _mm_set1_ps(invDirectionLow.z);
+    invDirectionHighX = _mm_set1_ps(invDirectionHigh.x);
+    invDirectionHighY = _mm_set1_ps(invDirectionHigh.y);
+    invDirectionHighZ = _mm_set1_ps(invDirectionHigh.z);
+    nearX = first.direction.x < 0;
+    nearY = first.direction.y < 0;
+    nearZ = first.direction.z < 0;
+
+    for (int group = 0; group < RayPacket::maxSize / 4; group++)
+    {
+        const Ray* rays = &packet.rays[group * 4];
+        invDirectionX[group] = _mm_div_ps(_mm_set1_ps(1.f), _mm_setr_ps(rays[0].direction.x, rays[1].direction.x,
+                                                                       rays[2].direction.x, rays[3].direction.x));
+        invDirectionY[group] = _mm_div_ps(_mm_set1_ps(1.f), _mm_setr_ps(rays[0].direction.y, rays[1].direction.y,
+                                                                       rays[2].direction.y, rays[3].direction.y));
+        invDirectionZ[group] = _mm_div_ps(_mm_set1_ps(1.f), _mm_setr_ps(rays[0].direction.z, rays[1].direction.z,
+                                                                       rays[2].direction.z, rays[3].direction.z));
+    }
+}
+
+float PacketFrustum::maxDistance() const
+{
+    float distance = packet->rays[0].maxDistance;
+    for (int i = 1; i < packet->size; i++)
+        distance = std::max(distance, packet->rays[i].maxDistance);
+    return distance;
+}
+
+WideBVH::WideBVH():
+    m_nodeCount(0),
+    m_stackSize(0)
+{
+}
+
+WideBVH::WideBVH(const scene::BVH& bvh, Format format):
+    m_nodeCount(0),
+    m_stackSize(0),
+    m_bvh(bvh)
+{
+    if (bvh.empty())
+        return;
+
+    // Each wide node on the way down leaves at most three of its children
+    // on the traversal stack, and the last one briefly needs room for four.
+    bool quantizable = true;
+    int depth;
+    m_nodeCount = countNodes(bvh.nodes(), 0, quantizable, depth);
+    m_stackSize = 3 * depth + 1;
+    if (format == Format::Automatic)
+        format = bvh.indexCount() >= quantizationThreshold ? Format::Quantized : Format::Full;
+    if (format == Format::Quantized && quantizable)
+        m_quantizedNodes = collapse<QuantizedWideBVHNode>(bvh, m_nodeCount);
+    else
+        m_nodes = collapse<WideBVHNode>(bvh, m_nodeCount);
+}
+
+bool WideBVH::empty() const
+{
+    return !m_nodeCount;
+}
+
+bool WideBVH::quantized() const
+{
+    return m_quantizedNodes != nullptr;
+}
+
+size_t WideBVH::nodeCount() const
+{
+    return m_nodeCount;
+}
+
+const uint32_t* WideBVH::indices() const
+{
+    return m_bvh.indices();
+}
@@ -0,0 +1,457 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef CPU_WIDEBVH_H
+#define CPU_WIDEBVH_H
+
+#include "Ray.h"
+#include "RayPacket.h"
+#include "scene/BVH.h"
+
+#include <emmintrin.h>
+#include <glm/glm.hpp>
+#include <memory>
+#include <stdint.h>
+
+namespace cpu
+{
+
+/**
+ *  Ray prepared for testing against the children of wide nodes.
+ */
+class WideRay
+{
+public:
+    explicit WideRay(const Ray& ray):
+        ray(&ray),
+        originX(_mm_set1_ps(ray.origin.x)),
+        originY(_mm_set1_ps(ray.origin.y)),
+        originZ(_mm_set1_ps(ray.origin.z)),
+        invDirectionX(_mm_set1_ps(1.f / ray.direction.x)),
+        invDirectionY(_mm_set1_ps(1.f / ray.direction.y)),
+        invDirectionZ(_mm_set1_ps(1.f / ray.direction.z)),
+        nearX(ray.direction.x < 0),
+        nearY(ray.direction.y < 0),
+        nearZ(ray.direction.z < 0)
+    {
+    }
+
+    float maxDistance() const
+    {
+        return ray->maxDistance;
+    }
+
+    /**
+     *  Returns a mask of the children of |node| hit by the ray closer than
+     *  |maxDistance| and stores their entry distances in |tMin|.
+     */
+    template <typename NodeType>
+    int intersect(const NodeType& node, __m128& tMin, float maxDistance) const
+    {
+        tMin = _mm_set1_ps(ray->minDistance);
+        return node.intersect(*this, tMin, _mm_set1_ps(maxDistance));
+    }
+
+    template <typename NodeType>
+    uint32_t leafRays(const NodeType&, int) const
+    {
+        return 1;
+    }
+
+    template <typename LeafVisitor>
+    bool visitLeaf(LeafVisitor& visitor, uint32_t first, uint32_t count, uint32_t) const
+    {
+        return visitor(first, count);
+    }
+
+    const Ray* ray;
+    __m128 originX, originY, originZ;
+    __m128 invDirectionX, invDirectionY, invDirectionZ;
+
+    // The near plane of each axis is fixed by the sign of the direction, so
+    // the slabs need no sorting.
+    int nearX, nearY, nearZ;
+};
+
+/**
+ *  Frustum bounding a coherent ray packet. Since the rays share their origin
+ *  and direction signs, the entry and exit distances of a box are bounded by
+ *  evaluating the slabs at the extremes of the inverse direction components.
+ *  A box missed by the frustum is missed by every ray in the packet.
+ */
+class PacketFrustum
+{
+public:
+    explicit PacketFrustum(const RayPacket& packet);
+
+    float maxDistance() const;
+
+    template <typename NodeType>
+    int intersect(const NodeType& node, __m128& tMin, float maxDistance) const
+    {
+        tMin = _mm_set1_ps(minDistance);
+        __m128 tMax = _mm_set1_ps(maxDistance);
+        clip(node.plane(0, nearX), node.plane(0, 1 - nearX), originX, invDirectionLowX, invDirectionHighX, tMin, tMax);
+        clip(node.plane(1, nearY), node.plane(1, 1 - nearY), originY, invDirectionLowY, invDirectionHighY, tMin, tMax);
+        clip(node.plane(2, nearZ), node.plane(2, 1 - nearZ), originZ, invDirectionLowZ, invDirectionHighZ, tMin, tMax);
+        return _mm_movemask_ps(_mm_cmple_ps(tMin, tMax));
+    }
+
+    /**
+     *  Returns a mask of the rays that hit the child |lane| of |node|, so
+     *  that leaves are only intersected with the rays that reach them.
+     */
+    template <typename NodeType>
+    uint32_t leafRays(const NodeType& node, int lane) const
+    {
+        __m128 nearOffsetX = _mm_set1_ps(node.bound(0, nearX, lane) - origin.x);
+        __m128 nearOffsetY = _mm_set1_ps(node.bound(1, nearY, lane) - origin.y);
+        __m128 nearOffsetZ = _mm_set1_ps(node.bound(2, nearZ, lane) - origin.z);
+        __m128 farOffsetX = _mm_set1_ps(node.bound(0, 1 - nearX, lane) - origin.x);
+        __m128 farOffsetY = _mm_set1_ps(node.bound(1, 1 - nearY, lane) - origin.y);
+        __m128 farOffsetZ = _mm_set1_ps(node.bound(2, 1 - nearZ, lane) - origin.z);
+
+        uint32_t mask = 0;
+        for (int group = 0; group * 4 < packet->size; group++)
+        {
+            const Ray* rays = &packet->rays[group * 4];
+            __m128 tMin = _mm_setr_ps(rays[0].minDistance, rays[1].minDistance,
+                                      rays[2].minDistance, rays[3].minDistance);
+            __m128 tMax = _mm_setr_ps(rays[0].maxDistance, rays[1].maxDistance,
+                                      rays[2].maxDistance, rays[3].maxDistance);
+            tMin = _mm_max_ps(tMin, _mm_mul_ps(nearOffsetX, invDirectionX[group]));
+            tMin = _mm_max_ps(tMin, _mm_mul_ps(nearOffsetY, invDirectionY[group]));
+            tMin = _mm_max_ps(tMin, _mm_mul_ps(nearOffsetZ, invDirectionZ[group]));
+            tMax = _mm_min_ps(tMax, _mm_mul_ps(farOffsetX, invDirectionX[group]));
+            tMax = _mm_min_ps(tMax, _mm_mul_ps(farOffsetY, invDirectionY[group]));
+            tMax = _mm_min_ps(tMax, _mm_mul_ps(farOffsetZ, invDirectionZ[group]));
+            mask |= _mm_movemask_ps(_mm_cmple_ps(tMin, tMax)) << (group * 4);
+        }
+        return mask & ((1u << packet->size) - 1);
+    }
+
+    template <typename LeafVisitor>
+    bool visitLeaf(LeafVisitor& visitor, uint32_t first, uint32_t count, uint32_t rays) const
+    {
+        return visitor(first, count, rays);
+    }
+
+    const RayPacket* packet;
+    glm::vec3 origin;
+    __m128 originX, originY, originZ;
+    __m128 invDirectionLowX, invDirectionLowY, invDirectionLowZ;
+    __m128 invDirectionHighX, invDirectionHighY, invDirectionHighZ;
+    int nearX, nearY, nearZ;
+    float minDistance;
+
+    // Inverse directions of the rays in groups of four.
+    __m128 invDirectionX[RayPacket::maxSize / 4];
+    __m128 invDirectionY[RayPacket::maxSize / 4];
+    __m128 invDirectionZ[RayPacket::maxSize / 4];
+
+private:
+    static void clip(__m128 nearPlane, __m128 farPlane, __m128 origin,
+                     __m128 invDirectionLow, __m128 invDirectionHigh,
+                     __m128& tMin, __m128& tMax)
+    {
+        __m128 nearOffset = _mm_sub_ps(nearPlane, origin);
+        __m128 farOffset = _mm_sub_ps(farPlane, origin);
+        tMin = _mm_max_ps(tMin, _mm_min_ps(_mm_mul_ps(nearOffset, invDirectionLow),
+                                           _mm_mul_ps(nearOffset, invDirectionHigh)));
+        tMax = _mm_min_ps(tMax, _mm_max_ps(_mm_mul_ps(farOffset, invDirectionLow),
+                                           _mm_mul_ps(farOffset, invDirectionHigh)));
+    }
+};
+
+/**
+ *  Node with four children. The child bounds are stored as a structure of
+ *  arrays, |bounds[axis][0]| holding the minimum and |bounds[axis][1]| the
+ *  maximum of each child, so that a ray can be tested against all children at
+ *  once. For inner children |child| is a node index and |count| is zero; for
+ *  leaves |child| is the first entry in the primitive index list and |count|
+ *  is non-zero. Unused slots have inverted bounds which no ray can hit.
+ */
+struct alignas(32) WideBVHNode
+{
+    /**
+     *  Returns a mask of the children hit within [|tMin|, |tMax|] and stores
+     *  their entry distances in |tMin|.
+     */
+    int intersect(const WideRay& ray, __m128& tMin, __m128 tMax) const
+    {
+        tMin = _mm_max_ps(tMin, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds[0][ray.nearX]), ray.originX), ray.invDirectionX));
+        tMax = _mm_min_ps(tMax, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds[0][1 - ray.nearX]), ray.originX), ray.invDirectionX));
+        tMin = _mm_max_ps(tMin, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds[1][ray.nearY]), ray.originY), ray.invDirectionY));
+        tMax = _mm_min_ps(tMax, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds[1][1 - ray.nearY]), ray.originY), ray.invDirectionY));
+        tMin = _mm_max_ps(tMin, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds[2][ray.nearZ]), ray.originZ), ray.invDirectionZ));
+        tMax = _mm_min_ps(tMax, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds[2][1 - ray.nearZ]), ray.originZ), ray.invDirectionZ));
+        return _mm_movemask_ps(_mm_cmple_ps(tMin, tMax));
+    }
+
+    void getChild(int i, uint32_t& index, uint32_t& primitiveCount) const
+    {
+        index = child[i];
+        primitiveCount = count[i];
+    }
+
+    __m128 plane(int axis, int side) const
+    {
+        return _mm_load_ps(bounds[axis][side]);
+    }
+
+    float bound(int axis, int side, int lane) const
+    {
+        return bounds[axis][side][lane];
+    }
+
+    float bounds[3][2][4];
+    uint32_t child[4];
+    uint32_t count[4];
+};
+
+/**
+ *  Wide node at half the size of WideBVHNode. The child bounds are quantized
+ *  to eight bits within the box spanned by |origin| and |origin + 255 *
+ *  scale|, rounding outwards. Each child reference packs the node index, or
+ *  the first primitive index and the primitive count of a leaf, into one
+ *  word. Unused slots have inverted bounds like in WideBVHNode. Each node
+ *  fills exactly one cache line.
+ */
+struct alignas(64) QuantizedWideBVHNode
+{
+    static const int leafCountBits = 4;
+
+    int intersect(const WideRay& ray, __m128& tMin, __m128 tMax) const
+    {
+        intersectSlabs(0, ray.nearX, ray.originX, ray.invDirectionX, tMin, tMax);
+        intersectSlabs(1, ray.nearY, ray.originY, ray.invDirectionY, tMin, tMax);
+        intersectSlabs(2, ray.nearZ, ray.originZ, ray.invDirectionZ, tMin, tMax);
+        return _mm_movemask_ps(_mm_cmple_ps(tMin, tMax));
+    }
+
+    void getChild(int i, uint32_t& index, uint32_t& primitiveCount) const
+    {
+        index = child[i] >> leafCountBits;
+        primitiveCount = child[i] & ((1 << leafCountBits) - 1);
+    }
+
+    __m128 plane(int axis, int side) const
+    {
+        __m128i zero = _mm_setzero_si128();
+        __m128i bytes = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(bounds[axis])), zero);
+        __m128 q = _mm_cvtepi32_ps(side ? _mm_unpackhi_epi16(bytes, zero) : _mm_unpacklo_epi16(bytes, zero));
+        return _mm_add_ps(_mm_set1_ps(origin[axis]), _mm_mul_ps(q, _mm_set1_ps(scale[axis])));
+    }
+
+    float bound(int axis, int side, int lane) const
+    {
+        return origin[axis] + bounds[axis][side][lane] * scale[axis];
+    }
+
+    // Decodes the child bounds along |axis| and clips [|tMin|, |tMax|] to them.
+    // The planes are decoded before the ray origin is subtracted, like in
+    // WideBVHNode. Folding the origin and scale into the inverse direction
+    // would multiply zeros by the infinite inverse direction of rays parallel
+    // to the axis.
+    void intersectSlabs(int axis, int near, __m128 rayOrigin, __m128 invDirection,
+                        __m128& tMin, __m128& tMax) const
+    {
+        __m128i zero = _mm_setzero_si128();
+        __m128i bytes = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(bounds[axis])), zero);
+        __m128 planes[2] =
+        {
+            _mm_cvtepi32_ps(_mm_unpacklo_epi16(bytes, zero)),
+            _mm_cvtepi32_ps(_mm_unpackhi_epi16(bytes, zero))
+        };
+        __m128 base = _mm_set1_ps(origin[axis]);
+        __m128 step = _mm_set1_ps(scale[axis]);
+        __m128 nearPlane = _mm_add_ps(base, _mm_mul_ps(planes[near], step));
+        __m128 farPlane = _mm_add_ps(base, _mm_mul_ps(planes[1 - near], step));
+        tMin = _mm_max_ps(tMin, _mm_mul_ps(_mm_sub_ps(nearPlane, rayOrigin), invDirection));
+        tMax = _mm_min_ps(tMax, _mm_mul_ps(_mm_sub_ps(farPlane, rayOrigin), invDirection));
+    }
+
+    float origin[3];
+    float scale[3];
+    uint8_t bounds[3][2][4];
+    uint32_t child[4];
+};
+
+/**
+ *  Four-wide bounding volume hierarchy collapsed from a binary one. The leaves
+ *  and the primitive index list are those of the binary hierarchy, which is
+ *  kept alive by the wide one. Hierarchies over many primitives use quantized
+ *  nodes, which halves the memory and bandwidth taken by the nodes.
+ */
+class WideBVH
+{
+public:
+    enum class Format
+    {
+        Automatic,
+        Full,
+        Quantized
+    };
+
+    // Primitive count from which the automatic format is quantized.
+    static const size_t quantizationThreshold = 1 << 20;
+
+    WideBVH();
+    explicit WideBVH(const scene::BVH& bvh, Format format = Format::Automatic);
+
+    bool empty() const;
+    bool quantized() const;
+    size_t nodeCount() const;
+    const uint32_t* indices() const;
+
+    /**
+     *  Visits the leaves hit by |ray| in front to back order of their entry
+     *  distances. |visitLeaf(first, count)| may shorten the ray to prune the
+     *  remaining nodes, or return true to end the traversal.
+     */
+    template <typename LeafVisitor>
+    void traverse(const Ray& ray, LeafVisitor visitLeaf) const;
+
+    /**
+     *  Visits the leaves hit by any ray of a coherent |packet|.
+     *  |visitLeaf(first, count, rays)| receives a mask of the rays that hit
+     *  the leaf. Nodes are pruned against the farthest of the ray distances.
+     */
+    template <typename LeafVisitor>
+    void traverse(const RayPacket& packet, LeafVisitor visitLeaf) const;
+
+private:
+    // Deferred child of the traversal.
+    struct StackEntry
+    {
+        uint32_t child;
+        uint32_t count;
+        uint32_t rays;
+        float distance;
+    };
+
+    // Traversal stacks up to this size live on the call stack. Deeper
+    // hierarchies, which the builder only makes from pathological input, get
+    // a heap allocated stack instead.
+    static const int fixedStackSize = 128;
+
+    template <typename Query, typename LeafVisitor>
+    void traverseNodes(const Query& query, LeafVisitor visitLeaf) const;
+
+    template <typename Query, typename LeafVisitor>
+    void traverseNodes(const Query& query, LeafVisitor visitLeaf, StackEntry* stack) const;
+
+    template <typename NodeType, typename Query, typename LeafVisitor>
+    static void traverse(const NodeType* nodes, const Query& query, LeafVisitor visitLeaf, StackEntry* stack);
+
+    std::shared_ptr<const WideBVHNode> m_nodes;
+    std::shared_ptr<const QuantizedWideBVHNode> m_quantizedNodes;
+    size_t m_nodeCount;
+    // Entries the traversal stack needs at most.
+    int m_stackSize;
+    scene::BVH m_bvh;
+};
+
+template <typename LeafVisitor>
+void WideBVH::traverse(const Ray& ray, LeafVisitor visitLeaf) const
+{
+    traverseNodes(WideRay(ray), visitLeaf);
+}
+
+template <typename LeafVisitor>
+void WideBVH::traverse(const RayPacket& packet, LeafVisitor visitLeaf) const
+{
+    traverseNodes(PacketFrustum(packet), visitLeaf);
+}
+
+template <typename Query, typename LeafVisitor>
+void WideBVH::traverseNodes(const Query& query, LeafVisitor visitLeaf) const
+{
+    if (m_stackSize <= fixedStackSize)
+    {
+        StackEntry stack[fixedStackSize];
+        traverseNodes(query, visitLeaf, stack);
+    }
+    else
+    {
+        std::unique_ptr<StackEntry[]> stack(new StackEntry[m_stackSize]);
+        traverseNodes(query, visitLeaf, stack.get());
+    }
+}
+
+template <typename Query, typename LeafVisitor>
+void WideBVH::traverseNodes(const Query& query, LeafVisitor visitLeaf, StackEntry* stack) const
+{
+    if (m_quantizedNodes)
+        traverse(m_quantizedNodes.get(), query, visitLeaf, stack);
+    else if (m_nodes)
+        traverse(m_nodes.get(), query, visitLeaf, stack);
+}
+
+template <typename NodeType, typename Query, typename LeafVisitor>
+void WideBVH::traverse(const NodeType* nodes, const Query& query, LeafVisitor visitLeaf, StackEntry* stack)
+{
+    int stackSize = 0;
+    StackEntry current = StackEntry{0, 0, 0, 0};
+
+    while (true)
+    {
+        if (current.count)
+        {
+            if (current.rays && query.visitLeaf(visitLeaf, current.child, current.count, current.rays))
+                return;
+        }
+        else
+        {
+            __m128 tMin;
+            int hitMask = query.intersect(nodes[current.child], tMin, query.maxDistance());
+
+            // Descend straight into a single hit child. With more hits, sort
+            // them by distance, push them far to near and continue with the
+            // nearest one.
+            const NodeType& node = nodes[current.child];
+            if (hitMask && !(hitMask & (hitMask - 1)))
+            {
+                int i = __builtin_ctz(hitMask);
+                node.getChild(i, current.child, current.count);
+                if (current.count)
+                    current.rays = query.leafRays(node, i);
+                continue;
+            }
+            if (hitMask)
+            {
+                alignas(16) float distances[4];
+                _mm_store_ps(distances, tMin);
+                StackEntry* hits = stack + stackSize;
+                int hitCount = 0;
+                for (; hitMask; hitMask &= hitMask - 1)
+                {
+                    int i = __builtin_ctz(hitMask);
+                    StackEntry hit;
+                    node.getChild(i, hit.child, hit.count);
+                    hit.rays = hit.count ? query.leafRays(node, i) : 0;
+                    hit.distance = distances[i];
+                    int j = hitCount++;
+                    for (; j > 0 && hits[j - 1].distance < hit.distance; j--)
+                        hits[j] = hits[j - 1];
+                    hits[j] = hit;
+                }
+                stackSize += hitCount - 1;
+                current = hits[hitCount - 1];
+                continue;
+            }
+        }
+
+        // Resume from the nearest deferred child still within reach.
+        float maxDistance = query.maxDistance();
+        do
+        {
+            if (!stackSize)
+                return;
+            current = stack[--stackSize];
+        }
+        while (current.distance > maxDistance);
+    }
+}
+
+}
+
+#endif
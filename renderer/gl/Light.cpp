@@ -3,6 +3,8 @@
 #include "Scene.h"
 #include "ShaderUtil.h"
 
+#include <algorithm>
+
 using namespace gl;
 
 SphericalLight::SphericalLight(const Sphere* sphere):
@@ -12,12 +14,58 @@ SphericalLight::SphericalLight(const Sphere* sphere):
 
 void SphericalLight::writeCommon(std::ostringstream& s)
 {
-    s << "float solidAngle(float radius, vec3 lightPos, vec3 surfacePos)\n"
+    // See cpu::SphericalLight for the derivation.
+    s << "struct LightCone {\n"
+         "    vec3 axis;\n"
+         "    float sin2ThetaMax;\n"
+         "    float oneMinusCosThetaMax;\n"
+         "};\n"
+         "\n"
+         "LightCone visibleCone(vec3 lightPos, float radius, vec3 surfacePos)\n"
+         "{\n"
+         "    LightCone cone;\n"
+         "    vec3 toCenter = lightPos - surfacePos;\n"
+         "    float dist2 = dot(toCenter, toCenter);\n"
+         "    cone.sin2ThetaMax = radius * radius / dist2;\n"
+         "    if (cone.sin2ThetaMax >= 1.0) {\n"
+         "        cone.axis = vec3(0.0, 0.0, 1.0);\n"
+         "        cone.oneMinusCosThetaMax = 2.0;\n"
+         "    } else {\n"
+         "        cone.axis = toCenter * inversesqrt(dist2);\n"
+         "        cone.oneMinusCosThetaMax = cone.sin2ThetaMax / (1.0 + sqrt(1.0 - cone.sin2ThetaMax));\n"
+         "    }\n"
+         "    return cone;\n"
+         "}\n"
+         "\n"
+         "float coneProbability(LightCone cone, vec3 direction)\n"
          "{\n"
-         "    float dist = length(lightPos - surfacePos);\n"
-         "    if (dist < radius)\n"
-         "        return 4.0 * M_PI;\n"
-         "    return 2.0 * M_PI * (1.0 - cos(asin(radius / dist)));\n"
+         "    if (cone.sin2ThetaMax >= 1.0)\n"
+         "        return 1.0 / (4.0 * M_PI);\n"
+         "    vec3 perpendicular = cross(direction, cone.axis);\n"
+         "    if (dot(direction, cone.axis) <= 0.0 ||\n"
+         "        dot(perpendicular, perpendicular) > cone.sin2ThetaMax * dot(direction, direction))\n"
+         "        return 0.0;\n"
+         "    return 1.0 / (2.0 * M_PI * cone.oneMinusCosThetaMax);\n"
+         "}\n"
+         "\n"
+         "RandomVec3 sampleCone(LightCone cone, float s1, float s2)\n"
+         "{\n"
+         "    float oneMinusCosTheta = s1 * cone.oneMinusCosThetaMax;\n"
+         "    float cosTheta = 1.0 - oneMinusCosTheta;\n"
+         "    float sinTheta = sqrt(max(0.0, oneMinusCosTheta * (2.0 - oneMinusCosTheta)));\n"
+         "    float phi = 2.0 * M_PI * s2;\n"
+         "\n"
+         "    vec3 n = cone.axis;\n"
+         "    float flip = n.z < 0.0 ? -1.0 : 1.0;\n"
+         "    float a = -1.0 / (flip + n.z);\n"
+         "    float b = n.x * n.y * a;\n"
+         "    vec3 tangent = vec3(1.0 + flip * n.x * n.x * a, flip * b, -flip * n.x);\n"
+         "    vec3 binormal = vec3(b, flip + n.y * n.y * a, -n.y);\n"
+         "\n"
+         "    RandomVec3 result;\n"
+         "    result.value = n * cosTheta + (tangent * cos(phi) + binormal * sin(phi)) * sinTheta;\n"
+         "    result.probability = 1.0 / (2.0 * M_PI * cone.oneMinusCosThetaMax);\n"
+         "    return result;\n"
          "}\n";
 }
 
@@ -27,30 +75,9 @@ void SphericalLight::writeSampleGenerator(std::ostringstream& s, const std::stri
          "{\n"
          "    float s1 = random(surfacePos.xy);\n"
          "    float s2 = random(surfacePos.yz);\n"
-         "    float s3 = random(surfacePos.zx);\n"
          "\n";
-
-    glm::vec3 lightPos(m_sphere->transform.matrix * glm::vec4(0, 0, 0, 1));
-    s << "    vec3 lightPos = vec3(";
-    writeVec3(s, lightPos);
-    s << ");\n";
-
-    s << "    float radius = ";
-    writeFloat(s, m_sphere->radius);
-    s << ";\n";
-
-    s << "    float radius2 = ";
-    writeFloat(s, m_sphere->radius * m_sphere->radius);
-    s << ";\n";
-
-    s << "    float x = radius * sqrt(s1) * cos(2.0 * M_PI * s2);\n"
-         "    float y = radius * sqrt(s1) * sin(2.0 * M_PI * s2);\n"
-         "    float z = sqrt(radius2 - x * x - y * y) * sin(M_PI * (s3 - .5));\n"
-         "\n"
-         "    RandomVec3 result;\n"
-         "    result.value = normalize(lightPos + vec3(x, y, z) - surfacePos);\n"
-         "    result.probability = 1.0 / solidAngle(radius, lightPos, surfacePos);\n"
-         "    return result;\n"
+    writeCone(s);
+    s << "    return sampleCone(cone, s1, s2);\n"
          "}\n";
 }
 
@@ -68,16 +95,27 @@ void SphericalLight::writeSampleProbability(std::ostringstream& s, const std::st
 {
     s << "float " << name << "(vec3 surfacePos, vec3 direction)\n";
     s << "{\n";
+    writeCone(s);
+    s << "    return coneProbability(cone, direction);\n";
+    s << "}\n";
+}
+
+void SphericalLight::writeCone(std::ostringstream& s) const
+{
+    // Cover the sphere with its bounding sphere in case the transform scales
+    // it unevenly.
+    const glm::mat4& matrix = m_sphere->transform.matrix;
+    glm::vec3 lightPos(matrix * glm::vec4(0, 0, 0, 1));
+    float scale = std::max(glm::length(glm::vec3(matrix[0])),
+                           std::max(glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
 
-    glm::vec3 lightPos(m_sphere->transform.matrix * glm::vec4(0, 0, 0, 1));
     s << "    vec3 lightPos = vec3(";
     writeVec3(s, lightPos);
     s << ");\n";
 
     s << "    float radius = ";
-    writeFloat(s, m_sphere->radius);
+    writeFloat(s, m_sphere->radius * scale);
     s << ";\n";
 
-    s << "    return 1.0 / solidAngle(radius, lightPos, surfacePos);\n";
-    s << "}\n";
+    s << "    LightCone cone = visibleCone(lightPos, radius, surfacePos);\n";
 }
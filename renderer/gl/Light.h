@@ -21,6 +21,8 @@ public:
     void writeSampleProbability(std::ostringstream& s, const std::string& name) const;
 
 private:
+    void writeCone(std::ostringstream& s) const;
+
     const Sphere* m_sphere;
 };
 
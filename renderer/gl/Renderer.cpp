@@ -11,22 +11,22 @@
 namespace gl
 {
 
-Renderer::Renderer(const scene::Scene& scene, Image* image):
+Renderer::Renderer(const scene::Scene& scene, Image* image, bool compactBuffers):
     m_image(image),
     m_scene(new Scene(scene)),
     m_random(new Random()),
     m_raytracer(new Raytracer(m_scene.get())),
     m_shader(new SurfaceShader(m_scene.get(), m_raytracer.get(), m_random.get())),
     m_originTexture(createTexture(GL_TEXTURE_2D, 1, GL_RGB32F, image->width, image->height)),
-    m_directionTexture(createTexture(GL_TEXTURE_2D, 1, GL_RGB32F, image->width, image->height)),
+    m_directionTexture(createTexture(GL_TEXTURE_2D, 1, compactBuffers ? GL_RGB16F : GL_RGB32F, image->width, image->height)),
     m_distanceNormalTexture(createTexture(GL_TEXTURE_2D, 1, GL_RGBA32F, image->width, image->height)),
-    m_tangentTexture(createTexture(GL_TEXTURE_2D, 1, GL_RGB32F, image->width, image->height)),
+    m_tangentTexture(createTexture(GL_TEXTURE_2D, 1, compactBuffers ? GL_RGB16F : GL_RGB32F, image->width, image->height)),
     m_radianceTexture(createTexture(GL_TEXTURE_2D, 1, GL_RGBA32F, image->width, image->height)),
-    m_weightTexture(createTexture(GL_TEXTURE_2D, 1, GL_RGBA32F, image->width, image->height)),
+    m_weightTexture(createTexture(GL_TEXTURE_2D, 1, compactBuffers ? GL_RGBA16F : GL_RGBA32F, image->width, image->height)),
     m_newOriginTexture(createTexture(GL_TEXTURE_2D, 1, GL_RGB32F, image->width, image->height)),
-    m_newDirectionTexture(createTexture(GL_TEXTURE_2D, 1, GL_RGB32F, image->width, image->height)),
+    m_newDirectionTexture(createTexture(GL_TEXTURE_2D, 1, compactBuffers ? GL_RGB16F : GL_RGB32F, image->width, image->height)),
     m_newRadianceTexture(createTexture(GL_TEXTURE_2D, 1, GL_RGBA32F, image->width, image->height)),
-    m_newWeightTexture(createTexture(GL_TEXTURE_2D, 1, GL_RGBA32F, image->width, image->height)),
+    m_newWeightTexture(createTexture(GL_TEXTURE_2D, 1, compactBuffers ? GL_RGBA16F : GL_RGBA32F, image->width, image->height)),
     m_tracerProgram(glCreateProgram()),
     m_shaderProgram(glCreateProgram()),
     m_originSampler(createSampler()),
@@ -23,7 +23,9 @@ namespace gl
 class Renderer
 {
 public:
-    Renderer(const scene::Scene& scene, Image* image);
+    // |compactBuffers| stores the per-ray direction, tangent and weight
+    // buffers at half precision.
+    Renderer(const scene::Scene& scene, Image* image, bool compactBuffers = false);
 
     int render();
 
@@ -4,6 +4,7 @@
 #include "ShaderUtil.h"
 
 #include <algorithm>
+#include <iostream>
 
 using namespace gl;
 
@@ -53,8 +54,7 @@ void Material::writeInitializer(std::ostringstream& s) const
 
 Transform::Transform(const glm::mat4 matrix):
     matrix(matrix),
-    invMatrix(glm::inverse(matrix)),
-    determinant(glm::determinant(matrix))
+    invMatrix(glm::inverse(matrix))
 {
 }
 
@@ -93,10 +93,6 @@ void Sphere::writeIntersector(std::ostringstream& s, const std::string& name, si
     transform.writeInverseMatrixInitializer(s);
     s << ";\n";
 
-    s << "    float determinant = ";
-    writeFloat(s, transform.determinant);
-    s << ";\n";
-
     s << "    float radius2 = ";
     writeFloat(s, radius * radius);
     s << ";\n";
@@ -134,7 +130,6 @@ void Sphere::writeIntersector(std::ostringstream& s, const std::string& name, si
          "        if (t0 < 0)\n"
          "            t0 = t1;\n"
          "\n"
-         "        t0 = determinant * t0;\n"
          "        if (t0 > minDistance && t0 < maxDistance) {\n"
          "            mat3 rotation = mat3(transform);\n"
          "            maxDistance = t0;\n"
@@ -167,10 +162,6 @@ void Plane::writeIntersector(std::ostringstream& s, const std::string& name, siz
     transform.writeInverseMatrixInitializer(s);
     s << ";\n";
 
-    s << "    float determinant = ";
-    writeFloat(s, transform.determinant);
-    s << ";\n";
-
     s << "    float localObjectIndex = ";
     writeFloat(s, objectIndex);
     s << ";\n";
@@ -199,6 +190,12 @@ Scene::Scene(const scene::Scene& scene):
         spheres.push_back(Sphere(sphere));
     for (const scene::Plane& plane: scene.planes)
         planes.push_back(Plane(plane));
+    if (!scene.meshes.empty())
+        std::cerr << "Warning: meshes are not supported by the gl renderer, skipping "
+                  << scene.meshes.size() << " meshes" << std::endl;
+    if (!scene.instances.empty())
+        std::cerr << "Warning: instances are not supported by the gl renderer, skipping "
+                  << scene.instances.size() << " instances" << std::endl;
 }
 
 size_t Scene::objectIndex(const Plane& plane) const
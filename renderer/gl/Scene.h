@@ -33,7 +33,6 @@ public:
 
     glm::mat4 matrix;
     glm::mat4 invMatrix;
-    float determinant;
 };
 
 class Sphere
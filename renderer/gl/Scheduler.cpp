@@ -8,8 +8,8 @@
 namespace gl
 {
 
-Scheduler::Scheduler(const scene::Scene& scene, Image* image, Preview* preview):
-    m_renderer(new Renderer(scene, image)),
+Scheduler::Scheduler(const scene::Scene& scene, Image* image, Preview* preview, bool compactBuffers):
+    m_renderer(new Renderer(scene, image, compactBuffers)),
     m_image(image),
     m_preview(preview)
 {
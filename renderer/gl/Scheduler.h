@@ -21,7 +21,7 @@ class Renderer;
 class Scheduler: public ::Scheduler
 {
 public:
-    Scheduler(const scene::Scene&, Image*, Preview*);
+    Scheduler(const scene::Scene&, Image*, Preview*, bool compactBuffers = false);
 
     virtual void run() override;
 
@@ -0,0 +1,517 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#include "BVH.h"
+
+#include <algorithm>
+#include <future>
+#include <limits>
+#include <thread>
+
+using namespace scene;
+
+namespace
+{
+
+const uint32_t g_maxLeafSize = 4;
+const int g_binCount = 16;
+
+// Centroid extents below this are treated as zero. Binning a smaller extent
+// would overflow its scale to infinity.
+const float g_minExtent = 1e-30f;
+
+// Relative costs of visiting a node and intersecting a primitive.
+const float g_traversalCost = 1;
+const float g_intersectionCost = 1;
+
+// Ranges smaller than this are always built on the current thread.
+const uint32_t g_minTaskSize = 4096;
+
+// Inputs at least this large are built from Morton codes instead of SAH
+// binning, which trades some tree quality for a much cheaper build.
+const size_t g_mortonThreshold = 1 << 21;
+
+class Bin
+{
+public:
+    Bin():
+        count(0)
+    {
+    }
+
+    AABB box;
+    AABB centroidBox;
+    uint32_t count;
+};
+
+// Spreads the low ten bits of |value| so that there are two zero bits
+// between each of them.
+uint32_t expandBits(uint32_t value)
+{
+    value = (value * 0x00010001u) & 0xff0000ffu;
+    value = (value * 0x00000101u) & 0x0f00f00fu;
+    value = (value * 0x00000011u) & 0xc30c30c3u;
+    value = (value * 0x00000005u) & 0x49249249u;
+    return value;
+}
+
+// Bin of a centroid scaled to the bin range. Clamping from below catches
+// rounding and anything that went wrong with the scale.
+int binIndex(float position)
+{
+    return std::max(0, std::min(int(position), g_binCount - 1));
+}
+
+uint32_t mortonCode(const glm::vec3& position)
+{
+    glm::vec3 p = glm::clamp(position * 1024.f, glm::vec3(0), glm::vec3(1023));
+    return (expandBits(uint32_t(p.x)) << 2) | (expandBits(uint32_t(p.y)) << 1) | expandBits(uint32_t(p.z));
+}
+
+/**
+ *  Top-down builder producing nodes in depth first order. Subtrees near the
+ *  root are built concurrently into separate node lists which are then
+ *  spliced after their parent.
+ */
+class Builder
+{
+public:
+    Builder(const std::vector<AABB>& bounds):
+        m_bounds(bounds),
+        m_parallelDepth(0)
+    {
+        m_indices.resize(bounds.size());
+        m_centroids.resize(bounds.size());
+        for (size_t i = 0; i < m_indices.size(); i++)
+        {
+            m_indices[i] = i;
+            m_centroids[i] = bounds[i].center();
+        }
+        m_nodes.reserve(2 * bounds.size());
+
+        unsigned threadCount = std::thread::hardware_concurrency();
+        while ((1u << m_parallelDepth) < threadCount)
+            m_parallelDepth++;
+        // Oversubscribe by one level to even out unbalanced splits.
+        if (m_parallelDepth)
+            m_parallelDepth++;
+    }
+
+    void buildSAH()
+    {
+        AABB box;
+        AABB centroidBox;
+        for (size_t i = 0; i < m_bounds.size(); i++)
+        {
+            box.extend(m_bounds[i]);
+            centroidBox.extend(m_centroids[i]);
+        }
+        buildSAH(0, m_indices.size(), box, centroidBox, m_nodes, 0);
+    }
+
+    void buildMorton()
+    {
+        AABB centroidBox;
+        for (const glm::vec3& centroid: m_centroids)
+            centroidBox.extend(centroid);
+
+        glm::vec3 extent = centroidBox.max - centroidBox.min;
+        glm::vec3 scale(extent.x > g_minExtent ? 1 / extent.x : 0,
+                        extent.y > g_minExtent ? 1 / extent.y : 0,
+                        extent.z > g_minExtent ? 1 / extent.z : 0);
+
+        std::vector<std::pair<uint32_t, uint32_t> > codes(m_indices.size());
+        for (size_t i = 0; i < codes.size(); i++)
+            codes[i] = std::make_pair(mortonCode((m_centroids[i] - centroidBox.min) * scale), uint32_t(i));
+        sort(codes.data(), codes.data() + codes.size(), 0);
+
+        m_codes.resize(codes.size());
+        for (size_t i = 0; i < codes.size(); i++)
+        {
+            m_codes[i] = codes[i].first;
+            m_indices[i] = codes[i].second;
+        }
+        buildMorton(0, m_indices.size(), m_nodes, 0);
+    }
+
+    std::vector<BVHNode> m_nodes;
+    std::vector<uint32_t> m_indices;
+
+private:
+    void buildSAH(uint32_t begin, uint32_t end, const AABB& box, const AABB& centroidBox,
+                  std::vector<BVHNode>& nodes, int depth)
+    {
+        size_t nodeIndex = nodes.size();
+        nodes.push_back(BVHNode());
+        nodes[nodeIndex].min = box.min;
+        nodes[nodeIndex].max = box.max;
+
+        uint32_t count = end - begin;
+        glm::vec3 extent = centroidBox.max - centroidBox.min;
+        if (count == 1 || glm::max(extent.x, glm::max(extent.y, extent.z)) <= g_minExtent)
+        {
+            makeLeaf(nodes[nodeIndex], begin, end);
+            return;
+        }
+
+        // Bin the centroids along every axis with a non-zero extent and
+        // find the cheapest split between two bins.
+        Bin bins[3][g_binCount];
+        glm::vec3 scale;
+        for (int axis = 0; axis < 3; axis++)
+            scale[axis] = extent[axis] > g_minExtent ? g_binCount * (1 - 1e-4f) / extent[axis] : 0;
+        for (uint32_t i = begin; i < end; i++)
+        {
+            uint32_t index = m_indices[i];
+            glm::vec3 bin = (m_centroids[index] - centroidBox.min) * scale;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                Bin& b = bins[axis][binIndex(bin[axis])];
+                b.box.extend(m_bounds[index]);
+                b.centroidBox.extend(m_centroids[index]);
+                b.count++;
+            }
+        }
+
+        float bestCost = std::numeric_limits<float>::infinity();
+        int bestAxis = -1;
+        int bestSplit = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (extent[axis] <= g_minExtent)
+                continue;
+
+            // The right hand cost of splitting after bin i.
+            float rightCost[g_binCount];
+            AABB rightBox;
+            uint32_t rightCount = 0;
+            for (int i = g_binCount - 1; i > 0; i--)
+            {
+                rightBox.extend(bins[axis][i].box);
+                rightCount += bins[axis][i].count;
+                rightCost[i - 1] = rightBox.surfaceArea() * rightCount;
+            }
+
+            AABB leftBox;
+            uint32_t leftCount = 0;
+            for (int i = 0; i < g_binCount - 1; i++)
+            {
+                leftBox.extend(bins[axis][i].box);
+                leftCount += bins[axis][i].count;
+                if (!leftCount || leftCount == count)
+                    continue;
+                float cost = leftBox.surfaceArea() * leftCount + rightCost[i];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+
+        float area = box.surfaceArea();
+        float splitCost = g_traversalCost + g_intersectionCost * (area > 0 ? bestCost / area : count);
+        float leafCost = g_intersectionCost * count;
+        if (bestAxis < 0 || (count <= g_maxLeafSize && leafCost <= splitCost))
+        {
+            makeLeaf(nodes[nodeIndex], begin, end);
+            return;
+        }
+
+        AABB leftBox, leftCentroids, rightBox, rightCentroids;
+        for (int i = 0; i < g_binCount; i++)
+        {
+            const Bin& bin = bins[bestAxis][i];
+            (i <= bestSplit ? leftBox : rightBox).extend(bin.box);
+            (i <= bestSplit ? leftCentroids : rightCentroids).extend(bin.centroidBox);
+        }
+
+        float minCentroid = centroidBox.min[bestAxis];
+        float axisScale = scale[bestAxis];
+        uint32_t middle = std::partition(&m_indices[begin], &m_indices[0] + end, [&](uint32_t index) {
+            return binIndex((m_centroids[index][bestAxis] - minCentroid) * axisScale) <= bestSplit;
+        }) - &m_indices[0];
+
+        // Guard against rounding putting everything on one side.
+        if (middle == begin || middle == end)
+        {
+            middle = begin + count / 2;
+            leftBox = leftCentroids = rightBox = rightCentroids = AABB();
+            bound(begin, middle, leftBox, leftCentroids);
+            bound(middle, end, rightBox, rightCentroids);
+        }
+
+        buildChildren(begin, middle, end, nodes, nodeIndex, depth,
+                      [&](uint32_t b, uint32_t e, std::vector<BVHNode>& n) {
+            if (b == begin)
+                buildSAH(b, e, leftBox, leftCentroids, n, depth + 1);
+            else
+                buildSAH(b, e, rightBox, rightCentroids, n, depth + 1);
+        });
+    }
+
+    AABB buildMorton(uint32_t begin, uint32_t end, std::vector<BVHNode>& nodes, int depth)
+    {
+        size_t nodeIndex = nodes.size();
+        nodes.push_back(BVHNode());
+
+        uint32_t count = end - begin;
+        AABB box;
+        if (count <= g_maxLeafSize)
+        {
+            AABB centroidBox;
+            bound(begin, end, box, centroidBox);
+            makeLeaf(nodes[nodeIndex], begin, end);
+        }
+        else
+        {
+            // Split where the highest differing bit of the sorted codes
+            // changes, or in the middle if all the codes are equal.
+            uint32_t first = m_codes[begin];
+            uint32_t last = m_codes[end - 1];
+            uint32_t middle = begin + count / 2;
+            if (first != last)
+            {
+                uint32_t bit = 31 - __builtin_clz(first ^ last);
+                middle = std::upper_bound(&m_codes[begin], &m_codes[0] + end, first | ((1u << bit) - 1)) - &m_codes[0];
+            }
+
+            AABB childBoxes[2];
+            buildChildren(begin, middle, end, nodes, nodeIndex, depth,
+                          [&](uint32_t b, uint32_t e, std::vector<BVHNode>& n) {
+                childBoxes[b != begin] = buildMorton(b, e, n, depth + 1);
+            });
+            box.extend(childBoxes[0]);
+            box.extend(childBoxes[1]);
+        }
+        nodes[nodeIndex].min = box.min;
+        nodes[nodeIndex].max = box.max;
+        return box;
+    }
+
+    /**
+     *  Builds the two children of the inner node at |nodeIndex| with
+     *  |buildChild|, either serially into |nodes| or, near the root,
+     *  concurrently into temporary lists that are spliced in afterwards.
+     */
+    template <typename BuildChild>
+    void buildChildren(uint32_t begin, uint32_t middle, uint32_t end,
+                       std::vector<BVHNode>& nodes, size_t nodeIndex, int depth,
+                       BuildChild buildChild)
+    {
+        nodes[nodeIndex].count = 0;
+        if (depth >= m_parallelDepth || end - begin < g_minTaskSize)
+        {
+            buildChild(begin, middle, nodes);
+            nodes[nodeIndex].offset = nodes.size();
+            buildChild(middle, end, nodes);
+            return;
+        }
+
+        std::vector<BVHNode> leftNodes;
+        std::vector<BVHNode> rightNodes;
+        std::future<void> left = std::async(std::launch::async, [&]() {
+            buildChild(begin, middle, leftNodes);
+        });
+        buildChild(middle, end, rightNodes);
+        left.get();
+
+        splice(nodes, leftNodes);
+        nodes[nodeIndex].offset = nodes.size();
+        splice(nodes, rightNodes);
+    }
+
+    static void splice(std::vector<BVHNode>& nodes, const std::vector<BVHNode>& subtree)
+    {
+        uint32_t base = nodes.size();
+        for (BVHNode node: subtree)
+        {
+            if (!node.isLeaf())
+                node.offset += base;
+            nodes.push_back(node);
+        }
+    }
+
+    void makeLeaf(BVHNode& node, uint32_t begin, uint32_t end)
+    {
+        node.offset = begin;
+        node.count = end - begin;
+    }
+
+    void bound(uint32_t begin, uint32_t end, AABB& box, AABB& centroidBox) const
+    {
+        for (uint32_t i = begin; i < end; i++)
+        {
+            box.extend(m_bounds[m_indices[i]]);
+            centroidBox.extend(m_centroids[m_indices[i]]);
+        }
+    }
+
+    template <typename T>
+    void sort(T* begin, T* end, int depth)
+    {
+        if (depth >= m_parallelDepth || uint32_t(end - begin) < g_minTaskSize)
+        {
+            std::sort(begin, end);
+            return;
+        }
+        T* middle = begin + (end - begin) / 2;
+        std::future<void> left = std::async(std::launch::async, [&]() {
+            sort(begin, middle, depth + 1);
+        });
+        sort(middle, end, depth + 1);
+        left.get();
+        std::inplace_merge(begin, middle, end);
+    }
+
+    const std::vector<AABB>& m_bounds;
+    std::vector<glm::vec3> m_centroids;
+    std::vector<uint32_t> m_codes;
+    int m_parallelDepth;
+};
+
+template <typename T>
+std::shared_ptr<const T> share(std::vector<T>& items)
+{
+    auto storage = std::make_shared<std::vector<T>>();
+    storage->swap(items);
+    return std::shared_ptr<const T>(storage, storage->data());
+}
+
+}
+
+AABB::AABB():
+    min(std::numeric_limits<float>::infinity()),
+    max(-std::numeric_limits<float>::infinity())
+{
+}
+
+AABB::AABB(const glm::vec3& min, const glm::vec3& max):
+    min(min),
+    max(max)
+{
+}
+
+void AABB::extend(const glm::vec3& point)
+{
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+}
+
+void AABB::extend(const AABB& box)
+{
+    min = glm::min(min, box.min);
+    max = glm::max(max, box.max);
+}
+
+AABB AABB::transformed(const glm::mat4& transform) const
+{
+    AABB box;
+    if (empty())
+        return box;
+    for (int i = 0; i < 8; i++)
+    {
+        glm::vec3 corner((i & 1) ? max.x : min.x,
+                         (i & 2) ? max.y : min.y,
+                         (i & 4) ? max.z : min.z);
+        box.extend(glm::vec3(transform * glm::vec4(corner, 1)));
+    }
+    return box;
+}
+
+glm::vec3 AABB::center() const
+{
+    return (min + max) * .5f;
+}
+
+float AABB::surfaceArea() const
+{
+    if (empty())
+        return 0;
+    glm::vec3 d = max - min;
+    return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+bool AABB::empty() const
+{
+    return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+BVH::BVH():
+    m_nodeCount(0),
+    m_indexCount(0)
+{
+}
+
+void BVH::build(const std::vector<AABB>& bounds)
+{
+    if (bounds.empty())
+    {
+        *this = BVH();
+        return;
+    }
+
+    Builder builder(bounds);
+    if (bounds.size() >= g_mortonThreshold)
+        builder.buildMorton();
+    else
+        builder.buildSAH();
+
+    m_nodeCount = builder.m_nodes.size();
+    m_indexCount = builder.m_indices.size();
+    m_nodes = share(builder.m_nodes);
+    m_indices = share(builder.m_indices);
+}
+
+void BVH::assign(const BVHNode* nodes, size_t nodeCount,
+                 const uint32_t* indices, size_t indexCount,
+                 std::shared_ptr<const void> storage)
+{
+    m_nodes = std::shared_ptr<const BVHNode>(storage, nodes);
+    m_nodeCount = nodeCount;
+    m_indices = std::shared_ptr<const uint32_t>(storage, indices);
+    m_indexCount = indexCount;
+}
+
+float BVH::sahCost() const
+{
+    if (empty())
+        return 0;
+
+    float rootArea = AABB(m_nodes.get()[0].min, m_nodes.get()[0].max).surfaceArea();
+    if (rootArea <= 0)
+        return 0;
+
+    float cost = 0;
+    for (size_t i = 0; i < m_nodeCount; i++)
+    {
+        const BVHNode& node = m_nodes.get()[i];
+        float area = AABB(node.min, node.max).surfaceArea() / rootArea;
+        cost += area * (node.isLeaf() ? g_intersectionCost * node.count : g_traversalCost);
+    }
+    return cost;
+}
+
+bool BVH::empty() const
+{
+    return !m_nodeCount;
+}
+
+const BVHNode* BVH::nodes() const
+{
+    return m_nodes.get();
+}
+
+size_t BVH::nodeCount() const
+{
+    return m_nodeCount;
+}
+
+const uint32_t* BVH::indices() const
+{
+    return m_indices.get();
+}
+
+size_t BVH::indexCount() const
+{
+    return m_indexCount;
+}
@@ -0,0 +1,89 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef SCENE_BVH_H
+#define SCENE_BVH_H
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+namespace scene
+{
+
+class AABB
+{
+public:
+    AABB();
+    AABB(const glm::vec3& min, const glm::vec3& max);
+
+    void extend(const glm::vec3& point);
+    void extend(const AABB& box);
+    AABB transformed(const glm::mat4& transform) const;
+    glm::vec3 center() const;
+    float surfaceArea() const;
+    bool empty() const;
+
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+/**
+ *  Bounding volume hierarchy node. The first child of an inner node
+ *  immediately follows its parent and |offset| is the index of the second
+ *  child. For leaves |offset| is the first entry in the primitive index list
+ *  and |count| is non-zero.
+ */
+struct BVHNode
+{
+    glm::vec3 min;
+    uint32_t offset;
+    glm::vec3 max;
+    uint32_t count;
+
+    bool isLeaf() const { return count != 0; }
+};
+
+/**
+ *  Bounding volume hierarchy over a list of primitives. The node and index
+ *  arrays are either owned by the hierarchy or borrowed from external storage
+ *  such as a memory mapped scene cache, which is kept alive as long as any
+ *  copy of the hierarchy refers to it.
+ */
+class BVH
+{
+public:
+    BVH();
+
+    /**
+     *  Builds the hierarchy with a binned surface area heuristic, or from
+     *  Morton codes for very large inputs. The top levels are built in
+     *  parallel.
+     */
+    void build(const std::vector<AABB>& bounds);
+    void assign(const BVHNode* nodes, size_t nodeCount,
+                const uint32_t* indices, size_t indexCount,
+                std::shared_ptr<const void> storage);
+
+    bool empty() const;
+
+    /**
+     *  Expected cost of tracing a ray through the hierarchy according to
+     *  the surface area heuristic, relative to the root node.
+     */
+    float sahCost() const;
+
+    const BVHNode* nodes() const;
+    size_t nodeCount() const;
+    const uint32_t* indices() const;
+    size_t indexCount() const;
+
+private:
+    std::shared_ptr<const BVHNode> m_nodes;
+    size_t m_nodeCount;
+    std::shared_ptr<const uint32_t> m_indices;
+    size_t m_indexCount;
+};
+
+}
+
+#endif
@@ -0,0 +1,498 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#include "Cache.h"
+#include "MappedFile.h"
+#include "Scene.h"
+
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace scene;
+
+namespace
+{
+
+const char g_magic[8] = {'K', 'A', 'J', 'O', 'S', 'C', 'N', 0};
+const uint32_t g_version = 4;
+const char g_meshMagic[8] = {'K', 'A', 'J', 'O', 'M', 'S', 'C', 0};
+const uint32_t g_meshVersion = 1;
+const size_t g_sectionAlignment = 64;
+
+struct Section
+{
+    uint64_t offset;
+    uint64_t count;
+};
+
+// Meshes are stored without their data, which is loaded separately from the
+// mesh file. The file name is a range in the string section.
+struct CachedMesh
+{
+    glm::mat4 transform;
+    Material material;
+    Section fileName;
+};
+
+// Ranges of the shared sections that hold the objects of the scene itself or
+// of one prototype. The name is a range in the string section.
+struct CachedGroup
+{
+    Section name;
+    Section spheres;
+    Section meshes;
+    Section nodes;
+    Section indices;
+};
+
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t key;
+
+    // Layout of the stored types, used to reject caches written by a
+    // differently compiled renderer.
+    uint32_t sphereSize;
+    uint32_t planeSize;
+    uint32_t nodeSize;
+    uint32_t meshSize;
+    uint32_t instanceSize;
+    uint32_t reserved;
+
+    glm::vec4 backgroundColor;
+    glm::mat4 cameraTransform;
+    glm::mat4 cameraProjection;
+
+    Section spheres;
+    Section planes;
+    Section nodes;
+    Section indices;
+    Section meshes;
+    Section strings;
+    Section prototypes;
+    Section instances;
+
+    CachedGroup scene;
+    Section instanceNodes;
+    Section instanceIndices;
+};
+
+struct MeshHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t key;
+
+    uint32_t triangleSize;
+    uint32_t nodeSize;
+
+    Section triangles;
+    Section nodes;
+    Section indices;
+};
+
+size_t align(size_t offset)
+{
+    return (offset + g_sectionAlignment - 1) & ~(g_sectionAlignment - 1);
+}
+
+template <typename T>
+bool validSection(const Section& section, size_t fileSize)
+{
+    return section.offset % g_sectionAlignment == 0 &&
+           section.offset <= fileSize &&
+           section.count <= (fileSize - section.offset) / sizeof(T);
+}
+
+template <typename T>
+const T* sectionData(const MappedFile& file, const Section& section)
+{
+    return reinterpret_cast<const T*>(file.data() + section.offset);
+}
+
+template <typename T>
+Section layoutSection(size_t& offset, size_t count)
+{
+    Section section = {align(offset), count};
+    offset = section.offset + count * sizeof(T);
+    return section;
+}
+
+bool writeSection(FILE* file, const Section& section, const void* data, size_t size)
+{
+    static const char padding[g_sectionAlignment] = {0};
+    long position = ftell(file);
+    if (position < 0 || static_cast<uint64_t>(position) > section.offset)
+        return false;
+    size_t paddingSize = section.offset - position;
+    if (paddingSize && fwrite(padding, 1, paddingSize, file) != paddingSize)
+        return false;
+    return !size || fwrite(data, 1, size, file) == size;
+}
+
+/**
+ *  Contents of a section gathered from several arrays without copying them.
+ */
+template <typename T>
+class SectionContents
+{
+public:
+    SectionContents():
+        count(0)
+    {
+    }
+
+    Section append(const T* data, size_t size)
+    {
+        Section range = {count, size};
+        if (size)
+            chunks.push_back(std::make_pair(data, size));
+        count += size;
+        return range;
+    }
+
+    bool write(FILE* file, const Section& section) const
+    {
+        if (!writeSection(file, section, nullptr, 0))
+            return false;
+        for (const auto& chunk: chunks)
+        {
+            if (fwrite(chunk.first, sizeof(T), chunk.second, file) != chunk.second)
+                return false;
+        }
+        return true;
+    }
+
+    std::vector<std::pair<const T*, size_t> > chunks;
+    size_t count;
+};
+
+bool validRange(const Section& range, const Section& section)
+{
+    return range.offset <= section.count && range.count <= section.count - range.offset;
+}
+
+// Checks that a hierarchy read from a cache only refers to its own nodes and
+// indices and to |primitiveCount| primitives. The second child of an inner
+// node must come after it, which also rules out cycles.
+bool validHierarchy(const BVHNode* nodes, size_t nodeCount,
+                    const uint32_t* indices, size_t indexCount, size_t primitiveCount)
+{
+    for (size_t i = 0; i < nodeCount; i++)
+    {
+        const BVHNode& node = nodes[i];
+        if (node.isLeaf())
+        {
+            if (node.offset > indexCount || node.count > indexCount - node.offset)
+                return false;
+        }
+        else if (i + 1 >= nodeCount || node.offset <= i + 1 || node.offset >= nodeCount)
+            return false;
+    }
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        if (indices[i] >= primitiveCount)
+            return false;
+    }
+    return true;
+}
+
+// Finishes writing a cache file and moves it in place. Caches are written to
+// a temporary file first so that other readers never see a partial one.
+bool commit(FILE* file, bool ok, const std::string& tempName, const std::string& fileName)
+{
+    ok = (fclose(file) == 0) && ok;
+    if (ok)
+        ok = rename(tempName.c_str(), fileName.c_str()) == 0;
+    if (!ok)
+        unlink(tempName.c_str());
+    return ok;
+}
+
+std::string tempFileName(const std::string& fileName)
+{
+    return fileName + ".tmp" + std::to_string(getpid());
+}
+
+}
+
+uint64_t Cache::hash(const char* data, size_t size, uint64_t seed)
+{
+    // FNV-1a applied to 64-bit words, followed by the remaining bytes.
+    const uint64_t prime = 0x100000001b3ull;
+    uint64_t result = 0xcbf29ce484222325ull ^ seed;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        result = (result ^ word) * prime;
+        result ^= result >> 29;
+    }
+    for (; i < size; i++)
+        result = (result ^ static_cast<uint8_t>(data[i])) * prime;
+    return result ^ size;
+}
+
+bool Cache::load(Scene& scene, const std::string& fileName, uint64_t key)
+{
+    std::shared_ptr<MappedFile> file = MappedFile::open(fileName);
+    if (!file || file->size() < sizeof(Header))
+        return false;
+
+    Header header;
+    memcpy(static_cast<void*>(&header), file->data(), sizeof(header));
+    if (memcmp(header.magic, g_magic, sizeof(g_magic)) ||
+        header.version != g_version ||
+        header.headerSize != sizeof(Header) ||
+        header.key != key ||
+        header.sphereSize != sizeof(Sphere) ||
+        header.planeSize != sizeof(Plane) ||
+        header.nodeSize != sizeof(BVHNode) ||
+        header.meshSize != sizeof(CachedMesh) ||
+        header.instanceSize != sizeof(Instance))
+        return false;
+
+    if (!validSection<Sphere>(header.spheres, file->size()) ||
+        !validSection<Plane>(header.planes, file->size()) ||
+        !validSection<BVHNode>(header.nodes, file->size()) ||
+        !validSection<uint32_t>(header.indices, file->size()) ||
+        !validSection<CachedMesh>(header.meshes, file->size()) ||
+        !validSection<char>(header.strings, file->size()) ||
+        !validSection<CachedGroup>(header.prototypes, file->size()) ||
+        !validSection<Instance>(header.instances, file->size()) ||
+        !validRange(header.instanceNodes, header.nodes) ||
+        !validRange(header.instanceIndices, header.indices) ||
+        header.instanceIndices.count != header.instances.count)
+        return false;
+
+    const Sphere* spheres = sectionData<Sphere>(*file, header.spheres);
+    const BVHNode* nodes = sectionData<BVHNode>(*file, header.nodes);
+    const uint32_t* indices = sectionData<uint32_t>(*file, header.indices);
+    const CachedMesh* meshes = sectionData<CachedMesh>(*file, header.meshes);
+    const char* strings = sectionData<char>(*file, header.strings);
+
+    // The scene is only replaced once the whole cache has been validated, so
+    // that the caller can fall back to parsing the source into it.
+    Scene loaded;
+
+    // Hierarchies are used in place and keep the mapping alive.
+    auto loadGroup = [&](const CachedGroup& group, std::string& name, SphereList& groupSpheres,
+                         MeshList& groupMeshes, BVH& bvh) {
+        if (!validRange(group.name, header.strings) ||
+            !validRange(group.spheres, header.spheres) ||
+            !validRange(group.meshes, header.meshes) ||
+            !validRange(group.nodes, header.nodes) ||
+            !validRange(group.indices, header.indices) ||
+            group.indices.count != group.spheres.count ||
+            !validHierarchy(nodes + group.nodes.offset, group.nodes.count,
+                            indices + group.indices.offset, group.indices.count, group.spheres.count))
+            return false;
+
+        name.assign(strings + group.name.offset, group.name.count);
+        groupSpheres.assign(spheres + group.spheres.offset,
+                            spheres + group.spheres.offset + group.spheres.count);
+        groupMeshes.clear();
+        for (size_t i = group.meshes.offset; i < group.meshes.offset + group.meshes.count; i++)
+        {
+            if (!validRange(meshes[i].fileName, header.strings))
+                return false;
+            Mesh mesh;
+            mesh.transform = meshes[i].transform;
+            mesh.material = meshes[i].material;
+            mesh.fileName.assign(strings + meshes[i].fileName.offset, meshes[i].fileName.count);
+            groupMeshes.push_back(mesh);
+        }
+        bvh.assign(nodes + group.nodes.offset, group.nodes.count,
+                   indices + group.indices.offset, group.indices.count, file);
+        return true;
+    };
+
+    std::string sceneName;
+    if (!loadGroup(header.scene, sceneName, loaded.spheres, loaded.meshes, loaded.sphereBVH))
+        return false;
+
+    const CachedGroup* prototypes = sectionData<CachedGroup>(*file, header.prototypes);
+    loaded.prototypes.resize(header.prototypes.count);
+    for (size_t i = 0; i < header.prototypes.count; i++)
+    {
+        Prototype& prototype = loaded.prototypes[i];
+        if (!loadGroup(prototypes[i], prototype.name, prototype.spheres, prototype.meshes, prototype.sphereBVH))
+            return false;
+    }
+
+    const Instance* instances = sectionData<Instance>(*file, header.instances);
+    loaded.instances.assign(instances, instances + header.instances.count);
+    for (const Instance& instance: loaded.instances)
+    {
+        if (instance.prototype >= loaded.prototypes.size())
+            return false;
+    }
+    if (!validHierarchy(nodes + header.instanceNodes.offset, header.instanceNodes.count,
+                        indices + header.instanceIndices.offset, header.instanceIndices.count,
+                        header.instances.count))
+        return false;
+    loaded.instanceBVH.assign(nodes + header.instanceNodes.offset, header.instanceNodes.count,
+                              indices + header.instanceIndices.offset, header.instanceIndices.count,
+                              file);
+
+    const Plane* planes = sectionData<Plane>(*file, header.planes);
+    loaded.planes.assign(planes, planes + header.planes.count);
+    loaded.backgroundColor = header.backgroundColor;
+    loaded.camera.transform = header.cameraTransform;
+    loaded.camera.projection = header.cameraProjection;
+    scene = std::move(loaded);
+    return true;
+}
+
+bool Cache::save(const Scene& scene, const std::string& fileName, uint64_t key)
+{
+    Header header;
+    memset(static_cast<void*>(&header), 0, sizeof(header));
+    memcpy(header.magic, g_magic, sizeof(g_magic));
+    header.version = g_version;
+    header.headerSize = sizeof(Header);
+    header.key = key;
+    header.sphereSize = sizeof(Sphere);
+    header.planeSize = sizeof(Plane);
+    header.nodeSize = sizeof(BVHNode);
+    header.meshSize = sizeof(CachedMesh);
+    header.instanceSize = sizeof(Instance);
+    header.backgroundColor = scene.backgroundColor;
+    header.cameraTransform = scene.camera.transform;
+    header.cameraProjection = scene.camera.projection;
+
+    SectionContents<Sphere> spheres;
+    SectionContents<BVHNode> nodes;
+    SectionContents<uint32_t> indices;
+    std::vector<CachedMesh> meshes;
+    std::string strings;
+
+    auto saveGroup = [&](const std::string& name, const SphereList& groupSpheres,
+                         const MeshList& groupMeshes, const BVH& bvh) {
+        CachedGroup group;
+        memset(static_cast<void*>(&group), 0, sizeof(group));
+        group.name.offset = strings.size();
+        group.name.count = name.size();
+        strings += name;
+        group.spheres = spheres.append(groupSpheres.data(), groupSpheres.size());
+        group.nodes = nodes.append(bvh.nodes(), bvh.nodeCount());
+        group.indices = indices.append(bvh.indices(), bvh.indexCount());
+        group.meshes.offset = meshes.size();
+        group.meshes.count = groupMeshes.size();
+        for (const Mesh& mesh: groupMeshes)
+        {
+            CachedMesh cachedMesh;
+            memset(static_cast<void*>(&cachedMesh), 0, sizeof(cachedMesh));
+            cachedMesh.transform = mesh.transform;
+            cachedMesh.material = mesh.material;
+            cachedMesh.fileName.offset = strings.size();
+            cachedMesh.fileName.count = mesh.fileName.size();
+            strings += mesh.fileName;
+            meshes.push_back(cachedMesh);
+        }
+        return group;
+    };
+
+    header.scene = saveGroup(std::string(), scene.spheres, scene.meshes, scene.sphereBVH);
+    std::vector<CachedGroup> prototypes;
+    for (const Prototype& prototype: scene.prototypes)
+        prototypes.push_back(saveGroup(prototype.name, prototype.spheres, prototype.meshes, prototype.sphereBVH));
+    header.instanceNodes = nodes.append(scene.instanceBVH.nodes(), scene.instanceBVH.nodeCount());
+    header.instanceIndices = indices.append(scene.instanceBVH.indices(), scene.instanceBVH.indexCount());
+
+    size_t offset = sizeof(Header);
+    header.spheres = layoutSection<Sphere>(offset, spheres.count);
+    header.planes = layoutSection<Plane>(offset, scene.planes.size());
+    header.nodes = layoutSection<BVHNode>(offset, nodes.count);
+    header.indices = layoutSection<uint32_t>(offset, indices.count);
+    header.meshes = layoutSection<CachedMesh>(offset, meshes.size());
+    header.strings = layoutSection<char>(offset, strings.size());
+    header.prototypes = layoutSection<CachedGroup>(offset, prototypes.size());
+    header.instances = layoutSection<Instance>(offset, scene.instances.size());
+
+    std::string tempName = tempFileName(fileName);
+    FILE* file = fopen(tempName.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool ok =
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        spheres.write(file, header.spheres) &&
+        writeSection(file, header.planes, scene.planes.data(), scene.planes.size() * sizeof(Plane)) &&
+        nodes.write(file, header.nodes) &&
+        indices.write(file, header.indices) &&
+        writeSection(file, header.meshes, meshes.data(), meshes.size() * sizeof(CachedMesh)) &&
+        writeSection(file, header.strings, strings.data(), strings.size()) &&
+        writeSection(file, header.prototypes, prototypes.data(), prototypes.size() * sizeof(CachedGroup)) &&
+        writeSection(file, header.instances, scene.instances.data(), scene.instances.size() * sizeof(Instance));
+    return commit(file, ok, tempName, fileName);
+}
+
+bool Cache::loadMesh(MeshData& mesh, const std::string& fileName, uint64_t key)
+{
+    std::shared_ptr<MappedFile> file = MappedFile::open(fileName);
+    if (!file || file->size() < sizeof(MeshHeader))
+        return false;
+
+    MeshHeader header;
+    memcpy(static_cast<void*>(&header), file->data(), sizeof(header));
+    if (memcmp(header.magic, g_meshMagic, sizeof(g_meshMagic)) ||
+        header.version != g_meshVersion ||
+        header.headerSize != sizeof(MeshHeader) ||
+        header.key != key ||
+        header.triangleSize != sizeof(Triangle) ||
+        header.nodeSize != sizeof(BVHNode))
+        return false;
+
+    if (!validSection<Triangle>(header.triangles, file->size()) ||
+        !validSection<BVHNode>(header.nodes, file->size()) ||
+        !validSection<uint32_t>(header.indices, file->size()) ||
+        header.indices.count != header.triangles.count ||
+        !validHierarchy(sectionData<BVHNode>(*file, header.nodes), header.nodes.count,
+                        sectionData<uint32_t>(*file, header.indices), header.indices.count,
+                        header.triangles.count))
+        return false;
+
+    // Both the triangles and their hierarchy are used in place.
+    BVH bvh;
+    bvh.assign(sectionData<BVHNode>(*file, header.nodes), header.nodes.count,
+               sectionData<uint32_t>(*file, header.indices), header.indices.count,
+               file);
+    mesh.assign(sectionData<Triangle>(*file, header.triangles), header.triangles.count, bvh, file);
+    return true;
+}
+
+bool Cache::saveMesh(const MeshData& mesh, const std::string& fileName, uint64_t key)
+{
+    MeshHeader header;
+    memset(static_cast<void*>(&header), 0, sizeof(header));
+    memcpy(header.magic, g_meshMagic, sizeof(g_meshMagic));
+    header.version = g_meshVersion;
+    header.headerSize = sizeof(MeshHeader);
+    header.key = key;
+    header.triangleSize = sizeof(Triangle);
+    header.nodeSize = sizeof(BVHNode);
+
+    const BVH& bvh = mesh.bvh();
+    size_t offset = sizeof(MeshHeader);
+    header.triangles = layoutSection<Triangle>(offset, mesh.triangleCount());
+    header.nodes = layoutSection<BVHNode>(offset, bvh.nodeCount());
+    header.indices = layoutSection<uint32_t>(offset, bvh.indexCount());
+
+    std::string tempName = tempFileName(fileName);
+    FILE* file = fopen(tempName.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool ok =
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        writeSection(file, header.triangles, mesh.triangles(), mesh.triangleCount() * sizeof(Triangle)) &&
+        writeSection(file, header.nodes, bvh.nodes(), bvh.nodeCount() * sizeof(BVHNode)) &&
+        writeSection(file, header.indices, bvh.indices(), bvh.indexCount() * sizeof(uint32_t));
+    return commit(file, ok, tempName, fileName);
+}
@@ -0,0 +1,39 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef SCENE_CACHE_H
+#define SCENE_CACHE_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+
+namespace scene
+{
+
+class MeshData;
+class Scene;
+
+/**
+ *  Compiled binary form of a scene, including its bounding volume hierarchy.
+ *  The cache is memory mapped when loaded and the hierarchy is used directly
+ *  from the mapping. Each cache file is tagged with a key derived from the
+ *  source it was compiled from so that stale caches are ignored.
+ */
+class Cache
+{
+public:
+    static uint64_t hash(const char* data, size_t size, uint64_t seed = 0);
+
+    static bool load(Scene& scene, const std::string& fileName, uint64_t key);
+    static bool save(const Scene& scene, const std::string& fileName, uint64_t key);
+
+    /**
+     *  Compiled triangles and hierarchy of a single mesh file. Meshes are
+     *  cached separately from scenes since many scenes can share them.
+     */
+    static bool loadMesh(MeshData& mesh, const std::string& fileName, uint64_t key);
+    static bool saveMesh(const MeshData& mesh, const std::string& fileName, uint64_t key);
+};
+
+}
+
+#endif
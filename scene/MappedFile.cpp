@@ -0,0 +1,59 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace scene;
+
+MappedFile::MappedFile(const char* data, size_t size):
+    m_data(data),
+    m_size(size)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_size)
+        munmap(const_cast<char*>(m_data), m_size);
+}
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& fileName)
+{
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    // Empty files cannot be mapped, but are still valid.
+    if (!info.st_size)
+    {
+        close(fd);
+        static const char empty = 0;
+        return std::shared_ptr<MappedFile>(new MappedFile(&empty, 0));
+    }
+
+    void* data = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return nullptr;
+    return std::shared_ptr<MappedFile>(new MappedFile(static_cast<const char*>(data), info.st_size));
+}
+
+const char* MappedFile::data() const
+{
+    return m_data;
+}
+
+size_t MappedFile::size() const
+{
+    return m_size;
+}
@@ -0,0 +1,36 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef SCENE_MAPPEDFILE_H
+#define SCENE_MAPPEDFILE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace scene
+{
+
+/**
+ *  Read-only memory mapping of a whole file.
+ */
+class MappedFile
+{
+public:
+    ~MappedFile();
+
+    static std::shared_ptr<MappedFile> open(const std::string& fileName);
+
+    const char* data() const;
+    size_t size() const;
+
+private:
+    MappedFile(const char* data, size_t size);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* m_data;
+    size_t m_size;
+};
+
+}
+
+#endif
@@ -0,0 +1,132 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#include "Mesh.h"
+#include "Cache.h"
+#include "MappedFile.h"
+
+#include <cstring>
+#include <vector>
+
+using namespace scene;
+
+namespace
+{
+
+const char g_magic[8] = {'K', 'A', 'J', 'O', 'M', 'S', 'H', 0};
+const uint32_t g_version = 1;
+
+struct MeshFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    uint32_t reserved;
+};
+
+}
+
+AABB Triangle::bounds() const
+{
+    AABB box(v0, v0);
+    box.extend(v1);
+    box.extend(v2);
+    return box;
+}
+
+MeshData::MeshData():
+    m_triangleCount(0)
+{
+}
+
+std::shared_ptr<const MeshData> MeshData::load(const std::string& fileName)
+{
+    std::shared_ptr<MappedFile> file = MappedFile::open(fileName);
+    if (!file)
+        return nullptr;
+
+    std::shared_ptr<MeshData> mesh = std::make_shared<MeshData>();
+    uint64_t cacheKey = Cache::hash(file->data(), file->size());
+    std::string cacheFileName = fileName + ".cache";
+    if (Cache::loadMesh(*mesh, cacheFileName, cacheKey))
+        return mesh;
+
+    MeshFileHeader header;
+    if (file->size() < sizeof(header))
+        return nullptr;
+    memcpy(&header, file->data(), sizeof(header));
+    if (memcmp(header.magic, g_magic, sizeof(g_magic)) || header.version != g_version)
+        return nullptr;
+
+    uint64_t positionsSize = uint64_t(header.vertexCount) * 3 * sizeof(float);
+    uint64_t indicesSize = uint64_t(header.triangleCount) * 3 * sizeof(uint32_t);
+    if (sizeof(header) + positionsSize + indicesSize > file->size())
+        return nullptr;
+
+    const char* data = file->data() + sizeof(header);
+    if (!mesh->build(reinterpret_cast<const float*>(data), header.vertexCount,
+                     reinterpret_cast<const uint32_t*>(data + positionsSize), header.triangleCount))
+        return nullptr;
+
+    Cache::saveMesh(*mesh, cacheFileName, cacheKey);
+    return mesh;
+}
+
+bool MeshData::build(const float* positions, size_t vertexCount,
+                     const uint32_t* indices, size_t triangleCount)
+{
+    std::vector<Triangle> triangles(triangleCount);
+    std::vector<AABB> bounds(triangleCount);
+    for (size_t i = 0; i < triangleCount; i++)
+    {
+        glm::vec3* vertices[3] = {&triangles[i].v0, &triangles[i].v1, &triangles[i].v2};
+        for (int j = 0; j < 3; j++)
+        {
+            uint32_t index = indices[i * 3 + j];
+            if (index >= vertexCount)
+                return false;
+            *vertices[j] = glm::vec3(positions[index * 3], positions[index * 3 + 1], positions[index * 3 + 2]);
+        }
+        bounds[i] = triangles[i].bounds();
+    }
+
+    BVH bvh;
+    bvh.build(bounds);
+
+    // Store the triangles in leaf order.
+    auto storage = std::make_shared<std::vector<Triangle>>(triangleCount);
+    for (size_t i = 0; i < triangleCount; i++)
+        (*storage)[i] = triangles[bvh.indices()[i]];
+
+    assign(storage->data(), triangleCount, bvh, storage);
+    return true;
+}
+
+void MeshData::assign(const Triangle* triangles, size_t triangleCount,
+                      const BVH& bvh, std::shared_ptr<const void> storage)
+{
+    m_triangles = std::shared_ptr<const Triangle>(storage, triangles);
+    m_triangleCount = triangleCount;
+    m_bvh = bvh;
+}
+
+const Triangle* MeshData::triangles() const
+{
+    return m_triangles.get();
+}
+
+size_t MeshData::triangleCount() const
+{
+    return m_triangleCount;
+}
+
+const BVH& MeshData::bvh() const
+{
+    return m_bvh;
+}
+
+AABB MeshData::bounds() const
+{
+    if (m_bvh.empty())
+        return AABB();
+    return AABB(m_bvh.nodes()[0].min, m_bvh.nodes()[0].max);
+}
@@ -0,0 +1,66 @@
+// Copyright (C) 2013 Sami Kyöstilä
+#ifndef SCENE_MESH_H
+#define SCENE_MESH_H
+
+#include "BVH.h"
+
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+namespace scene
+{
+
+/**
+ *  Triangle with its vertices stored inline so that intersecting it needs no
+ *  index lookups.
+ */
+class Triangle
+{
+public:
+    AABB bounds() const;
+
+    glm::vec3 v0;
+    glm::vec3 v1;
+    glm::vec3 v2;
+};
+
+/**
+ *  Triangles of a mesh file in the leaf order of a per-mesh bounding volume
+ *  hierarchy, so that every leaf covers a contiguous run of triangles.
+ *
+ *  Mesh files are binary: a header of the magic "KAJOMSH\0", a version number
+ *  (1), the vertex count, the triangle count and a reserved word, all
+ *  little-endian 32-bit. The header is followed by the vertex positions as
+ *  three floats each and the triangles as three 32-bit vertex indices each.
+ *  The compiled triangles and hierarchy are cached next to the mesh file and
+ *  memory mapped on later loads.
+ */
+class MeshData
+{
+public:
+    MeshData();
+
+    static std::shared_ptr<const MeshData> load(const std::string& fileName);
+
+    bool build(const float* positions, size_t vertexCount,
+               const uint32_t* indices, size_t triangleCount);
+    void assign(const Triangle* triangles, size_t triangleCount,
+                const BVH& bvh, std::shared_ptr<const void> storage);
+
+    const Triangle* triangles() const;
+    size_t triangleCount() const;
+    const BVH& bvh() const;
+    AABB bounds() const;
+
+private:
+    std::shared_ptr<const Triangle> m_triangles;
+    size_t m_triangleCount;
+    BVH m_bvh;
+};
+
+}
+
+#endif
@@ -1,70 +1,186 @@
 // Copyright (C) 2012 Sami Kyöstilä
 #include "Parser.h"
+#include "Cache.h"
+#include "MappedFile.h"
 #include "Scene.h"
 
-#include <JSON.h>
-#include <fstream>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <future>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <map>
 #include <memory>
-#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace {
 
-int hexToInt(wchar_t digit)
+// Arrays with fewer elements than this per thread are parsed serially.
+const size_t minObjectsPerThread = 256;
+
+const double powersOfTen[] =
 {
-    if (digit >= L'0' && digit <= L'9')
-        return (digit - L'0');
-    else if (digit >= L'A' && digit <= L'F')
-        return (digit - L'A' + 10);
-    else if (digit >= L'a' && digit <= L'f')
-        return (digit - L'a' + 10);
-    return 0;
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ *  A range of characters in the source buffer.
+ */
+class StringView
+{
+public:
+    StringView():
+        begin(nullptr),
+        end(nullptr)
+    {
+    }
+
+    StringView(const char* begin, const char* end):
+        begin(begin),
+        end(end)
+    {
+    }
+
+    size_t size() const
+    {
+        return end - begin;
+    }
+
+    bool equals(const char* s) const
+    {
+        size_t length = strlen(s);
+        return size() == length && !memcmp(begin, s, length);
+    }
+
+    bool startsWith(const char* s) const
+    {
+        size_t length = strlen(s);
+        return size() >= length && !memcmp(begin, s, length);
+    }
+
+    const char* begin;
+    const char* end;
+};
+
+bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
 }
 
-glm::vec4 parseVec4(std::wistream& ss)
+bool isSpace(char c)
 {
-    glm::vec4 result;
-    ss >> result.x;
-    if (ss.peek() == L',')
-        ss.ignore();
-    ss >> result.y;
-    if (ss.peek() == L',')
-        ss.ignore();
-    ss >> result.z;
-    if (ss.peek() == L',')
-        ss.ignore();
-    ss >> result.w;
-    if (ss.peek() == L',')
-        ss.ignore();
-    return result;
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
 }
 
-glm::vec4 parseVec4(const std::wstring& s)
+const char* skipSpaces(const char* p, const char* end)
 {
-    std::wstringstream ss(s);
-    return parseVec4(ss);
+    while (p != end && isSpace(*p))
+        ++p;
+    return p;
 }
 
-glm::vec3 parseVec3(std::wistream& ss)
+/**
+ *  Parses a decimal number starting at @a begin and returns the position
+ *  after it, or @a begin if there is no number. Numbers that fit in a double
+ *  mantissa with a small exponent are converted exactly without going through
+ *  the C library.
+ */
+const char* parseFloat(const char* begin, const char* end, float& result)
 {
-    glm::vec3 result;
-    ss >> result.x;
-    if (ss.peek() == L',')
-        ss.ignore();
-    ss >> result.y;
-    if (ss.peek() == L',')
-        ss.ignore();
-    ss >> result.z;
-    if (ss.peek() == L',')
-        ss.ignore();
-    return result;
+    const char* p = begin;
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    bool seenDigit = false;
+    for (; p != end && isDigit(*p); ++p)
+    {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += (mantissa != 0);
+        seenDigit = true;
+    }
+    if (p != end && *p == '.')
+    {
+        for (++p; p != end && isDigit(*p); ++p)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += (mantissa != 0);
+            exponent--;
+            seenDigit = true;
+        }
+    }
+    if (!seenDigit)
+        return begin;
+
+    if (p != end && (*p == 'e' || *p == 'E'))
+    {
+        const char* e = p + 1;
+        bool negativeExponent = false;
+        if (e != end && (*e == '-' || *e == '+'))
+            negativeExponent = (*e++ == '-');
+        if (e != end && isDigit(*e))
+        {
+            int value = 0;
+            for (; e != end && isDigit(*e); ++e)
+                value = std::min(value * 10 + (*e - '0'), 100000);
+            exponent += negativeExponent ? -value : value;
+            p = e;
+        }
+    }
+
+    if (digits <= 19 && mantissa <= (uint64_t(1) << 53) &&
+        exponent >= -22 && exponent <= 22)
+    {
+        double value = double(mantissa);
+        value = (exponent < 0) ? value / powersOfTen[-exponent] : value * powersOfTen[exponent];
+        result = float(negative ? -value : value);
+        return p;
+    }
+
+    std::string number(begin, p);
+    result = float(strtod(number.c_str(), nullptr));
+    return p;
 }
 
-glm::vec3 parseVec3(const std::wstring& s)
+/**
+ *  Reads up to @a count numbers separated by commas or whitespace. Values
+ *  that are missing are left untouched.
+ */
+const char* parseNumbers(const char* p, const char* end, float* values, int count)
 {
-    std::wstringstream ss(s);
-    return parseVec3(ss);
+    for (int i = 0; i < count; ++i)
+    {
+        p = skipSpaces(p, end);
+        const char* next = parseFloat(p, end, values[i]);
+        if (next == p)
+            break;
+        p = skipSpaces(next, end);
+        if (p != end && *p == ',')
+            ++p;
+    }
+    return p;
+}
+
+int hexToInt(char digit)
+{
+    if (digit >= '0' && digit <= '9')
+        return (digit - '0');
+    else if (digit >= 'A' && digit <= 'F')
+        return (digit - 'A' + 10);
+    else if (digit >= 'a' && digit <= 'f')
+        return (digit - 'a' + 10);
+    return 0;
 }
 
 glm::vec4 srgbToLinear(const glm::vec4& color)
@@ -72,161 +188,841 @@ glm::vec4 srgbToLinear(const glm::vec4& color)
     return glm::pow(color, glm::vec4(2.2f));
 }
 
-glm::vec4 parseColor(const std::wstring& value)
+glm::vec4 parseColor(const StringView& value)
 {
+    const char* s = value.begin;
     glm::vec4 result;
-    if (value.size() == 4 && value[0] == L'#') {
-        result = glm::vec4(hexToInt(value[1]) / 15.f, hexToInt(value[2]) / 15.f, hexToInt(value[3]) / 15.f, 1);
-    } else if (value.size() == 7 && value[0] == L'#') {
+    if (value.size() == 4 && s[0] == '#') {
+        result = glm::vec4(hexToInt(s[1]) / 15.f, hexToInt(s[2]) / 15.f, hexToInt(s[3]) / 15.f, 1);
+    } else if (value.size() == 7 && s[0] == '#') {
         result = glm::vec4(
-                (hexToInt(value[1]) * 16 + hexToInt(value[2])) / 255.f,
-                (hexToInt(value[3]) * 16 + hexToInt(value[4])) / 255.f,
-                (hexToInt(value[5]) * 16 + hexToInt(value[6])) / 255.f, 1);
-    } else if (value.size() >= 6 && value.find(L"rgba(") == 0) {
-        result = parseVec4(value.substr(5));
-    } else if (value.size() >= 5 && value.find(L"rgb(") == 0) {
-        result = glm::vec4(parseVec3(value.substr(4)), 1);
+                (hexToInt(s[1]) * 16 + hexToInt(s[2])) / 255.f,
+                (hexToInt(s[3]) * 16 + hexToInt(s[4])) / 255.f,
+                (hexToInt(s[5]) * 16 + hexToInt(s[6])) / 255.f, 1);
+    } else if (value.size() >= 6 && value.startsWith("rgba(")) {
+        float c[4] = {0, 0, 0, 0};
+        parseNumbers(s + 5, value.end, c, 4);
+        result = glm::vec4(c[0], c[1], c[2], c[3]);
+    } else if (value.size() >= 5 && value.startsWith("rgb(")) {
+        float c[3] = {0, 0, 0};
+        parseNumbers(s + 4, value.end, c, 3);
+        result = glm::vec4(c[0], c[1], c[2], 1);
     }
     result = srgbToLinear(result);
     return result;
 }
 
-bool expect(std::wistream& s, const std::wstring& expected)
-{
-    std::wstring word;
-    s >> word;
-    return word == expected;
-}
-
-glm::mat4 parseTransform(const std::wstring& value)
+glm::mat4 parseTransform(const StringView& value)
 {
-    std::wstringstream ss(value);
-    std::wstring command;
-
     glm::mat4 result;
-    while (std::getline(ss, command, L'('))
+    const char* p = value.begin;
+    const char* end = value.end;
+    while (true)
     {
-        if (command == L"lookat")
+        p = skipSpaces(p, end);
+        const char* paren = static_cast<const char*>(memchr(p, '(', end - p));
+        if (!paren)
+            break;
+        StringView command(p, paren);
+        p = paren + 1;
+
+        float params[9] = {0};
+        if (command.equals("lookat"))
         {
-            const int paramCount = 9;
-            float params[paramCount] = {0};
-            for (int i = 0; i < paramCount; ++i)
-            {
-                if (!(ss >> params[i]))
-                    break;
-                if (ss.peek() == L',')
-                    ss.ignore();
-            }
-            expect(ss, L")");
+            p = parseNumbers(p, end, params, 9);
             result *= glm::lookAt(
                     glm::vec3(params[0], params[1], params[2]),
                     glm::vec3(params[3], params[4], params[5]),
                     glm::vec3(params[6], params[7], params[8]));
         }
-        else if (command == L"translate")
+        else if (command.equals("translate"))
         {
-            glm::vec3 offset = parseVec3(ss);
-            expect(ss, L")");
-            result = glm::translate(result, offset);
+            p = parseNumbers(p, end, params, 3);
+            result = glm::translate(result, glm::vec3(params[0], params[1], params[2]));
         }
-        else if (command == L"scale")
+        else if (command.equals("scale"))
         {
-            glm::vec3 scale = parseVec3(ss);
-            expect(ss, L")");
-            result = glm::scale(result, scale);
+            p = parseNumbers(p, end, params, 3);
+            result = glm::scale(result, glm::vec3(params[0], params[1], params[2]));
         }
-        else if (command == L"rotate")
+        else if (command.equals("rotate"))
         {
-            glm::vec4 rotation = parseVec4(ss);
-            expect(ss, L")");
-            result = glm::rotate(result, rotation.x, glm::vec3(rotation.y, rotation.z, rotation.w));
+            p = parseNumbers(p, end, params, 4);
+            result = glm::rotate(result, params[0], glm::vec3(params[1], params[2], params[3]));
         }
-        while (ss.peek() == L' ')
-            ss.ignore();
+
+        const char* close = static_cast<const char*>(memchr(p, ')', end - p));
+        if (!close)
+            break;
+        p = close + 1;
     }
     return result;
 }
 
-scene::Camera parseCamera(JSONObject data, float aspectRatio)
+/**
+ *  Single pass JSON reader working directly on the source buffer. Trailing
+ *  commas are accepted in objects and arrays since the scene files use them.
+ */
+class Reader
 {
-    scene::Camera camera;
-    if (data.find(L"projection") != data.end())
+public:
+    Reader(const char* begin, const char* end):
+        m_pos(begin),
+        m_end(end)
+    {
+    }
+
+    const char* position() const
+    {
+        return m_pos;
+    }
+
+    bool atEnd()
+    {
+        m_pos = skipSpaces(m_pos, m_end);
+        return m_pos == m_end;
+    }
+
+    bool consume(char c)
+    {
+        m_pos = skipSpaces(m_pos, m_end);
+        if (m_pos == m_end || *m_pos != c)
+            return false;
+        ++m_pos;
+        return true;
+    }
+
+    /**
+     *  Consumes the comma after an object member or array element. Without a
+     *  comma the container must end next.
+     */
+    bool separator(char close)
+    {
+        if (consume(','))
+            return true;
+        return m_pos != m_end && *m_pos == close;
+    }
+
+    /**
+     *  Reads a string. Strings without escape sequences point into the
+     *  source buffer; others are decoded into a scratch buffer that is only
+     *  valid until the next string is read.
+     */
+    bool readString(StringView& result)
+    {
+        if (!consume('"'))
+            return false;
+        const char* begin = m_pos;
+        while (m_pos != m_end && *m_pos != '"' && *m_pos != '\\')
+            ++m_pos;
+        if (m_pos == m_end)
+            return false;
+        if (*m_pos == '"')
+        {
+            result = StringView(begin, m_pos++);
+            return true;
+        }
+
+        m_scratch.assign(begin, m_pos);
+        while (m_pos != m_end && *m_pos != '"')
+        {
+            if (*m_pos != '\\')
+            {
+                m_scratch += *m_pos++;
+                continue;
+            }
+            if (++m_pos == m_end)
+                return false;
+            char c = *m_pos++;
+            switch (c)
+            {
+            case 'b': m_scratch += '\b'; break;
+            case 'f': m_scratch += '\f'; break;
+            case 'n': m_scratch += '\n'; break;
+            case 'r': m_scratch += '\r'; break;
+            case 't': m_scratch += '\t'; break;
+            case 'u':
+                if (!readCodePoint())
+                    return false;
+                break;
+            default: m_scratch += c; break;
+            }
+        }
+        if (m_pos == m_end)
+            return false;
+        ++m_pos;
+        result = StringView(m_scratch.data(), m_scratch.data() + m_scratch.size());
+        return true;
+    }
+
+    bool readNumber(float& result)
+    {
+        m_pos = skipSpaces(m_pos, m_end);
+        const char* next = parseFloat(m_pos, m_end, result);
+        if (next == m_pos)
+            return false;
+        m_pos = next;
+        return true;
+    }
+
+    bool skipValue()
+    {
+        m_pos = skipSpaces(m_pos, m_end);
+        if (m_pos == m_end)
+            return false;
+
+        StringView string;
+        switch (*m_pos)
+        {
+        case '"':
+            return readString(string);
+        case '{':
+            ++m_pos;
+            while (!consume('}'))
+            {
+                if (!readString(string) || !consume(':') || !skipValue() || !separator('}'))
+                    return false;
+            }
+            return true;
+        case '[':
+            ++m_pos;
+            while (!consume(']'))
+            {
+                if (!skipValue() || !separator(']'))
+                    return false;
+            }
+            return true;
+        }
+
+        // Numbers and literals.
+        const char* begin = m_pos;
+        while (m_pos != m_end && (isalnum(*m_pos) || *m_pos == '-' || *m_pos == '+' || *m_pos == '.'))
+            ++m_pos;
+        return m_pos != begin;
+    }
+
+private:
+    int readHex4()
+    {
+        if (m_end - m_pos < 4)
+            return -1;
+        int value = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            char c = *m_pos++;
+            if (!isxdigit(c))
+                return -1;
+            value = value * 16 + hexToInt(c);
+        }
+        return value;
+    }
+
+    bool readCodePoint()
     {
-        std::wstring projection = data[L"projection"]->AsString();
-        if (projection.find(L"perspective(") == 0)
+        int codePoint = readHex4();
+        if (codePoint < 0)
+            return false;
+        if (codePoint >= 0xd800 && codePoint < 0xdc00 &&
+            m_end - m_pos >= 6 && m_pos[0] == '\\' && m_pos[1] == 'u')
+        {
+            m_pos += 2;
+            int low = readHex4();
+            if (low < 0xdc00 || low >= 0xe000)
+                return false;
+            codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+        }
+
+        if (codePoint < 0x80)
+            m_scratch += char(codePoint);
+        else if (codePoint < 0x800)
+        {
+            m_scratch += char(0xc0 | (codePoint >> 6));
+            m_scratch += char(0x80 | (codePoint & 0x3f));
+        }
+        else if (codePoint < 0x10000)
+        {
+            m_scratch += char(0xe0 | (codePoint >> 12));
+            m_scratch += char(0x80 | ((codePoint >> 6) & 0x3f));
+            m_scratch += char(0x80 | (codePoint & 0x3f));
+        }
+        else
         {
-            std::wstringstream ss(projection.substr(12));
-            glm::vec3 p = parseVec3(ss);
-            camera.projection = glm::perspective(p.x, aspectRatio, p.y, p.z);
+            m_scratch += char(0xf0 | (codePoint >> 18));
+            m_scratch += char(0x80 | ((codePoint >> 12) & 0x3f));
+            m_scratch += char(0x80 | ((codePoint >> 6) & 0x3f));
+            m_scratch += char(0x80 | (codePoint & 0x3f));
         }
+        return true;
     }
-    if (data.find(L"transform") != data.end())
-        camera.transform = parseTransform(data[L"transform"]->AsString());
-    return camera;
+
+    const char* m_pos;
+    const char* m_end;
+    std::string m_scratch;
+};
+
+bool readColor(Reader& reader, glm::vec4& color)
+{
+    StringView value;
+    if (!reader.readString(value))
+        return false;
+    color = parseColor(value);
+    return true;
+}
+
+bool readTransform(Reader& reader, glm::mat4& transform)
+{
+    StringView value;
+    if (!reader.readString(value))
+        return false;
+    transform = parseTransform(value);
+    return true;
 }
 
-void parseObjects(scene::Scene& scene, JSONArray data)
+bool parseCamera(Reader& reader, scene::Camera& camera, float aspectRatio)
 {
-    for (size_t i = 0; i < data.size(); i++)
+    if (!reader.consume('{'))
+        return false;
+    while (!reader.consume('}'))
     {
-        JSONObject objectData = data[i]->AsObject();
-        if (objectData.find(L"type") == objectData.end())
-            continue;
+        StringView key;
+        if (!reader.readString(key) || !reader.consume(':'))
+            return false;
+
+        bool ok;
+        if (key.equals("projection"))
+        {
+            StringView projection;
+            ok = reader.readString(projection);
+            if (ok && projection.startsWith("perspective("))
+            {
+                float p[3] = {0, 0, 0};
+                parseNumbers(projection.begin + 12, projection.end, p, 3);
+                camera.projection = glm::perspective(p[0], aspectRatio, p[1], p[2]);
+            }
+        }
+        else if (key.equals("transform"))
+            ok = readTransform(reader, camera.transform);
+        else
+            ok = reader.skipValue();
 
-        scene::Material material;
-        if (objectData.find(L"diffuse") != objectData.end())
-            material.diffuse = parseColor(objectData[L"diffuse"]->AsString());
-        if (objectData.find(L"specular") != objectData.end())
-            material.specular = parseColor(objectData[L"specular"]->AsString());
-        if (objectData.find(L"specularExponent") != objectData.end())
-            material.specularExponent = objectData[L"specularExponent"]->AsNumber();
-        if (objectData.find(L"emission") != objectData.end())
-            material.emission = parseColor(objectData[L"emission"]->AsString());
-        if (objectData.find(L"transparency") != objectData.end())
-            material.transparency = parseColor(objectData[L"transparency"]->AsString());
-        if (objectData.find(L"refractiveIndex") != objectData.end())
-            material.refractiveIndex = objectData[L"refractiveIndex"]->AsNumber();
+        if (!ok || !reader.separator('}'))
+            return false;
+    }
+    return true;
+}
 
-        glm::mat4 transform;
-        if (objectData.find(L"transform") != objectData.end())
-            transform = parseTransform(objectData[L"transform"]->AsString());
+enum class ObjectType
+{
+    None,
+    Sphere,
+    Plane,
+    Mesh,
+    Instance
+};
 
-        if (objectData[L"type"]->AsString() == L"sphere")
+/**
+ *  Returns the object type called |name|, or |type| if the name is unknown.
+ */
+ObjectType objectType(const StringView& name, ObjectType type)
+{
+    if (name.equals("sphere"))
+        return ObjectType::Sphere;
+    else if (name.equals("plane"))
+        return ObjectType::Plane;
+    else if (name.equals("mesh"))
+        return ObjectType::Mesh;
+    else if (name.equals("instance"))
+        return ObjectType::Instance;
+    return type;
+}
+
+/**
+ *  Number of objects of each type, or the position of the next object of
+ *  each type in an ObjectList.
+ */
+class ObjectCounts
+{
+public:
+    ObjectCounts():
+        spheres(0),
+        planes(0),
+        meshes(0),
+        instances(0)
+    {
+    }
+
+    void add(ObjectType type)
+    {
+        spheres += (type == ObjectType::Sphere);
+        planes += (type == ObjectType::Plane);
+        meshes += (type == ObjectType::Mesh);
+        instances += (type == ObjectType::Instance);
+    }
+
+    size_t spheres;
+    size_t planes;
+    size_t meshes;
+    size_t instances;
+};
+
+/**
+ *  Destination of parsed objects, which are moved into the lists. Objects are
+ *  appended to the lists, unless the lists were sized beforehand and the
+ *  list is told to overwrite them from a given position on.
+ */
+class ObjectList
+{
+public:
+    ObjectList(scene::SphereList& spheres, scene::PlaneList& planes, scene::MeshList& meshes,
+               scene::InstanceList& instances, std::vector<std::string>& instancePrototypes):
+        m_spheres(spheres),
+        m_planes(planes),
+        m_meshes(meshes),
+        m_instances(instances),
+        m_instancePrototypes(instancePrototypes)
+    {
+        m_next.spheres = spheres.size();
+        m_next.planes = planes.size();
+        m_next.meshes = meshes.size();
+        m_next.instances = instances.size();
+    }
+
+    void seek(const ObjectCounts& position)
+    {
+        m_next = position;
+    }
+
+    void add(scene::Sphere& sphere)
+    {
+        store(m_spheres, m_next.spheres++, sphere);
+    }
+
+    void add(scene::Plane& plane)
+    {
+        store(m_planes, m_next.planes++, plane);
+    }
+
+    void add(scene::Mesh& mesh)
+    {
+        store(m_meshes, m_next.meshes++, mesh);
+    }
+
+    /**
+     *  Adds an instance of the prototype called |prototype|, which is resolved
+     *  once all prototypes are known.
+     */
+    void add(scene::Instance& instance, std::string& prototype)
+    {
+        store(m_instances, m_next.instances, instance);
+        store(m_instancePrototypes, m_next.instances++, prototype);
+    }
+
+private:
+    template<typename T>
+    static void store(std::vector<T>& list, size_t index, T& value)
+    {
+        if (index < list.size())
+            list[index] = std::move(value);
+        else
+            list.push_back(std::move(value));
+    }
+
+    scene::SphereList& m_spheres;
+    scene::PlaneList& m_planes;
+    scene::MeshList& m_meshes;
+    scene::InstanceList& m_instances;
+    std::vector<std::string>& m_instancePrototypes;
+    ObjectCounts m_next;
+};
+
+/**
+ *  Skips an object and returns the type it declares. Like parseObject(), the
+ *  last known type member wins.
+ */
+bool readObjectType(Reader& reader, ObjectType& type)
+{
+    if (!reader.consume('{'))
+        return false;
+
+    type = ObjectType::None;
+    while (!reader.consume('}'))
+    {
+        StringView key;
+        if (!reader.readString(key) || !reader.consume(':'))
+            return false;
+
+        bool ok;
+        if (key.equals("type"))
+        {
+            StringView value;
+            ok = reader.readString(value);
+            type = objectType(value, type);
+        }
+        else
+            ok = reader.skipValue();
+
+        if (!ok || !reader.separator('}'))
+            return false;
+    }
+    return true;
+}
+
+bool parseObject(Reader& reader, ObjectList& objects)
+{
+    if (!reader.consume('{'))
+        return false;
+
+    ObjectType type = ObjectType::None;
+    scene::Material material;
+    glm::mat4 transform;
+    float radius = 1;
+    std::string path;
+    std::string prototype;
+
+    while (!reader.consume('}'))
+    {
+        StringView key;
+        if (!reader.readString(key) || !reader.consume(':'))
+            return false;
+
+        bool ok;
+        if (key.equals("type"))
         {
-            scene::Sphere sphere;
-            sphere.radius = objectData[L"radius"]->AsNumber();
-            sphere.material = material;
-            sphere.transform = transform;
-            scene.spheres.push_back(sphere);
+            StringView value;
+            ok = reader.readString(value);
+            type = objectType(value, type);
         }
-        else if (objectData[L"type"]->AsString() == L"plane")
+        else if (key.equals("path"))
         {
-            scene::Plane plane;
-            plane.material = material;
-            plane.transform = transform;
-            scene.planes.push_back(plane);
+            StringView value;
+            ok = reader.readString(value);
+            path.assign(value.begin, value.end);
         }
+        else if (key.equals("prototype"))
+        {
+            StringView value;
+            ok = reader.readString(value);
+            prototype.assign(value.begin, value.end);
+        }
+        else if (key.equals("radius"))
+            ok = reader.readNumber(radius);
+        else if (key.equals("diffuse"))
+            ok = readColor(reader, material.diffuse);
+        else if (key.equals("specular"))
+            ok = readColor(reader, material.specular);
+        else if (key.equals("specularExponent"))
+            ok = reader.readNumber(material.specularExponent);
+        else if (key.equals("emission"))
+            ok = readColor(reader, material.emission);
+        else if (key.equals("transparency"))
+            ok = readColor(reader, material.transparency);
+        else if (key.equals("refractiveIndex"))
+            ok = reader.readNumber(material.refractiveIndex);
+        else if (key.equals("transform"))
+            ok = readTransform(reader, transform);
+        else
+            ok = reader.skipValue();
+
+        if (!ok || !reader.separator('}'))
+            return false;
+    }
+
+    if (type == ObjectType::Sphere)
+    {
+        scene::Sphere sphere;
+        sphere.radius = radius;
+        sphere.material = material;
+        sphere.transform = transform;
+        objects.add(sphere);
+    }
+    else if (type == ObjectType::Plane)
+    {
+        scene::Plane plane;
+        plane.material = material;
+        plane.transform = transform;
+        objects.add(plane);
     }
+    else if (type == ObjectType::Mesh)
+    {
+        scene::Mesh mesh;
+        mesh.material = material;
+        mesh.transform = transform;
+        mesh.fileName = path;
+        objects.add(mesh);
+    }
+    else if (type == ObjectType::Instance)
+    {
+        scene::Instance instance;
+        instance.transform = transform;
+        objects.add(instance, prototype);
+    }
+    return true;
+}
+
+/**
+ *  Parses a run of array elements. The range may end with the comma that
+ *  separates it from the next run.
+ */
+bool parseObjectRange(const char* begin, const char* end, ObjectList& objects)
+{
+    Reader reader(begin, end);
+    while (!reader.atEnd())
+    {
+        if (!parseObject(reader, objects))
+            return false;
+        reader.consume(',');
+    }
+    return true;
+}
+
+/**
+ *  Parses the object array. The elements and their types are first found
+ *  with a quick structural scan, which sizes the object lists of the scene.
+ *  Large arrays are then split into contiguous runs that are parsed in
+ *  parallel straight into their place in the lists.
+ */
+bool parseObjects(Reader& reader, scene::Scene& scene, std::vector<std::string>& instancePrototypes)
+{
+    if (!reader.consume('['))
+        return false;
+
+    std::vector<const char*> elements;
+    std::vector<ObjectType> types;
+    while (!reader.consume(']'))
+    {
+        ObjectType type;
+        elements.push_back(reader.position());
+        if (!readObjectType(reader, type) || !reader.separator(']'))
+            return false;
+        types.push_back(type);
+    }
+    if (elements.empty())
+        return true;
+    elements.push_back(reader.position() - 1);
+
+    size_t objectCount = elements.size() - 1;
+    size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+    size_t runCount = std::max<size_t>(1, std::min(threadCount, objectCount / minObjectsPerThread));
+
+    // Find where the objects of each run start in the lists.
+    std::vector<ObjectCounts> runStarts(runCount + 1);
+    runStarts[0].spheres = scene.spheres.size();
+    runStarts[0].planes = scene.planes.size();
+    runStarts[0].meshes = scene.meshes.size();
+    runStarts[0].instances = scene.instances.size();
+    for (size_t i = 0; i < runCount; i++)
+    {
+        runStarts[i + 1] = runStarts[i];
+        for (size_t j = objectCount * i / runCount; j < objectCount * (i + 1) / runCount; j++)
+            runStarts[i + 1].add(types[j]);
+    }
+    scene.spheres.resize(runStarts[runCount].spheres);
+    scene.planes.resize(runStarts[runCount].planes);
+    scene.meshes.resize(runStarts[runCount].meshes);
+    scene.instances.resize(runStarts[runCount].instances);
+    instancePrototypes.resize(runStarts[runCount].instances);
+
+    std::vector<std::future<bool> > results;
+    for (size_t i = 0; i < runCount; i++)
+    {
+        const char* begin = elements[objectCount * i / runCount];
+        const char* end = elements[objectCount * (i + 1) / runCount];
+        ObjectCounts start = runStarts[i];
+        std::launch policy = (runCount > 1) ? std::launch::async : std::launch::deferred;
+        results.push_back(std::async(policy, [=, &scene, &instancePrototypes]() {
+            ObjectList objects(scene.spheres, scene.planes, scene.meshes, scene.instances, instancePrototypes);
+            objects.seek(start);
+            return parseObjectRange(begin, end, objects);
+        }));
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < runCount; i++)
+        ok = results[i].get() && ok;
+    return ok;
+}
+
+/**
+ *  Parses the prototype object, which maps prototype names to object
+ *  arrays. Prototypes may only contain spheres and meshes.
+ */
+bool parsePrototypes(Reader& reader, scene::Scene& scene)
+{
+    if (!reader.consume('{'))
+        return false;
+    while (!reader.consume('}'))
+    {
+        StringView key;
+        if (!reader.readString(key) || !reader.consume(':'))
+            return false;
+
+        scene::Prototype prototype;
+        prototype.name.assign(key.begin, key.end);
+
+        scene::PlaneList planes;
+        scene::InstanceList instances;
+        std::vector<std::string> instancePrototypes;
+        ObjectList objects(prototype.spheres, planes, prototype.meshes, instances, instancePrototypes);
+        if (!reader.consume('['))
+            return false;
+        while (!reader.consume(']'))
+        {
+            if (!parseObject(reader, objects) || !reader.separator(']'))
+                return false;
+        }
+        if (!planes.empty() || !instances.empty())
+            std::cerr << "Warning: ignoring planes and instances in prototype " << prototype.name << std::endl;
+
+        // Only the spheres of the scene itself are sampled as lights.
+        for (const scene::Sphere& sphere: prototype.spheres)
+        {
+            if (sphere.material.emission != glm::vec4(0))
+            {
+                std::cerr << "Warning: emissive spheres in prototype " << prototype.name
+                          << " do not light the scene" << std::endl;
+                break;
+            }
+        }
+
+        scene.prototypes.push_back(std::move(prototype));
+
+        if (!reader.separator('}'))
+            return false;
+    }
+    return true;
+}
+
+bool resolveInstances(scene::Scene& scene, const std::vector<std::string>& instancePrototypes)
+{
+    std::map<std::string, uint32_t> prototypes;
+    for (size_t i = 0; i < scene.prototypes.size(); i++)
+        prototypes[scene.prototypes[i].name] = i;
+
+    for (size_t i = 0; i < scene.instances.size(); i++)
+    {
+        auto prototype = prototypes.find(instancePrototypes[i]);
+        if (prototype == prototypes.end())
+        {
+            std::cerr << "Unknown prototype: " << instancePrototypes[i] << std::endl;
+            return false;
+        }
+        scene.instances[i].prototype = prototype->second;
+    }
+    return true;
+}
+
+/**
+ *  Loads the contents of every mesh. Relative mesh paths are resolved
+ *  against the directory of the scene file. Meshes referring to the same
+ *  file share its data.
+ */
+bool loadMeshes(scene::Scene& scene, const std::string& sceneFileName)
+{
+    std::string directory;
+    size_t separator = sceneFileName.rfind('/');
+    if (separator != std::string::npos)
+        directory = sceneFileName.substr(0, separator + 1);
+
+    std::vector<scene::Mesh*> meshes;
+    for (scene::Mesh& mesh: scene.meshes)
+        meshes.push_back(&mesh);
+    for (scene::Prototype& prototype: scene.prototypes)
+        for (scene::Mesh& mesh: prototype.meshes)
+            meshes.push_back(&mesh);
+
+    std::map<std::string, std::shared_ptr<const scene::MeshData> > loadedMeshes;
+    for (scene::Mesh* mesh: meshes)
+    {
+        std::string fileName = mesh->fileName;
+        if (fileName.empty() || fileName[0] != '/')
+            fileName = directory + fileName;
+
+        std::shared_ptr<const scene::MeshData>& data = loadedMeshes[fileName];
+        if (!data)
+            data = scene::MeshData::load(fileName);
+        if (!data)
+        {
+            std::cerr << "Failed to load mesh from " << fileName << std::endl;
+            return false;
+        }
+        mesh->data = data;
+    }
+    return true;
 }
 
 } // namespace
 
 bool scene::Parser::load(Scene& scene, const std::string& fileName, float aspectRatio)
 {
-    std::stringstream source;
-    source << std::ifstream(fileName).rdbuf();
-
-    std::unique_ptr<JSONValue> data(JSON::Parse(source.str().c_str()));
-    if (!data || !data->IsObject())
+    std::shared_ptr<MappedFile> source = MappedFile::open(fileName);
+    if (!source)
         return false;
 
-    JSONObject sceneData = data->AsObject();
-    if (sceneData.find(L"background") != sceneData.end())
-        scene.backgroundColor = parseColor(sceneData[L"background"]->AsString());
-    if (sceneData.find(L"camera") != sceneData.end())
-        scene.camera = parseCamera(sceneData[L"camera"]->AsObject(), aspectRatio);
-    if (sceneData.find(L"objects") != sceneData.end())
-        parseObjects(scene, sceneData[L"objects"]->AsArray());
+    // The camera projection depends on the aspect ratio, so it is part of
+    // the cache key.
+    uint32_t aspectRatioBits;
+    memcpy(&aspectRatioBits, &aspectRatio, sizeof(aspectRatioBits));
+    uint64_t cacheKey = Cache::hash(source->data(), source->size(), aspectRatioBits);
+    std::string cacheFileName = fileName + ".cache";
+    if (Cache::load(scene, cacheFileName, cacheKey))
+    {
+        if (!loadMeshes(scene, fileName))
+            return false;
 
+        // The bounds of prototypes with meshes depend on the mesh files,
+        // which may have changed since the cache was written.
+        for (const scene::Prototype& prototype: scene.prototypes)
+        {
+            if (!prototype.meshes.empty())
+            {
+                scene.buildInstanceBVH();
+                break;
+            }
+        }
+        return true;
+    }
+
+    if (!parse(scene, source->data(), source->size(), aspectRatio) ||
+        !loadMeshes(scene, fileName))
+        return false;
+
+    scene.buildBVH();
+    Cache::save(scene, cacheFileName, cacheKey);
     return true;
 }
+
+bool scene::Parser::parse(Scene& scene, const char* source, size_t size, float aspectRatio)
+{
+    const char* end = source + size;
+
+    // Skip a UTF-8 byte order mark.
+    if (size >= 3 && !memcmp(source, "\xef\xbb\xbf", 3))
+        source += 3;
+
+    Reader reader(source, end);
+    std::vector<std::string> instancePrototypes;
+    if (!reader.consume('{'))
+        return false;
+    while (!reader.consume('}'))
+    {
+        StringView key;
+        if (!reader.readString(key) || !reader.consume(':'))
+            return false;
+
+        bool ok;
+        if (key.equals("background"))
+            ok = readColor(reader, scene.backgroundColor);
+        else if (key.equals("camera"))
+            ok = parseCamera(reader, scene.camera, aspectRatio);
+        else if (key.equals("objects"))
+            ok = parseObjects(reader, scene, instancePrototypes);
+        else if (key.equals("prototypes"))
+            ok = parsePrototypes(reader, scene);
+        else
+            ok = reader.skipValue();
+
+        if (!ok || !reader.separator('}'))
+            return false;
+    }
+    return reader.atEnd() && resolveInstances(scene, instancePrototypes);
+}
@@ -2,6 +2,7 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <cstddef>
 #include <string>
 
 namespace scene
@@ -12,7 +13,17 @@ class Scene;
 class Parser
 {
 public:
+    /**
+     *  Loads a scene from a JSON file. A compiled copy of the scene is kept
+     *  next to the source file and used instead of the source as long as the
+     *  source does not change.
+     */
     static bool load(Scene& scene, const std::string& fileName, float aspectRatio);
+
+    /**
+     *  Parses a scene from a UTF-8 JSON buffer in a single pass.
+     */
+    static bool parse(Scene& scene, const char* source, size_t size, float aspectRatio);
 };
 
 }
@@ -1,12 +1,127 @@
 // Copyright (C) 2012 Sami Kyöstilä
 #include "Scene.h"
 
+#include <chrono>
+#include <sstream>
+
 using namespace scene;
 
-Scene::Scene()
+namespace
+{
+
+std::vector<AABB> sphereBounds(const SphereList& spheres)
+{
+    std::vector<AABB> bounds;
+    bounds.reserve(spheres.size());
+    for (const Sphere& sphere: spheres)
+        bounds.push_back(sphere.bounds());
+    return bounds;
+}
+
+}
+
+Scene::Scene():
+    bvhBuildTime(0)
 {
 };
 
+void Scene::buildBVH()
+{
+    auto start = std::chrono::steady_clock::now();
+    sphereBVH.build(sphereBounds(spheres));
+    for (Prototype& prototype: prototypes)
+        prototype.buildBVH();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    bvhBuildTime = elapsed.count();
+    buildInstanceBVH();
+}
+
+void Scene::buildInstanceBVH()
+{
+    if (instances.empty())
+    {
+        instanceBVH = BVH();
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<AABB> prototypeBounds;
+    prototypeBounds.reserve(prototypes.size());
+    for (const Prototype& prototype: prototypes)
+        prototypeBounds.push_back(prototype.bounds());
+
+    std::vector<AABB> bounds;
+    bounds.reserve(instances.size());
+    for (const Instance& instance: instances)
+        bounds.push_back(prototypeBounds[instance.prototype].transformed(instance.transform));
+    instanceBVH.build(bounds);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    bvhBuildTime += elapsed.count();
+}
+
+std::string Scene::bvhStatistics() const
+{
+    size_t nodeCount = sphereBVH.nodeCount() + instanceBVH.nodeCount();
+    for (const Prototype& prototype: prototypes)
+        nodeCount += prototype.sphereBVH.nodeCount();
+
+    std::ostringstream s;
+    s << spheres.size() << " spheres, " << instances.size() << " instances, "
+      << nodeCount << " nodes, SAH cost " << sphereBVH.sahCost();
+    if (!instanceBVH.empty())
+        s << " (instances " << instanceBVH.sahCost() << ")";
+    if (bvhBuildTime > 0)
+        s << ", built in " << bvhBuildTime * 1000 << " ms";
+    else
+        s << ", loaded from the cache";
+    return s.str();
+}
+
+void Prototype::buildBVH()
+{
+    sphereBVH.build(sphereBounds(spheres));
+}
+
+AABB Prototype::bounds() const
+{
+    AABB box;
+    if (sphereBVH.indexCount() == spheres.size())
+    {
+        if (!sphereBVH.empty())
+            box.extend(AABB(sphereBVH.nodes()[0].min, sphereBVH.nodes()[0].max));
+    }
+    else
+    {
+        for (const Sphere& sphere: spheres)
+            box.extend(sphere.bounds());
+    }
+    for (const Mesh& mesh: meshes)
+        box.extend(mesh.bounds());
+    return box;
+}
+
+Instance::Instance():
+    prototype(0)
+{
+}
+
+AABB Sphere::bounds() const
+{
+    // The half extent of a transformed sphere along each axis is the radius
+    // scaled by the length of the corresponding row of the transform.
+    glm::vec3 center(transform[3]);
+    glm::vec3 extent;
+    for (int i = 0; i < 3; i++)
+        extent[i] = radius * glm::length(glm::vec3(transform[0][i], transform[1][i], transform[2][i]));
+    return AABB(center - extent, center + extent);
+}
+
+AABB Mesh::bounds() const
+{
+    return data ? data->bounds().transformed(transform) : AABB();
+}
+
 Material::Material():
     specularExponent(0),
     refractiveIndex(1)
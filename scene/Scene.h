@@ -2,7 +2,13 @@
 #ifndef SCENE_H
 #define SCENE_H
 
+#include "BVH.h"
+#include "Mesh.h"
+
 #include <glm/glm.hpp>
+#include <memory>
+#include <stdint.h>
+#include <string>
 #include <vector>
 
 namespace scene
@@ -25,6 +31,8 @@ public:
 class Sphere
 {
 public:
+    AABB bounds() const;
+
     glm::mat4 transform;
     Material material;
     float radius;
@@ -37,6 +45,50 @@ public:
     Material material;
 };
 
+typedef std::vector<Sphere> SphereList;
+typedef std::vector<Plane> PlaneList;
+
+class Mesh
+{
+public:
+    AABB bounds() const;
+
+    glm::mat4 transform;
+    Material material;
+
+    // Path of the mesh file as given in the scene, and its loaded contents.
+    std::string fileName;
+    std::shared_ptr<const MeshData> data;
+};
+
+typedef std::vector<Mesh> MeshList;
+
+/**
+ *  Group of spheres and meshes in its own coordinate space, which is placed
+ *  in the scene any number of times through instances. All instances share
+ *  the geometry, materials and hierarchy of the prototype.
+ */
+class Prototype
+{
+public:
+    void buildBVH();
+    AABB bounds() const;
+
+    std::string name;
+    SphereList spheres;
+    MeshList meshes;
+    BVH sphereBVH;
+};
+
+class Instance
+{
+public:
+    Instance();
+
+    glm::mat4 transform;
+    uint32_t prototype; // Index to Scene::prototypes
+};
+
 class Camera
 {
 public:
@@ -44,20 +96,43 @@ public:
     glm::mat4 projection;
 };
 
-typedef std::vector<Sphere> SphereList;
-typedef std::vector<Plane> PlaneList;
+typedef std::vector<Prototype> PrototypeList;
+typedef std::vector<Instance> InstanceList;
 
 class Scene
 {
 public:
     Scene();
 
+    // Builds the hierarchies over the spheres, inside each prototype and
+    // over the instances. Planes are unbounded and are not part of them.
+    // Mesh data must be loaded first.
+    void buildBVH();
+
+    // Rebuilds only the top level hierarchy over the instances, which is
+    // enough after instances have moved.
+    void buildInstanceBVH();
+
+    // Describes the size and quality of the hierarchies and the time spent
+    // building them.
+    std::string bvhStatistics() const;
+
     glm::vec4 backgroundColor;
 
     Camera camera;
 
     SphereList spheres;
     PlaneList planes;
+    MeshList meshes;
+    PrototypeList prototypes;
+    InstanceList instances;
+
+    BVH sphereBVH;
+    BVH instanceBVH;
+
+    // Seconds spent building the hierarchies, which is zero when they were
+    // loaded from the cache.
+    double bvhBuildTime;
 };
 
 } // namespace scene
@@ -1,11 +0,0 @@
-// The functions available, 1 single header to make things easier
-
-// The print out function
-void print_out(const wchar_t *output);
-
-// Example functions
-void example1();
-void example2();
-
-// Test case runner
-void run_tests();
@@ -1,24 +0,0 @@
-//{{NO_DEPENDENCIES}}
-// Microsoft Visual C++ generated include file.
-// Used by gui.rc
-//
-#define IDD_JSONDEMO                    101
-#define IDC_INPUT                       1001
-#define IDC_OUTPUT                      1002
-#define IDC_VERIFY                      1003
-#define IDC_ECHO                        1004
-#define IDC_EX1                         1005
-#define IDC_EX2                         1006
-#define IDC_EX3                         1007
-#define IDC_TESTCASES                   1007
-
-// Next default values for new objects
-// 
-#ifdef APSTUDIO_INVOKED
-#ifndef APSTUDIO_READONLY_SYMBOLS
-#define _APS_NEXT_RESOURCE_VALUE        102
-#define _APS_NEXT_COMMAND_VALUE         40001
-#define _APS_NEXT_CONTROL_VALUE         1007
-#define _APS_NEXT_SYMED_VALUE           101
-#endif
-#endif
@@ -0,0 +1,169 @@
+// Copyright (C) 2013 Sami Kyöstilä
+//
+// Checks the error bounds documented in renderer/cpu/FastMath.h against the
+// double precision library functions. Returns nonzero if any bound is
+// exceeded. The optional argument sets the number of random arguments tried
+// for each function. The check runs as a test of the cmake build; to check
+// the AVX2 kernels, build it by hand with their flags:
+//
+//   g++ -O3 -ffast-math -std=c++0x -mavx2 -mfma -I. tools/FastMathCheck.cpp
+
+#include "renderer/cpu/FastMath.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+namespace
+{
+
+// Samples for each function unless given on the command line.
+const int g_defaultSamples = 2000000;
+
+class Check
+{
+public:
+    Check(const char* name):
+        m_name(name),
+        m_worstRatio(0),
+        m_worstArgument(0),
+        m_worstSecondArgument(0)
+    {
+    }
+
+    /**
+     *  Records the |error| of a result for |x| (and |y|), which may be at most
+     *  |bound|.
+     */
+    void add(double error, double bound, double x, double y = 0)
+    {
+        double ratio = std::isnan(error) ? HUGE_VAL : error / bound;
+        if (ratio > m_worstRatio)
+        {
+            m_worstRatio = ratio;
+            m_worstArgument = x;
+            m_worstSecondArgument = y;
+        }
+    }
+
+    bool report() const
+    {
+        bool passed = m_worstRatio <= 1;
+        std::cout << (passed ? "ok    " : "FAIL  ") << m_name
+                  << ": worst error " << m_worstRatio << " of the bound at x = " << m_worstArgument;
+        if (m_worstSecondArgument)
+            std::cout << ", y = " << m_worstSecondArgument;
+        std::cout << std::endl;
+        return passed;
+    }
+
+private:
+    const char* m_name;
+    double m_worstRatio;
+    double m_worstArgument;
+    double m_worstSecondArgument;
+};
+
+// Returns a positive normal float with a uniformly distributed exponent.
+float positiveNormal(std::mt19937& random)
+{
+    std::uniform_int_distribution<uint32_t> bits(0x00800000, 0x7f7fffff);
+    return cpu::floatFromBits(bits(random));
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    int samples = argc > 1 ? atoi(argv[1]) : g_defaultSamples;
+    std::mt19937 random(0715517);
+    bool passed = true;
+
+    {
+        Check sinCheck("fastSin, |x| <= 2 * pi"), cosCheck("fastCos, |x| <= 2 * pi");
+        std::uniform_real_distribution<float> argument(float(-2 * M_PI), float(2 * M_PI));
+        for (int i = 0; i < samples; i++)
+        {
+            float x = argument(random);
+            float sine, cosine;
+            cpu::fastSinCos(x, sine, cosine);
+            sinCheck.add(fabs(sine - sin(double(x))), 2e-7, x);
+            cosCheck.add(fabs(cosine - cos(double(x))), 2e-7, x);
+        }
+        passed &= sinCheck.report();
+        passed &= cosCheck.report();
+    }
+
+    {
+        Check sinCheck("fastSin, |x| > 2 * pi"), cosCheck("fastCos, |x| > 2 * pi");
+        std::uniform_real_distribution<float> exponent(float(log2(2 * M_PI)), 20);
+        for (int i = 0; i < samples; i++)
+        {
+            float x = exp2f(exponent(random)) * (i & 1 ? -1 : 1);
+            float sine, cosine;
+            cpu::fastSinCos(x, sine, cosine);
+            sinCheck.add(fabs(sine - sin(double(x))), 1.1e-7 * fabs(x), x);
+            cosCheck.add(fabs(cosine - cos(double(x))), 1.1e-7 * fabs(x), x);
+        }
+        passed &= sinCheck.report();
+        passed &= cosCheck.report();
+    }
+
+    {
+        Check check("fastExp");
+        std::uniform_real_distribution<float> argument(-87, 88);
+        for (int i = 0; i < samples; i++)
+        {
+            float x = argument(random);
+            double expected = exp(double(x));
+            check.add(fabs(cpu::fastExp(x) - expected) / expected, 1.3e-7 * std::max(1., fabs(x)), x);
+        }
+        passed &= check.report();
+    }
+
+    {
+        Check check("fastLog");
+        for (int i = 0; i < samples; i++)
+        {
+            float x = positiveNormal(random);
+            double expected = log(double(x));
+            check.add(fabs(cpu::fastLog(x) - expected), 1.7e-7 * std::max(1., fabs(expected)), x);
+        }
+        passed &= check.report();
+    }
+
+    {
+        // The exponent is limited so that the result stays within the
+        // clamped range of fastExp.
+        Check check("fastPow");
+        std::uniform_real_distribution<float> exponent(-16, 16);
+        for (int i = 0; i < samples; i++)
+        {
+            float x = positiveNormal(random);
+            float y = exponent(random);
+            double product = y * log(double(x));
+            if (product < -87 || product > 88)
+                continue;
+            double expected = exp(product);
+            check.add(fabs(cpu::fastPow(x, y) - expected) / expected, 2.8e-7 * (1 + fabs(product)), x, y);
+        }
+        check.add(cpu::fastPow(0, 2) != 0, 1, 0, 2);
+        check.add(cpu::fastPow(0, 0) != 1, 1, 0, 0);
+        passed &= check.report();
+    }
+
+    {
+        Check check("fastAcos");
+        std::uniform_real_distribution<float> argument(-1, 1);
+        for (int i = 0; i < samples; i++)
+        {
+            float x = argument(random);
+            check.add(fabs(cpu::fastAcos(x) - acos(double(x))), 3.6e-7, x);
+        }
+        check.add(fabs(cpu::fastAcos(1)), 3.6e-7, 1);
+        check.add(fabs(cpu::fastAcos(-1) - M_PI), 3.6e-7, -1);
+        passed &= check.report();
+    }
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
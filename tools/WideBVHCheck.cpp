@@ -0,0 +1,115 @@
+// Copyright (C) 2013 Sami Kyöstilä
+//
+// Traces rays through the full precision and the quantized wide bounding
+// volume hierarchies of the cpu renderer and checks that both visit every
+// box the rays hit. Half of the rays are parallel to an axis, which makes
+// the inverse direction of the other axes infinite. Returns nonzero if a hit
+// is missed.
+
+#include "renderer/cpu/WideBVH.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+const int g_boxCount = 20000;
+const int g_rayCount = 4000;
+
+/**
+ *  Returns true if |ray| hits |box|, using exact comparisons for the axes
+ *  the ray is parallel to.
+ */
+bool hits(const cpu::Ray& ray, const scene::AABB& box)
+{
+    double tMin = ray.minDistance;
+    double tMax = ray.maxDistance;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double origin = ray.origin[axis];
+        double direction = ray.direction[axis];
+        if (!direction)
+        {
+            if (origin < box.min[axis] || origin > box.max[axis])
+                return false;
+            continue;
+        }
+        double t0 = (box.min[axis] - origin) / direction;
+        double t1 = (box.max[axis] - origin) / direction;
+        tMin = std::max(tMin, std::min(t0, t1));
+        tMax = std::min(tMax, std::max(t0, t1));
+    }
+    return tMin <= tMax;
+}
+
+// Returns the number of boxes hit by |ray| that the traversal of |bvh| misses.
+int missedBoxes(const cpu::WideBVH& bvh, const std::vector<scene::AABB>& boxes, const cpu::Ray& ray)
+{
+    std::vector<bool> visited(boxes.size());
+    const uint32_t* indices = bvh.indices();
+    bvh.traverse(ray, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++)
+            visited[indices[i]] = true;
+        return false;
+    });
+
+    int missed = 0;
+    for (size_t i = 0; i < boxes.size(); i++)
+        missed += !visited[i] && hits(ray, boxes[i]);
+    return missed;
+}
+
+}
+
+int main()
+{
+    std::mt19937 random(0715517);
+    std::uniform_real_distribution<float> position(-10, 10);
+    std::uniform_real_distribution<float> size(.01f, .5f);
+
+    std::vector<scene::AABB> boxes;
+    for (int i = 0; i < g_boxCount; i++)
+    {
+        glm::vec3 min(position(random), position(random), position(random));
+        glm::vec3 extent(size(random), size(random), size(random));
+        boxes.push_back(scene::AABB(min, min + extent));
+    }
+    scene::BVH binaryBVH;
+    binaryBVH.build(boxes);
+    cpu::WideBVH fullBVH(binaryBVH, cpu::WideBVH::Format::Full);
+    cpu::WideBVH quantizedBVH(binaryBVH, cpu::WideBVH::Format::Quantized);
+
+    int fullMissed = 0;
+    int quantizedMissed = 0;
+    for (int i = 0; i < g_rayCount; i++)
+    {
+        cpu::Ray ray;
+        ray.origin = glm::vec3(position(random), position(random), position(random));
+        ray.minDistance = 0;
+        ray.maxDistance = std::numeric_limits<float>::infinity();
+        if (i & 1)
+        {
+            ray.direction = glm::vec3(position(random), position(random), position(random));
+        }
+        else
+        {
+            // Start the axis-aligned rays outside the boxes so that they
+            // cross several of them.
+            int axis = (i / 2) % 3;
+            float sign = (i / 6) & 1 ? -1.f : 1.f;
+            ray.direction = glm::vec3(0);
+            ray.direction[axis] = sign;
+            ray.origin[axis] = -20 * sign;
+        }
+        fullMissed += missedBoxes(fullBVH, boxes, ray);
+        quantizedMissed += missedBoxes(quantizedBVH, boxes, ray);
+    }
+
+    std::cout << "Missed " << fullMissed << " hits with full precision nodes and "
+              << quantizedMissed << " with quantized nodes" << std::endl;
+    return fullMissed || quantizedMissed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
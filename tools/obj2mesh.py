@@ -0,0 +1,38 @@
+#!/usr/bin/env python
+# Copyright (C) 2013 Sami Kyöstilä
+"""Converts the vertices and faces of a Wavefront OBJ file into a Kajo mesh
+file. Polygons are split into triangle fans."""
+
+import struct
+import sys
+
+def convert(input, output):
+    vertices = []
+    triangles = []
+    for line in input:
+        fields = line.split()
+        if not fields:
+            continue
+        if fields[0] == 'v':
+            vertices.append(tuple(float(x) for x in fields[1:4]))
+        elif fields[0] == 'f':
+            face = []
+            for field in fields[1:]:
+                index = int(field.split('/')[0])
+                face.append(index - 1 if index > 0 else len(vertices) + index)
+            for i in range(1, len(face) - 1):
+                triangles.append((face[0], face[i], face[i + 1]))
+
+    output.write(b'KAJOMSH\0')
+    output.write(struct.pack('<4I', 1, len(vertices), len(triangles), 0))
+    for vertex in vertices:
+        output.write(struct.pack('<3f', *vertex))
+    for triangle in triangles:
+        output.write(struct.pack('<3I', *triangle))
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3:
+        print('Usage: %s INPUT.obj OUTPUT.mesh' % sys.argv[0])
+        sys.exit(1)
+    with open(sys.argv[1]) as input, open(sys.argv[2], 'wb') as output:
+        convert(input, output)